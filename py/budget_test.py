@@ -0,0 +1,64 @@
+import sys
+import libcutsim
+from meshcheck import Sim, open_edge_list, weld, covered, check
+
+# Test that a memory budget keeps the octree within it, and that away from the coarsened
+# regions the mesh is that of a simulation without budget, and as closed
+
+def resident(sim):
+    s = sim.cs.get_tree_stats()
+    return s.node_bytes + s.brick_bytes + s.packed_bytes
+
+def inside(items, centers, h):
+    """the triangles or edges with all vertices within the boxes of half-size h at the centers"""
+    return [t for t in items
+            if all(any(max(abs(p - q) for p, q in zip(v, c)) < h for c in centers) for v in t)]
+
+def main():
+    # two passes over the left of the stock, then 8 cuts on stock that only the stock
+    # itself was coarsened at, away from its edges where the distance field is not linear
+    left = [(-3.3 + 2.0 * (i % 10) / 9.0, -3.0 + 0.5 * (i // 10), z) for z in (0.011, -0.489) for i in range(120)]
+    last = [(0.6 + 0.2 * i, 0.2 + 0.05 * i, -0.289) for i in range(8)]
+
+    fresh = Sim(max_depth=8)
+    fresh.stock()
+    fresh.cut(left + last)
+    full = resident(fresh)
+    expected = fresh.triangles()
+    del fresh  # the budget counts the nodes of all Cutsims of the process
+    print("fresh:", len(expected), "triangles,", full, "bytes")
+
+    budget = full // 2
+    sim = Sim(max_depth=8)
+    sim.cs.set_memory_budget(budget)
+    sim.stock()
+    ok = check("stock within budget", resident(sim) <= budget)
+    peak = 0
+    for move in left + last:
+        sim.cut([move])
+        peak = max(peak, resident(sim))
+    mesh = sim.triangles()
+    print("budget:", len(mesh), "triangles,", peak, "bytes at most,", sim.cs.coarsened_count(), "regions coarsened")
+    ok &= check("within budget", peak <= budget and sim.cs.coarsened_count() > 0)
+    ok &= check("coarser mesh", len(mesh) < len(expected))
+
+    # the cells of the last 8 cuts are kept. 0.15 inside the cutter boxes the mesh is that of the
+    # fresh simulation, up to the rounding of corners interpolated from the coarsened stock.
+    # Open edges are counted after welding that rounding: the fresh mesh has some of its own,
+    # where a cut left the corners that neighbouring nodes share with different values
+    h = 0.65
+    kept = inside(expected, last, h)
+    around = inside(mesh, last, h)
+    ok &= check("mesh of the last cuts", len(kept) > 100 and covered(kept, mesh, 0.001) and covered(around, expected, 0.001))
+    gaps = len(inside(open_edge_list(weld(mesh, 0.001)), last, h))
+    fresh_gaps = len(inside(open_edge_list(weld(expected, 0.001)), last, h))
+    print("open edges around the last cuts:", gaps, "with budget,", fresh_gaps, "without")
+    ok &= check("open edges of the last cuts", gaps <= fresh_gaps)
+
+    sim.cs.set_memory_budget(0)
+    ok &= check("budget off", sim.cs.get_depth_limit() == 8)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
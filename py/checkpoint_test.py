@@ -0,0 +1,56 @@
+import os
+import sys
+import tempfile
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test save_checkpoint() and load_checkpoint() against a fresh simulation of the same moves,
+# and that damaged checkpoints are refused without changing the stock
+
+def main():
+    first = moves(30)
+    second = moves(30, z=-0.5, phase=0.3)
+
+    fresh = Sim()
+    fresh.stock()
+    fresh.cut(first + second)
+    expected = fresh.triangles()
+    print("fresh:", len(expected), "triangles")
+
+    dir = tempfile.mkdtemp()
+    path = os.path.join(dir, "stock.ckpt")
+    sim = Sim()
+    sim.stock()
+    sim.cut(first)
+    ok = check("save", sim.cs.save_checkpoint(path))
+    ok &= check("save async", sim.cs.save_checkpoint_async(path + ".async", False) and sim.cs.wait_checkpoint())
+
+    for name, file, map in (("load", path, False), ("load mapped", path, True), ("load async", path + ".async", False)):
+        resumed = Sim()
+        ok &= check(name, resumed.cs.load_checkpoint(file, map))
+        resumed.cut(second)
+        ok &= check(name + " mesh", resumed.triangles() == expected)
+
+    # damaged copies: a flipped byte in the middle, and the file cut short
+    data = open(path, "rb").read()
+    flipped = bytearray(data)
+    flipped[len(data) // 2] ^= 0xff
+    damaged = {"flipped": bytes(flipped), "truncated": data[:len(data) // 2], "empty": b""}
+    for name, content in sorted(damaged.items()):
+        bad = os.path.join(dir, name + ".ckpt")
+        open(bad, "wb").write(content)
+        resumed = Sim()
+        resumed.stock()
+        resumed.cut(first)
+        for map in (False, True):
+            ok &= check(name + " refused", not resumed.cs.load_checkpoint(bad, map))
+        resumed.cut(second)  # the stock is as before the failed loads
+        ok &= check(name + " stock kept", resumed.triangles() == expected)
+
+    ok &= check("other tiles refused", not Sim(size=12.0).cs.load_checkpoint(path, False))
+    ok &= check("missing file refused", not Sim().cs.load_checkpoint(os.path.join(dir, "none"), False))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,57 @@
+import os
+import sys
+import tempfile
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test a chain of delta checkpoints against a fresh simulation of the same moves
+
+def main():
+    steps = [moves(20), moves(20, z=-0.5, phase=0.3), moves(20, z=-1.0, phase=0.6)]
+    last = moves(20, z=-0.2, phase=1.2)
+
+    fresh = Sim()
+    fresh.stock()
+    fresh.cut(steps[0] + steps[1] + steps[2] + last)
+    expected = fresh.triangles()
+    print("fresh:", len(expected), "triangles")
+
+    dir = tempfile.mkdtemp()
+    chain = [os.path.join(dir, "stock.%d" % n) for n in range(len(steps))]
+    sim = Sim()
+    sim.stock()
+    ok = check("no delta before a checkpoint", not sim.cs.save_delta_checkpoint(chain[0]))
+    sim.cut(steps[0])
+    ok &= check("full", sim.cs.save_checkpoint(chain[0]))
+    sim.cut(steps[1])
+    ok &= check("delta 1", sim.cs.save_delta_checkpoint(chain[1]))
+    sim.cut(steps[2])
+    ok &= check("delta 2 async", sim.cs.save_checkpoint_async(chain[2], True) and sim.cs.wait_checkpoint())
+    ok &= check("deltas smaller", os.path.getsize(chain[1]) < os.path.getsize(chain[0]))
+
+    resumed = Sim()
+    ok &= check("delta without its checkpoint refused", not resumed.cs.load_checkpoint(chain[1], False))
+    for n, path in enumerate(chain):
+        ok &= check("load %d" % n, resumed.cs.load_checkpoint(path, n % 2 == 1))
+    ok &= check("delta again refused", not resumed.cs.load_checkpoint(chain[2], False))
+    resumed.cut(last)
+    ok &= check("resumed mesh", resumed.triangles() == expected)
+
+    # a delta out of order, and a damaged one, leave the stock as of the checkpoint before
+    skipped = Sim()
+    ok &= check("load full", skipped.cs.load_checkpoint(chain[0], False))
+    ok &= check("delta 2 before 1 refused", not skipped.cs.load_checkpoint(chain[2], False))
+    data = bytearray(open(chain[1], "rb").read())
+    data[len(data) // 2] ^= 0xff
+    damaged = os.path.join(dir, "damaged.1")
+    open(damaged, "wb").write(bytes(data))
+    ok &= check("damaged delta refused", not skipped.cs.load_checkpoint(damaged, False))
+    for path in chain[1:]:
+        ok &= check("chain after refusals", skipped.cs.load_checkpoint(path, False))
+    skipped.cut(last)
+    ok &= check("mesh after refusals", skipped.triangles() == expected)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,56 @@
+import sys
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test that the distance cache leaves the mesh unchanged, and that the primitives bypass it
+
+def cube_tool(h):
+    """a MeshVolume cube of half-side h, as 12 facets of (normal, v1, v2, v3)"""
+    facets = []
+    for axis in range(3):
+        for sign in (-1.0, 1.0):
+            n = [0.0, 0.0, 0.0]
+            n[axis] = sign
+            u, v = (axis + 1) % 3, (axis + 2) % 3
+            corners = []
+            for a, b in ((-1, -1), (1, -1), (1, 1), (-1, 1)):
+                p = [0.0, 0.0, 0.0]
+                p[axis], p[u], p[v] = sign * h, a * h, b * h
+                corners.append(tuple(p))
+            if sign < 0:
+                corners.reverse()
+            facets.append([tuple(n), corners[0], corners[1], corners[2]])
+            facets.append([tuple(n), corners[0], corners[2], corners[3]])
+    tool = libcutsim.MeshVolume()
+    tool.loadMesh(facets)
+    return tool
+
+def mesh_cut(sim, path):
+    tool = cube_tool(0.6)
+    for (x, y, z) in path:
+        tool.setMeshCenter(x, y, z)
+        sim.cs.diff_volume(tool)
+
+def main():
+    path = moves(12, -0.3, 0.0)
+    plain, cached = Sim(), Sim()
+    cached.cs.set_dist_cache(True)
+    empty = cached.cs.get_tree_stats().distcache_bytes
+    for sim in (plain, cached):
+        sim.stock()
+    # the table would grow for init_stock() and only shrink at the next operation
+    ok = check("primitives bypass the cache", cached.cs.get_tree_stats().distcache_bytes == empty)
+    for sim in (plain, cached):
+        sim.cut(path)
+    ok &= check("primitives same mesh", cached.triangles() == plain.triangles())
+
+    before = plain.triangles()
+    for sim in (plain, cached):
+        mesh_cut(sim, moves(12, -1.5, 0.5))
+    ok &= check("mesh tool cuts", plain.triangles() != before)
+    ok &= check("mesh tool same mesh", cached.triangles() == plain.triangles())
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,44 @@
+import sys
+import libcutsim
+from meshcheck import Sim, open_edges, check
+
+# Test extruded stock, and that a profile of fewer than 3 points is refused
+
+def volume(triangles):
+    """the volume enclosed by the triangles, by the divergence theorem"""
+    v = 0.0
+    for a, b, c in triangles:
+        v += (a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0])
+              + a[2] * (b[0] * c[1] - b[1] * c[0]))
+    return v / 6
+
+def main():
+    profile = [(-4, -4), (4, -4), (4, -1), (0.3, 0.7), (-1, 4), (-4, 4)]  # not convex
+    area = 0.5 * abs(sum(x0 * y1 - x1 * y0 for (x0, y0), (x1, y1) in zip(profile, profile[1:] + profile[:1])))
+    stock = libcutsim.ExtrusionVolume()
+    for x, y in profile:
+        stock.addPoint(x, y)
+    stock.setLength(3.0)
+    stock.setCenter(0.013, 0.021, -3.017)
+
+    sim = Sim(max_depth=8)
+    sim.cs.init_stock(stock)
+    mesh = sim.triangles()
+    print("extrusion:", len(mesh), "triangles,", volume(mesh), "volume of", area * 3.0)
+    ok = check("closed", open_edges(mesh) == 0)
+    ok &= check("volume", abs(volume(mesh) - area * 3.0) < 0.01 * area * 3.0)
+
+    line = libcutsim.ExtrusionVolume()
+    line.addPoint(0, 0)
+    line.addPoint(1, 1)
+    line.setLength(10.0)
+    sim.cs.diff_volume(line)
+    sim.cs.sum_volume(line)
+    sim.cs.intersect_volume(line)
+    sim.cs.init_stock(line)
+    ok &= check("short profile refused", sim.triangles() == mesh)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,114 @@
+import libcutsim
+
+# helpers for the tests that compare the mesh of a simulation with that of a fresh one
+
+class Sim:
+    """a Cutsim together with the GLData and MarchingCubes it draws with, which must outlive it"""
+    def __init__(self, snapshot=None, size=10.0, max_depth=7):
+        self.gl = libcutsim.GLData()
+        self.iso = libcutsim.MarchingCubes()
+        if snapshot is None:
+            self.cs = libcutsim.Cutsim(size, max_depth, self.gl, self.iso)
+        else:
+            self.cs = libcutsim.Cutsim(snapshot, self.gl, self.iso)
+
+    def stock(self):
+        """a box of stock, its top at z = 0"""
+        box = libcutsim.BoxVolume()
+        box.setSize(8, 8, 4)
+        box.setCenter(0.013, 0.021, -2.017)  # off the lattice, no corner is exactly on the surface
+        self.cs.init_stock(box)
+
+    def cut(self, moves):
+        """diff a sphere at each of the (x, y, z) moves"""
+        cutter = libcutsim.SphereVolume()
+        cutter.setRadius(0.8)
+        for (x, y, z) in moves:
+            cutter.setCenter(x, y, z)
+            self.cs.diff_volume(cutter)
+
+    def triangles(self):
+        """the mesh as a sorted list of triangles, each starting at its smallest vertex"""
+        self.cs.updateGL()
+        out = []
+        for tri in self.gl.get_triangles():
+            t = [(round(v.x, 4), round(v.y, 4), round(v.z, 4)) for v in tri]
+            n = t.index(min(t))
+            out.append(tuple(t[n:] + t[:n]))
+        out.sort()
+        return out
+
+
+def moves(n, z=0.0, phase=0.0):
+    """n cutter positions along a zig-zag over the top of the stock"""
+    return [(-3.0 + 6.0 * (i % 10) / 9.0, -3.0 + 0.6 * (i // 10) + phase, z + 0.011) for i in range(n)]
+
+
+def open_edge_list(triangles):
+    """the edges used by only one triangle, none for a closed surface"""
+    count = {}
+    for t in triangles:
+        for a, b in ((t[0], t[1]), (t[1], t[2]), (t[2], t[0])):
+            e = (min(a, b), max(a, b))
+            count[e] = count.get(e, 0) + 1
+    return [e for e, c in count.items() if c == 1]
+
+
+def open_edges(triangles):
+    """number of edges used by only one triangle, 0 for a closed surface"""
+    return len(open_edge_list(triangles))
+
+
+def near(items, centers, r):
+    """the triangles or edges with all vertices within r of one of the centers"""
+    def close(v):
+        return min((v[0] - c[0]) ** 2 + (v[1] - c[1]) ** 2 + (v[2] - c[2]) ** 2 for c in centers) < r * r
+    return [t for t in items if all(close(v) for v in t)]
+
+
+def _cell(v, eps):
+    return tuple(int(x // eps) for x in v)
+
+
+def _nearby(grid, v, eps):
+    """the vertices in grid within eps of v, in the max-norm"""
+    c = _cell(v, eps)
+    for dx in (-1, 0, 1):
+        for dy in (-1, 0, 1):
+            for dz in (-1, 0, 1):
+                for w in grid.get((c[0] + dx, c[1] + dy, c[2] + dz), ()):
+                    if max(abs(p - q) for p, q in zip(v, w)) <= eps:
+                        yield w
+
+
+def covered(a, b, eps):
+    """true if each vertex of the triangles a is within eps of a vertex of the triangles b"""
+    grid = {}
+    for t in b:
+        for v in t:
+            grid.setdefault(_cell(v, eps), []).append(v)
+    return all(any(True for _ in _nearby(grid, v, eps)) for t in a for v in t)
+
+
+def weld(triangles, eps):
+    """the triangles with the vertices within eps of each other merged, without the degenerate ones.
+    The open edges that remain are gaps wider than eps, not the rounding of the vertex positions."""
+    grid = {}
+    out = []
+    for t in triangles:
+        w = []
+        for v in t:
+            r = next(_nearby(grid, v, eps), None)
+            if r is None:
+                r = v
+                grid.setdefault(_cell(v, eps), []).append(v)
+            w.append(r)
+        if len(set(w)) == 3:
+            out.append(tuple(w))
+    return out
+
+
+def check(name, ok):
+    """print the result of one check, return ok"""
+    print(name, "OK" if ok else "FAILED")
+    return ok
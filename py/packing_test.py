@@ -0,0 +1,37 @@
+import sys
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test packing idle sub-trees and reading them back against a fresh simulation of the same moves
+
+def main():
+    first = moves(40)
+    second = moves(40, z=-0.5, phase=0.3)
+
+    fresh = Sim()
+    fresh.stock()
+    fresh.cut(first + second)
+    expected = fresh.triangles()
+    print("fresh:", len(expected), "triangles")
+
+    sim = Sim()
+    sim.stock()
+    sim.cs.set_packing(4)
+    sim.triangles()  # a sub-tree still to be meshed is not packed
+    sim.cut(first)
+    sim.triangles()
+    unpacked = sim.cs.get_tree_stats().total_bytes()
+    packed = sim.cs.pack()
+    print("packed", packed, "sub-trees,", unpacked, "bytes before,", sim.cs.get_tree_stats().total_bytes(), "after")
+    ok = check("packed", packed > 0 and sim.cs.get_tree_stats().total_bytes() < unpacked)
+    sim.cut(second)  # reads back the packed sub-trees that the cuts reach
+    ok &= check("packed mesh", sim.triangles() == expected)
+
+    sim.cs.set_packing(0)  # reads all packed sub-trees back
+    ok &= check("nothing packed", sim.cs.pack() == 0)
+    ok &= check("read back mesh", sim.triangles() == expected)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,38 @@
+import os
+import sys
+import tempfile
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test paging sub-trees out to a file and back against a fresh simulation of the same moves
+
+def main():
+    first = moves(40)
+    second = moves(40, z=-0.5, phase=0.3)
+
+    fresh = Sim()
+    fresh.stock()
+    fresh.cut(first + second)
+    expected = fresh.triangles()
+    print("fresh:", len(expected), "triangles")
+
+    path = os.path.join(tempfile.mkdtemp(), "pages")
+    sim = Sim()
+    sim.stock()
+    ok = check("paging on", sim.cs.set_paging(path, 1))  # a budget of one byte pages all it can
+    sim.cut(first)  # pages out after each cut
+    paged = sim.cs.get_tree_stats().total_bytes()
+    resident = fresh.cs.get_tree_stats().total_bytes()
+    print("in memory:", paged, "bytes paged,", resident, "not paged")
+    ok &= check("paged", paged < resident / 2 and os.path.getsize(path + ".0") > 0)
+    sim.cut(second)  # reads back the pages that the cuts reach
+    ok &= check("paged mesh", sim.triangles() == expected)
+
+    ok &= check("paging off", sim.cs.set_paging("", 0))  # reads all pages back
+    ok &= check("read back mesh", sim.triangles() == expected)
+    ok &= check("bad path refused", not Sim().cs.set_paging(os.path.join(path, "no", "dir"), 1))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,38 @@
+import sys
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test snapshot(), fork and restore() against a fresh simulation of the same moves
+
+def main():
+    first = moves(30)
+    second = moves(30, z=-0.5, phase=0.3)
+
+    fresh = Sim()
+    fresh.stock()
+    fresh.cut(first + second)
+    expected = fresh.triangles()
+    print("fresh:", len(expected), "triangles")
+
+    sim = Sim()
+    sim.stock()
+    sim.cut(first)
+    snapshot = sim.cs.snapshot()
+    sim.cut(moves(20, z=-1.0, phase=1.0))  # a variant that is thrown away again
+    ok = check("variant differs", sim.triangles() != expected)
+
+    fork = Sim(snapshot)  # starts from the snapshot, the variant is not in it
+    fork.cut(second)
+    ok &= check("fork", fork.triangles() == expected)
+
+    ok &= check("restore", sim.cs.restore(snapshot))
+    sim.cut(second)
+    ok &= check("restored mesh", sim.triangles() == expected)
+
+    other = Sim(size=12.0)  # a different tile, restore must refuse it
+    ok &= check("restore other tiles refused", not other.cs.restore(snapshot))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,27 @@
+import sys
+import libcutsim
+from meshcheck import Sim, check
+
+# Test the tree statistics of a tree that init() subdivided below max_depth
+
+def main():
+    ok = True
+    for n in (3, 4, 5):
+        sim = Sim(max_depth=3)
+        sim.cs.init(n)
+        s = sim.cs.get_tree_stats()
+        text = str(sim.cs)
+        print("init(%d):" % n, s.node_count, "nodes,", s.leaf_count, "leaves")
+        leaves = 8 ** n
+        nodes = sum(8 ** d for d in range(n + 1))
+        ok &= check("init(%d) depths" % n, len(s.nodes) == n + 1 and len(s.leaves) == n + 1)
+        ok &= check("init(%d) nodes per depth" % n, s.nodes == [8 ** d for d in range(n + 1)])
+        ok &= check("init(%d) leaves per depth" % n, s.leaves == [0] * n + [leaves])
+        ok &= check("init(%d) counts" % n, s.node_count == nodes and s.leaf_count == leaves)
+        ok &= check("init(%d) leaf_count" % n, sim.cs.leaf_count() == leaves)
+        ok &= check("init(%d) str" % n, ("depth %d: %d nodes, %d leaves" % (n, leaves, leaves)) in text)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,62 @@
+import sys
+import libcutsim
+from meshcheck import Sim, moves, open_edge_list, covered, check
+
+# Test set_refine_tolerance(): fewer nodes for the same surface, and count the open edges of
+# the mesh, which is not watertight where coarse and fine leaves meet
+
+def volume(triangles):
+    """the volume enclosed by the triangles, by the divergence theorem"""
+    v = 0.0
+    for a, b, c in triangles:
+        v += (a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0])
+              + a[2] * (b[0] * c[1] - b[1] * c[0]))
+    return v / 6
+
+def on_box(v, center=(0.013, 0.021, -2.017), half=(4, 4, 2), eps=1e-4):
+    """true if v is on a face of the stock box of Sim.stock()"""
+    inside = all(abs(x - c) <= h + eps for x, c, h in zip(v, center, half))
+    return inside and min(abs(abs(x - c) - h) for x, c, h in zip(v, center, half)) <= eps
+
+def run(tolerance, path):
+    sim = Sim(max_depth=8)
+    if tolerance is not None:
+        sim.cs.set_refine_tolerance(tolerance)
+    sim.stock()
+    sim.cut(path)
+    return sim, sim.triangles()
+
+def main():
+    path = moves(80) + moves(80, z=-0.5, phase=0.3)
+    ok = True
+
+    # off by default, and then the box is closed
+    box, box_mesh = run(None, [])
+    zero, zero_mesh = run(0.0, [])
+    ok &= check("default off", zero.cs.get_refine_tolerance() == 0 and zero_mesh == box_mesh)
+    ok &= check("closed box", len(open_edge_list(box_mesh)) == 0)
+
+    # on the planar faces of the box the coarse leaves give the same surface. The open edges are
+    # T-junctions on the faces, no gaps
+    coarse, coarse_mesh = run(0.001, [])
+    edges = open_edge_list(coarse_mesh)
+    print("box:", len(box_mesh), "triangles,", box.cs.get_tree_stats().node_count, "nodes without tolerance,",
+          len(coarse_mesh), "triangles,", coarse.cs.get_tree_stats().node_count, "nodes,", len(edges), "open edges with")
+    ok &= check("tolerance", abs(coarse.cs.get_refine_tolerance() - 0.001) < 1e-9)
+    ok &= check("fewer nodes", coarse.cs.get_tree_stats().node_count < box.cs.get_tree_stats().node_count / 2)
+    ok &= check("same box volume", abs(volume(coarse_mesh) - volume(box_mesh)) < 1e-4 * volume(box_mesh))
+    ok &= check("T-junctions on the faces", all(on_box(v) for e in edges for v in e))
+
+    # a cut stock: the surface is within about the tolerance of the fine one
+    fine, fine_mesh = run(None, path)
+    cut, cut_mesh = run(0.001, path)
+    print("cut:", len(open_edge_list(fine_mesh)), "open edges without tolerance,",
+          len(open_edge_list(cut_mesh)), "with")
+    ok &= check("fewer nodes cut", cut.cs.get_tree_stats().node_count < fine.cs.get_tree_stats().node_count * 0.7)
+    ok &= check("same cut volume", abs(volume(cut_mesh) - volume(fine_mesh)) < 1e-3 * volume(fine_mesh))
+    ok &= check("close to the fine surface", covered(cut_mesh, fine_mesh, 0.002))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
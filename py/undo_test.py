@@ -0,0 +1,37 @@
+import sys
+import libcutsim
+from meshcheck import Sim, moves, check
+
+# Test undo() against a fresh simulation of the same moves
+
+def main():
+    first = moves(30)
+    second = moves(30, z=-0.5, phase=0.3)
+    variant = moves(12, z=-1.0, phase=1.0)
+
+    fresh = Sim()
+    fresh.stock()
+    fresh.cut(first + second)
+    expected = fresh.triangles()
+    print("fresh:", len(expected), "triangles")
+
+    sim = Sim()
+    sim.cs.set_undo(len(variant))
+    sim.stock()
+    sim.cut(first)
+    sim.triangles()  # meshed before the variant, so that undo() has meshed nodes to revert
+    sim.cut(variant)
+    ok = check("undo count", sim.cs.undo_count() == len(variant))
+    ok &= check("undo", sim.cs.undo(len(variant) + 1) == len(variant))
+    ok &= check("nothing left to undo", sim.cs.undo(1) == 0)
+    sim.cut(second)
+    ok &= check("undone mesh", sim.triangles() == expected)
+
+    sim.cut(variant[:2])
+    sim.cs.snapshot()  # ends the history
+    ok &= check("snapshot ends history", sim.cs.undo_count() == 0 and sim.cs.undo(1) == 0)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,75 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cutsim
+{
+
+    /// A dense block of distance samples that replaces the bottom levels of an Octree.
+    ///
+    /// A Brick belongs to an Octnode, and samples the distance-field on the 9x9x9 lattice of
+    /// the leaf corners below the node, i.e. it has the resolution of cells x cells x cells leaves.
+    /// For the thin shells around the surface of a machined part this is both denser and faster
+    /// to update than the sparse leaves: there are no pointers, no per-leaf state, and the
+    /// boolean operations run as flat loops over rows of samples.
+    /// The samples are 16-bit fixed point relative to the cell size, as for Octnode.
+    /// The Bricks in memory are counted, for the memory budget of paging, see Octree::page_out().
+    struct Brick
+    {
+        Brick() { ++live; }
+        Brick(const Brick &o)
+        {
+            std::copy(o.f, o.f + samples * samples * samples, f);
+            std::copy(o.mat, o.mat + cells * cells * cells, mat);
+            ++live;
+        }
+        ~Brick() { --live; }
+        Brick &operator=(const Brick &) = default;
+        /// number of Bricks in memory
+        static inline std::atomic<std::size_t> live{0};
+
+        /// cells along each axis
+        static const int cells = 8;
+        /// samples along each axis
+        static const int samples = cells + 1;
+        /// offsets of the corners of a cell, in the corner order of Octnode::direction
+        static constexpr int corner[8][3] = {
+            {1, 1, 0}, {0, 1, 0}, {0, 0, 0}, {1, 0, 0},
+            {1, 1, 1}, {0, 1, 1}, {0, 0, 1}, {1, 0, 1}};
+        /// index of sample (i,j,k) in f[]
+        static inline int sample(int i, int j, int k) { return i + samples * (j + samples * k); }
+        /// index of cell (i,j,k) in mat[]
+        static inline int cell(int i, int j, int k) { return i + cells * (j + cells * k); }
+
+        /// distance-field samples, x runs fastest
+        int16_t f[samples * samples * samples];
+        /// material index of each cell, see Palette
+        uint8_t mat[cells * cells * cells];
+    };
+
+} // end namespace
+
+// end file brick.hpp
@@ -0,0 +1,287 @@
+/*
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CUTSIM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "checkpoint.hpp"
+#include "octree.hpp"
+#include "octnode.hpp"
+#include "palette.hpp"
+#include "trace.hpp"
+
+namespace cutsim
+{
+
+    namespace
+    {
+        const char magic[8] = {'C', 'U', 'T', 'S', 'I', 'M', 'C', 'P'};
+        const uint32_t byte_order = 0x01020304;
+        const std::size_t buffer_size = 1 << 16;
+        const uint64_t hash_seed = 0xcbf29ce484222325ULL; // the FNV-1a offset basis
+
+#ifdef CUTSIM_MMAP
+        /// a file mapped read-only into memory, unmapped when done
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(const std::string &path) : data(NULL), size(0)
+            {
+                int fd = open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    return;
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0)
+                {
+                    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (p != MAP_FAILED)
+                    {
+                        data = static_cast<const char *>(p);
+                        size = st.st_size;
+                        madvise(p, size, MADV_SEQUENTIAL); // read once, front to back
+                    }
+                }
+                close(fd);
+            }
+            ~MappedFile()
+            {
+                if (data)
+                    munmap(const_cast<char *>(data), size);
+            }
+            const char *data;
+            std::size_t size;
+        };
+#endif
+    } // end anonymous namespace
+
+    CheckpointWriter::CheckpointWriter(std::ostream &o) : out(o), buffer(buffer_size), used(0), sum(hash_seed) {}
+
+    bool CheckpointWriter::flush()
+    {
+        out.write(buffer.data(), used);
+        used = 0;
+        return out.good();
+    }
+
+    CheckpointReader::CheckpointReader(std::istream &i) : in(&i), data(NULL), pos(0), end(0), sum(hash_seed) {}
+
+    CheckpointReader::CheckpointReader(const char *d, std::size_t size)
+        : in(NULL), data(d), pos(0), end(size), sum(hash_seed) {}
+
+    bool CheckpointReader::fill(std::size_t size)
+    {
+        if (!in)
+            return false; // the end of the memory
+        // keep the unread bytes, and read the next ones after them
+        std::size_t left = end - pos;
+        std::vector<char> next(std::max(buffer_size, size));
+        std::copy(data + pos, data + end, next.begin());
+        in->read(next.data() + left, next.size() - left);
+        buffer.swap(next);
+        data = buffer.data();
+        pos = 0;
+        end = left + in->gcount();
+        return end >= size;
+    }
+
+    bool Checkpoint::save(const std::string &path, const std::vector<Octree *> &tiles, const Palette &palette,
+                          const CheckpointId &id)
+    {
+        TraceScope trace(id.sequence ? "save_delta_checkpoint" : "save_checkpoint");
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << " Checkpoint::save() error: cannot open " << path << "\n";
+            return false;
+        }
+        CheckpointWriter out(file);
+        out.write(magic, sizeof(magic));
+        out.put(version);
+        out.put(byte_order);
+        out.put(id.chain);
+        out.put(id.sequence);
+        out.put((uint32_t)tiles.size());
+        out.put((uint32_t)palette.size());
+        for (unsigned int m = 0; m < palette.size(); ++m)
+        {
+            const Color &c = palette.color(m);
+            out.put(c.r);
+            out.put(c.g);
+            out.put(c.b);
+        }
+        for (std::size_t t = 0; t < tiles.size(); ++t)
+        {
+            GLVertex c = tiles[t]->root->center();
+            out.put(c.x);
+            out.put(c.y);
+            out.put(c.z);
+            out.put(tiles[t]->root_scale);
+            out.put((uint32_t)tiles[t]->max_depth);
+        }
+        for (std::size_t t = 0; t < tiles.size(); ++t)
+        {
+            if (!(id.sequence ? tiles[t]->save_delta(out) : tiles[t]->save(out)))
+            {
+                std::cout << " Checkpoint::save() error: cannot read a page of tile " << t << "\n";
+                return false;
+            }
+        }
+        out.write(magic, sizeof(magic));
+        out.put(out.checksum());
+        if (!out.flush())
+        {
+            std::cout << " Checkpoint::save() error: cannot write " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool Checkpoint::load(const std::string &path, bool map, std::vector<Octree *> &tiles, Palette &palette,
+                          CheckpointId &id)
+    {
+        TraceScope trace("load_checkpoint");
+#ifdef CUTSIM_MMAP
+        if (map)
+        {
+            MappedFile file(path);
+            if (!file.data)
+            {
+                std::cout << " Checkpoint::load() error: cannot map " << path << "\n";
+                return false;
+            }
+            CheckpointReader in(file.data, file.size);
+            return load(in, tiles, palette, id);
+        }
+#else
+        (void)map; // read through the buffer
+#endif
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << " Checkpoint::load() error: cannot open " << path << "\n";
+            return false;
+        }
+        CheckpointReader in(file);
+        return load(in, tiles, palette, id);
+    }
+
+    bool Checkpoint::load(CheckpointReader &in, std::vector<Octree *> &tiles, Palette &palette, CheckpointId &id)
+    {
+        char head[sizeof(magic)];
+        uint32_t file_version = 0, order = 0, ntiles = 0, ncolors = 0;
+        CheckpointId file_id = {0, 0};
+        if (!in.read(head, sizeof(head)) || !std::equal(head, head + sizeof(head), magic))
+        {
+            std::cout << " Checkpoint::load() error: not a checkpoint\n";
+            return false;
+        }
+        in.get(file_version);
+        in.get(order);
+        if (file_version != version || order != byte_order)
+        {
+            std::cout << " Checkpoint::load() error: version " << file_version << " or byte order not supported\n";
+            return false;
+        }
+        if (!in.get(file_id.chain) || !in.get(file_id.sequence) || file_id.chain == 0)
+        {
+            std::cout << " Checkpoint::load() error: not a checkpoint\n";
+            return false;
+        }
+        if (file_id.sequence && (file_id.chain != id.chain || file_id.sequence != id.sequence + 1))
+        {
+            std::cout << " Checkpoint::load() error: delta " << file_id.sequence
+                      << " does not follow the checkpoint of the stock\n";
+            return false;
+        }
+        if (!in.get(ntiles) || ntiles != tiles.size() || !in.get(ncolors) || ncolors == 0 || ncolors > Palette::max_size)
+        {
+            std::cout << " Checkpoint::load() error: the checkpoint has " << ntiles << " tiles, the stock " << tiles.size() << "\n";
+            return false;
+        }
+        // the colors get their index back when added in order
+        Palette colors;
+        for (uint32_t m = 0; m < ncolors; ++m)
+        {
+            Color c;
+            if (!in.get(c.r) || !in.get(c.g) || !in.get(c.b) || colors.material(c) != m)
+            {
+                std::cout << " Checkpoint::load() error: damaged palette\n";
+                return false;
+            }
+        }
+        for (std::size_t t = 0; t < tiles.size(); ++t)
+        {
+            float x, y, z;
+            double scale;
+            uint32_t depth;
+            if (!in.get(x) || !in.get(y) || !in.get(z) || !in.get(scale) || !in.get(depth))
+                return false;
+            GLVertex c = tiles[t]->root->center();
+            if (c.x != x || c.y != y || c.z != z || scale != tiles[t]->root_scale || depth != tiles[t]->max_depth)
+            {
+                std::cout << " Checkpoint::load() error: tile " << t << " of the checkpoint is not that of the stock\n";
+                return false;
+            }
+        }
+        // read into new trees first, so that the stock stays as it is on damaged data.
+        // a delta is applied to forks, which copy the nodes it changes
+        std::vector<std::unique_ptr<Octree>> loaded;
+        for (std::size_t t = 0; t < tiles.size(); ++t)
+        {
+            if (file_id.sequence)
+            {
+                loaded.emplace_back(tiles[t]->fork(NULL));
+                if (!loaded.back()->load_delta(in))
+                    return false;
+                continue;
+            }
+            GLVertex center = tiles[t]->root->center();
+            loaded.emplace_back(new Octree(tiles[t]->root_scale, tiles[t]->max_depth, center, NULL));
+            if (!loaded.back()->load(in))
+                return false;
+        }
+        if (!in.read(head, sizeof(head)) || !std::equal(head, head + sizeof(head), magic))
+        {
+            std::cout << " Checkpoint::load() error: the checkpoint is truncated\n";
+            return false;
+        }
+        uint64_t sum = in.checksum(), file_sum = 0;
+        if (!in.get(file_sum) || file_sum != sum)
+        {
+            std::cout << " Checkpoint::load() error: checksum mismatch, the checkpoint is damaged\n";
+            return false;
+        }
+        for (std::size_t t = 0; t < tiles.size(); ++t)
+            tiles[t]->restore(*loaded[t]);
+        palette = colors;
+        id = file_id;
+        return true;
+    }
+
+} // end namespace
+// end of file checkpoint.cpp
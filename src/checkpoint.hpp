@@ -0,0 +1,185 @@
+/*
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cutsim
+{
+
+    class Octree;
+    class Palette;
+
+    /// FNV-1a hash of size bytes at data, continued from hash. The checksum of a checkpoint.
+    inline uint64_t checkpoint_hash(uint64_t hash, const char *data, std::size_t size)
+    {
+        for (std::size_t n = 0; n < size; ++n)
+        {
+            hash ^= static_cast<unsigned char>(data[n]);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    /// writes a checkpoint to a stream, through a buffer
+    class CheckpointWriter
+    {
+    public:
+        explicit CheckpointWriter(std::ostream &out);
+        /// write size bytes
+        void write(const void *data, std::size_t size)
+        {
+            sum = checkpoint_hash(sum, static_cast<const char *>(data), size);
+            if (used + size > buffer.size())
+                flush();
+            if (size > buffer.size())
+                out.write(static_cast<const char *>(data), size);
+            else
+            {
+                std::memcpy(buffer.data() + used, data, size);
+                used += size;
+            }
+        }
+        /// write a value as raw bytes
+        template <class T>
+        void put(const T &value) { write(&value, sizeof(T)); }
+        /// write the buffer to the stream, false if the stream failed
+        bool flush();
+        /// the checksum of the bytes written so far
+        uint64_t checksum() const { return sum; }
+
+    private:
+        std::ostream &out;
+        std::vector<char> buffer;
+        std::size_t used; ///< bytes in the buffer
+        uint64_t sum;     ///< checksum of the bytes written
+    };
+
+    /// reads a checkpoint from a stream, or from memory such as a memory-mapped file
+    class CheckpointReader
+    {
+    public:
+        /// read from a stream, through a buffer
+        explicit CheckpointReader(std::istream &in);
+        /// read from size bytes at data, which are not copied
+        CheckpointReader(const char *data, std::size_t size);
+        /// the next size bytes, valid until the next call. NULL at the end of the data.
+        const char *next(std::size_t size)
+        {
+            if (pos + size > end && !fill(size))
+                return NULL;
+            const char *p = data + pos;
+            pos += size;
+            sum = checkpoint_hash(sum, p, size);
+            return p;
+        }
+        /// read size bytes to dst, false at the end of the data
+        bool read(void *dst, std::size_t size)
+        {
+            const char *p = next(size);
+            if (p)
+                std::memcpy(dst, p, size);
+            return p != NULL;
+        }
+        /// read a value written by CheckpointWriter::put()
+        template <class T>
+        bool get(T &value) { return read(&value, sizeof(T)); }
+        /// the checksum of the bytes read so far
+        uint64_t checksum() const { return sum; }
+
+    private:
+        /// read from the stream until size bytes are available
+        bool fill(std::size_t size);
+
+        std::istream *in;         ///< the stream, NULL when reading from memory
+        std::vector<char> buffer; ///< the bytes read from the stream
+        const char *data;         ///< the data, the buffer or the memory
+        std::size_t pos;          ///< read position in data
+        std::size_t end;          ///< bytes available in data
+        uint64_t sum;             ///< checksum of the bytes read
+    };
+
+    /// the place of a checkpoint in a chain of a full checkpoint and the deltas after it
+    struct CheckpointId
+    {
+        uint64_t chain;    ///< random number of the chain, 0 for none
+        uint32_t sequence; ///< 0 for the full checkpoint, n for the n-th delta after it
+    };
+
+    /// Binary checkpoint files of the stock, see Cutsim::save_checkpoint().
+    ///
+    /// A checkpoint stores the structure and the distance field of each octree tile, so a
+    /// simulation can resume from it without cutting again. A delta checkpoint stores only
+    /// the nodes changed since the previous checkpoint of its chain, see Octree::save_delta().
+    /// Format version 3, in the byte order of the machine that wrote it:
+    ///  - header: "CUTSIMCP", uint32 version, uint32 0x01020304 (byte order),
+    ///    uint64 chain, uint32 sequence (see CheckpointId), uint32 tile count
+    ///  - palette: uint32 size, then size times float r, g, b
+    ///  - per tile: float center x, y, z, double root scale, uint32 max depth
+    ///  - per tile: the nodes in depth-first order, children 0..7 after their parent.
+    ///    A node is int16 f[8], uint8 material and uint8 flags: state (bits 0-1), previous
+    ///    state (bits 2-3), eight children follow (bit 4), a Brick follows (bit 5).
+    ///    A Brick is int16 f[729] and uint8 material[512].
+    ///    In a delta each node is preceded by a uint8 mark, and an unchanged node is only the
+    ///    mark, standing for its whole sub-tree.
+    ///  - trailer: "CUTSIMCP", uint64 FNV-1a checksum of all bytes before it
+    /// The position and size of a node follow from its place in the order, so a node takes
+    /// 18 bytes in the file instead of 64 in memory. The checksum catches damage that still
+    /// parses, e.g. a changed distance value.
+    class Checkpoint
+    {
+    public:
+        /// the format version written, and the only one read
+        static constexpr uint32_t version = 3;
+        /// bytes per node in the file, without the Brick
+        static constexpr std::size_t node_bytes = 18;
+        // node flags
+        static constexpr uint8_t has_children = 1 << 4; ///< the eight children follow the node
+        static constexpr uint8_t has_brick = 1 << 5;    ///< the Brick follows the node
+        // node marks of a delta
+        static constexpr uint8_t unchanged = 0; ///< the sub-tree is as in the previous checkpoint
+        static constexpr uint8_t changed = 1;   ///< the node follows, and the marks of its children
+
+        /// write the tiles and palette of a stock to path, false on error.
+        /// A delta, with id.sequence > 0, holds the nodes changed in the current epoch of the tiles.
+        static bool save(const std::string &path, const std::vector<Octree *> &tiles, const Palette &palette,
+                         const CheckpointId &id);
+        /// replace the nodes of the tiles and the palette with those in the checkpoint at path.
+        /// The checkpoint must be of tiles with the same centers, scale and depth. A delta
+        /// must be the next in the chain of id, the checkpoint that the tiles are as of.
+        /// On success id becomes that of the file.
+        /// With map the file is memory-mapped instead of read through a buffer, where supported.
+        /// Nothing changes if the file is not a valid checkpoint of the tiles.
+        static bool load(const std::string &path, bool map, std::vector<Octree *> &tiles, Palette &palette,
+                         CheckpointId &id);
+
+    private:
+        /// read the checkpoint, after the file is opened
+        static bool load(CheckpointReader &in, std::vector<Octree *> &tiles, Palette &palette, CheckpointId &id);
+    };
+
+} // end namespace
+
+// end file checkpoint.hpp
@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "isosurface.hpp"
+#include "traversal.hpp"
 
 namespace cutsim
 {
@@ -56,18 +57,35 @@ namespace cutsim
         bool draw_outside;     ///< flag for drawing outside nodes
         bool draw_undecided;   ///< flag for drawing undecided nodes
 
+        /// visits all nodes and updates their lines
+        struct UpdateVisitor
+        {
+            CubeWireFrame &wf;
+            bool pre(Octnode *node) { return wf.update_node(node); }
+            void post(Octnode *) {}
+        };
+
         // traverse tree and add/remove gl-elements to GLData
         void updateGL(Octnode *node)
         {
+            UpdateVisitor visitor = {*this};
+            traverse(node, visitor);
+        }
+
+        /// update the lines of one node, return true to descend into its children
+        bool update_node(Octnode *node)
+        {
+            CUTSIM_STAT(++stats.nodes_visited);
             if (node->valid())
             {
                 valid_count++;
-                return;
+                return false;
             }
             else if (!node->valid())
             {
                 update_calls++;
-                node->clearVertexSet(); // remove all previous GLData
+                node->page_in(g);        // draw the paged sub-tree too
+                node->clearVertexSet(g); // remove all previous GLData
 
                 // add lines corresponding to the cube.
                 // cube image: http://paulbourke.net/geometry/polygonise/
@@ -80,8 +98,8 @@ namespace cutsim
                     for (unsigned int i = 0; i < 12; i++)
                     {
                         std::vector<unsigned int> lineSeg;
-                        GLVertex p1 = *(node->vertex)[segTable[i][0]];
-                        GLVertex p2 = *(node->vertex)[segTable[i][1]];
+                        GLVertex p1 = node->vertex(segTable[i][0]);
+                        GLVertex p2 = node->vertex(segTable[i][1]);
                         Color line_color = outside_color;
                         if (node->is_outside())
                         {
@@ -107,17 +125,9 @@ namespace cutsim
                     }
                 }
                 node->setValid();
-
-                // current node done, now recurse into tree.
-                if (node->childcount == 8)
-                {
-                    for (unsigned int m = 0; m < 8; m++)
-                    {
-                        //if ( !node->child[m]->valid() )
-                        updateGL(node->child[m]);
-                    }
-                }
             }
+            node->unshare_children(g);
+            return true; // current node done, now descend into tree.
         }
 
         /*
@@ -17,64 +17,680 @@
  *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+
 #include "cutsim.hpp"
+#include "trace.hpp"
+#include "checkpoint.hpp"
 
 namespace cutsim {
 
+namespace {
+
+// false, with an error, for a volume that the operation op can not evaluate
+bool usable(const Volume* volume, const char* op) {
+    if (volume->valid())
+        return true;
+    std::cout << " Cutsim::" << op << "() error: invalid volume, e.g. an extrusion profile of fewer than 3 points\n";
+    return false;
+}
+
+} // end anonymous namespace
+
 Cutsim::Cutsim (double octree_size, unsigned int octree_max_depth, GLData* gld, IsoSurfaceAlgorithm* iso)
-    : iso_algo(iso), g(gld) {
+    : iso_algo(iso), g(gld), threads(1), undo_depth(0), checkpoint_id{0, 0}, stock_changed(true), page_budget(0), operations(0), pack_idle(0), pack_since(0), packed_at(0), memory_budget(0), coarsened(0), coarsest(0), making_stock(false) {
     GLVertex octree_center(0,0,0);
-    tree = new Octree(octree_size, octree_max_depth, octree_center, g );
-    tree->debug=false;
     iso_algo->set_gl(g);
-    iso_algo->set_tree(tree);
+    iso_algo->set_palette(&palette);
+    add_tile(octree_size, octree_max_depth, octree_center);
     iso_algo->set_polyVerts();
 } 
 
+Cutsim::Cutsim (const Bbox& stock, double tile_size, unsigned int octree_max_depth, GLData* gld, IsoSurfaceAlgorithm* iso)
+    : iso_algo(iso), g(gld), threads(1), undo_depth(0), checkpoint_id{0, 0}, stock_changed(true), page_budget(0), operations(0), pack_idle(0), pack_since(0), packed_at(0), memory_budget(0), coarsened(0), coarsest(0), making_stock(false) {
+    iso_algo->set_gl(g);
+    iso_algo->set_palette(&palette);
+    double side = 2*tile_size;
+    int nx = std::max(1, (int)std::ceil( (stock.maxpt.x - stock.minpt.x) / side ));
+    int ny = std::max(1, (int)std::ceil( (stock.maxpt.y - stock.minpt.y) / side ));
+    int nz = std::max(1, (int)std::ceil( (stock.maxpt.z - stock.minpt.z) / side ));
+    for (int k=0;k<nz;++k) {
+        for (int j=0;j<ny;++j) {
+            for (int i=0;i<nx;++i) {
+                GLVertex center( stock.minpt.x + (i+0.5)*side,
+                                 stock.minpt.y + (j+0.5)*side,
+                                 stock.minpt.z + (k+0.5)*side );
+                add_tile(tile_size, octree_max_depth, center);
+            }
+        }
+    }
+    iso_algo->set_polyVerts();
+}
+
+Cutsim::Cutsim (const Snapshot& s, GLData* gld, IsoSurfaceAlgorithm* iso)
+    : iso_algo(iso), palette(s.palette), g(gld), threads(1), undo_depth(0), checkpoint_id{0, 0}, stock_changed(true), page_budget(0), operations(0), pack_idle(0), pack_since(0), packed_at(0), memory_budget(0), coarsened(0), coarsest(0), making_stock(false) {
+    iso_algo->set_gl(g);
+    iso_algo->set_palette(&palette);
+    for (std::size_t t=0;t<s.tiles.size();++t) {
+        tiles.push_back( s.tiles[t]->fork(g) );
+        iso_algo->add_tree(tiles.back());
+    }
+    if (!tiles.empty()) {
+        undo_depth = tiles[0]->get_undo();
+        memory_budget = tiles[0]->get_memory_limit();
+    }
+    iso_algo->set_polyVerts();
+}
+
+Snapshot::~Snapshot() {
+    for (std::size_t n=0;n<tiles.size();++n)
+        delete tiles[n];
+}
+
+OctreeStats Snapshot::get_tree_stats() const {
+    OctreeStats s, tile;
+    for (std::size_t t=0;t<tiles.size();++t) {
+        tiles[t]->get_stats(tile);
+        s += tile;
+    }
+    return s;
+}
+
+Snapshot* Cutsim::snapshot() {
+    TraceScope trace("snapshot");
+    Snapshot* s = new Snapshot();
+    for (std::size_t t=0;t<tiles.size();++t)
+        s->tiles.push_back( tiles[t]->fork(NULL) );
+    s->palette = palette;
+    history.clear();
+    return s;
+}
+
+bool Cutsim::restore(const Snapshot& s) {
+    TraceScope trace("restore");
+    bool same = (s.tiles.size() == tiles.size());
+    for (std::size_t t=0;same && t<tiles.size();++t)
+        same = tiles[t]->same_lattice( *s.tiles[t] );
+    if (!same) {
+        std::cout << " Cutsim::restore() error: the snapshot has different tiles\n";
+        return false;
+    }
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->restore( *s.tiles[t] );
+    palette = s.palette;
+    history.clear();
+    checkpoint_id.chain = 0;
+    return true;
+}
+
 Cutsim::~Cutsim() {
-    delete tree;
+    if (checkpoint.valid())
+        checkpoint.wait();
+    for (std::size_t n=0;n<tiles.size();++n)
+        delete tiles[n];
+}
+
+bool Cutsim::next_checkpoint(bool delta, CheckpointId& id) {
+    wait_checkpoint(); // a failed one ends the chain
+    if (!delta) {
+        std::random_device random;
+        id.chain = ((uint64_t)random() << 32) | random();
+        id.chain += (id.chain == 0); // 0 is no chain
+        id.sequence = 0;
+        return true;
+    }
+    if (!checkpoint_id.chain) {
+        std::cout << " Cutsim: no checkpoint since the stock was replaced, write a full one first\n";
+        return false;
+    }
+    id.chain = checkpoint_id.chain;
+    id.sequence = checkpoint_id.sequence + 1;
+    return true;
+}
+
+void Cutsim::checkpoint_taken(const CheckpointId& id) {
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->next_epoch();
+    checkpoint_id = id;
+    stock_changed = false;
+}
+
+bool Cutsim::save_checkpoint(const std::string& path) {
+    CheckpointId id;
+    if (!next_checkpoint(false, id) || !Checkpoint::save(path, tiles, palette, id))
+        return false;
+    checkpoint_taken(id);
+    return true;
+}
+
+bool Cutsim::save_delta_checkpoint(const std::string& path) {
+    CheckpointId id;
+    if (!next_checkpoint(true, id) || !Checkpoint::save(path, tiles, palette, id))
+        return false; // the changes stay stamped for the next try
+    checkpoint_taken(id);
+    return true;
+}
+
+bool Cutsim::save_checkpoint_async(const std::string& path, bool delta) {
+    CheckpointId id;
+    if (!next_checkpoint(delta, id))
+        return false;
+    Snapshot* s = snapshot(); // the forks keep the epoch of the tiles
+    checkpoint_taken(id);
+    checkpoint = std::async(std::launch::async, [s, path, id]() {
+        bool ok = Checkpoint::save(path, s->tiles, s->palette, id);
+        delete s;
+        return ok;
+    });
+    return true;
+}
+
+bool Cutsim::wait_checkpoint() {
+    if (!checkpoint.valid())
+        return false;
+    if (checkpoint.get())
+        return true;
+    checkpoint_id.chain = 0; // the next delta would follow a checkpoint that is not there
+    return false;
+}
+
+bool Cutsim::load_checkpoint(const std::string& path, bool map) {
+    wait_checkpoint();
+    history.clear(); // a delta is applied to forks of the tiles, which end their journals
+    CheckpointId id = checkpoint_id;
+    if (stock_changed)
+        id.chain = 0; // no delta follows the stock
+    if (!Checkpoint::load(path, map, tiles, palette, id))
+        return false;
+    checkpoint_id = id;
+    stock_changed = false;
+    return true;
+}
+
+void Cutsim::add_tile(double tile_size, unsigned int octree_max_depth, const GLVertex& center) {
+    GLVertex c(center);
+    Octree* tile = new Octree(tile_size, octree_max_depth, c, g );
+    tile->debug=false;
+    tiles.push_back(tile);
+    iso_algo->add_tree(tile);
 }
 
 void Cutsim::init(unsigned int n) {
-    tree->init(n);
+    history.clear();
+    checkpoint_id.chain = 0;
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->init(n);
     //std::cout << "Cutsim::init() tree after init: " << tree->str() << "\n";
 }
 
+void Cutsim::init_stock(const Volume *stock) {
+    if (!usable(stock, "init_stock"))
+        return;
+    // the stock is made at full resolution, coarsen() then lowers it evenly to the memory budget.
+    // Stopping the sum at the budget would leave the part of the stock added last too coarse, or lose it.
+    for (std::size_t t=0;t<tiles.size();++t) {
+        tiles[t]->clear();
+        tiles[t]->set_depth_limit(0);
+        tiles[t]->set_memory_limit(0);
+    }
+    coarsest = 0;
+    making_stock = true; // the stock is no cut
+    sum_volume(stock);
+    making_stock = false;
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_memory_limit(memory_budget);
+    set_undo(undo_depth); // the history starts from the stock
+    checkpoint_id.chain = 0;
+}
+
+namespace {
+
+const unsigned long hot_cut_count = 8; // recent cuts whose sub-trees are not paged
+
+} // end anonymous namespace
+
+bool Cutsim::set_paging(const std::string& path, std::size_t budget) {
+    bool on = !path.empty() && budget;
+    bool ok = true;
+    for (std::size_t t=0;on && ok && t<tiles.size();++t) {
+        std::ostringstream name;
+        name << path << "." << t;
+        ok = tiles[t]->set_paging(name.str());
+    }
+    if (!on || !ok) {
+        for (std::size_t t=0;t<tiles.size();++t)
+            tiles[t]->set_paging("");
+        budget = 0;
+    }
+    page_budget = budget;
+    return ok;
+}
+
+void Cutsim::set_packing(std::size_t idle) {
+    if (!idle)
+        for (std::size_t t=0;t<tiles.size();++t)
+            tiles[t]->unpack();
+    pack_idle = idle;
+    pack_since = operations; // the cuts before are not known
+    packed_at = operations;
+}
+
+std::size_t Cutsim::pack() {
+    if (!pack_idle)
+        return 0;
+    TraceScope trace("pack");
+    packed_at = operations;
+    std::size_t packed = 0;
+    std::vector<Octnode*> nodes;
+    for (std::size_t t=0;t<tiles.size();++t) {
+        nodes.clear();
+        tiles[t]->page_candidates(nodes);
+        for (std::size_t n=0;n<nodes.size();++n) {
+            if (nodes[n]->is_paged())
+                continue;
+            if (!nodes[n]->valid() && nodes[n]->owned(g))
+                continue; // updateGL() would unpack it at once
+            if (operations - std::max(tiles[t]->last_cut(nodes[n]), pack_since) < pack_idle)
+                continue;
+            if (tiles[t]->pack(nodes[n]))
+                ++packed;
+        }
+    }
+    if (packed)
+        history.clear(); // the tiles forgot their journals
+    if (Trace::enabled()) {
+        std::ostringstream args;
+        args << "\"packed\": " << packed;
+        trace.set_args(args.str());
+    }
+    return packed;
+}
+
+void Cutsim::record_cut(const Bbox& bb) {
+    if (!page_budget && !pack_idle && !memory_budget)
+        return;
+    unsigned long op = making_stock ? 0 : ++operations;
+    latest_cut = bb;
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->mark_cut(bb, op);
+}
+
+void Cutsim::check_memory() {
+    if (pack_idle && operations - packed_at >= std::max<std::size_t>(1, pack_idle / 8))
+        pack();
+    if (page_budget && Octnode::resident_bytes() > page_budget)
+        page_out();
+    if (memory_budget && Octnode::resident_bytes() > memory_budget / 10 * 9)
+        coarsen();
+    if (memory_budget)
+        limit_depth();
+}
+
+void Cutsim::set_memory_budget(std::size_t budget) {
+    memory_budget = budget;
+    coarsest = 0;
+    for (std::size_t t=0;t<tiles.size();++t) {
+        if (!budget)
+            tiles[t]->set_depth_limit(0);
+        tiles[t]->set_memory_limit(budget);
+    }
+}
+
+unsigned int Cutsim::get_depth_limit() const {
+    return tiles.empty() ? 0 : tiles[0]->get_depth_limit();
+}
+
+std::size_t Cutsim::coarsen() {
+    std::size_t target = memory_budget / 10 * 8;
+    if (!memory_budget || tiles.empty() || Octnode::resident_bytes() <= target)
+        return 0;
+    TraceScope trace("coarsen");
+    std::size_t before = Octnode::resident_bytes();
+    // the cells cut since the operation hot are left alone, the cutter is still around.
+    // Those never cut, i.e. of operation 0, are the first to go.
+    unsigned long hot = operations >= hot_cut_count ? operations + 1 - hot_cut_count : 1;
+    unsigned int max_depth = tiles[0]->get_max_depth();
+    unsigned int depth = max_depth - 1;
+    std::size_t count = 0;
+    // the finest level goes first, in the cells cut least recently, i.e. a quarter of the
+    // operations at a time, then the next level
+    while (depth > 1 && Octnode::resident_bytes() > target) {
+        --depth;
+        for (unsigned long q=1;q<=4 && Octnode::resident_bytes() > target;++q)
+            for (std::size_t t=0;t<tiles.size();++t)
+                count += tiles[t]->coarsen(depth, std::max(1ul, hot * q / 4));
+    }
+    if (count) {
+        history.clear(); // the tiles forgot their journals
+        coarsened += count;
+        if (!coarsest || depth < coarsest) {
+            coarsest = depth;
+            std::cout << "Cutsim: over the memory budget, " << count << " regions away from the cutter coarsened to depth "
+                      << depth << " of " << max_depth << "\n";
+        }
+    }
+    if (Trace::enabled()) {
+        std::ostringstream args;
+        args << "\"coarsened\": " << count << ", \"depth\": " << depth
+             << ", \"freed\": " << (long)before - (long)Octnode::resident_bytes();
+        trace.set_args(args.str());
+    }
+    return count;
+}
+
+void Cutsim::limit_depth() {
+    // coarsen() has left what the cutter refines itself
+    unsigned int limit = get_depth_limit();
+    unsigned int max_depth = tiles.empty() ? 0 : tiles[0]->get_max_depth();
+    if (Octnode::resident_bytes() > memory_budget && limit > 2) {
+        --limit;
+        std::cout << "Cutsim: over the memory budget, the operations subdivide to depth " << limit << " of " << max_depth << "\n";
+    } else if (Octnode::resident_bytes() < memory_budget / 2 && limit < max_depth) {
+        ++limit;
+    } else {
+        return;
+    }
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_depth_limit(limit);
+}
+
+std::size_t Cutsim::page_out() {
+    std::size_t target = page_budget / 10 * 9;
+    if (!page_budget || Octnode::resident_bytes() <= target)
+        return 0;
+    TraceScope trace("page_out");
+    // least recently cut first. The nodes that updateGL() has still to mesh come last, it
+    // would read them back at once.
+    struct Candidate {
+        std::size_t tile;
+        Octnode* node;
+        bool unmeshed;
+        unsigned long last; // the latest operation that cut the node, 0 for none
+        float distance;     // from the latest cut
+    };
+    std::vector<Candidate> candidates;
+    GLVertex latest = (latest_cut.minpt + latest_cut.maxpt) * 0.5;
+    std::vector<Octnode*> nodes;
+    for (std::size_t t=0;t<tiles.size();++t) {
+        nodes.clear();
+        tiles[t]->page_candidates(nodes);
+        for (std::size_t n=0;n<nodes.size();++n) {
+            unsigned long last = tiles[t]->last_cut(nodes[n]);
+            if (last && last + hot_cut_count > operations)
+                continue; // the cutter is still around
+            bool unmeshed = !nodes[n]->valid() && nodes[n]->owned(g);
+            candidates.push_back( Candidate{t, nodes[n], unmeshed, last, (nodes[n]->center() - latest).norm()} );
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.unmeshed != b.unmeshed)
+            return b.unmeshed;
+        return a.last != b.last ? a.last < b.last : a.distance > b.distance;
+    });
+    std::size_t paged = 0;
+    for (std::size_t n=0;n<candidates.size() && Octnode::resident_bytes() > target;++n)
+        if (tiles[candidates[n].tile]->page_out(candidates[n].node))
+            ++paged;
+    if (paged)
+        history.clear(); // the tiles forgot their journals
+    if (Trace::enabled()) {
+        std::ostringstream args;
+        args << "\"paged\": " << paged << ", \"candidates\": " << candidates.size();
+        trace.set_args(args.str());
+    }
+    return paged;
+}
+
+void Cutsim::set_lazy_prune(bool lazy, std::size_t max_pending) {
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_lazy_prune(lazy, max_pending);
+}
+
+void Cutsim::set_dist_cache(bool on) {
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_dist_cache(on);
+}
+
+void Cutsim::set_bricks(bool on) {
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_bricks(on);
+}
+
+void Cutsim::set_refine_tolerance(float tolerance) {
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_refine_tolerance(tolerance);
+}
+
+void Cutsim::set_undo(std::size_t depth) {
+    for (std::size_t t=0;t<tiles.size();++t)
+        tiles[t]->set_undo(depth);
+    undo_depth = depth;
+    history.clear();
+}
+
+void Cutsim::add_history(const std::vector<std::size_t>& changed) {
+    stock_changed = true;
+    if (!undo_depth)
+        return;
+    history.push_back(changed);
+    // a tile journals at least as many operations as the history
+    if (history.size() > undo_depth)
+        history.pop_front();
+}
+
+std::size_t Cutsim::undo(std::size_t n) {
+    TraceScope trace("undo");
+    std::size_t undone = 0;
+    for (; undone < n && !history.empty(); ++undone) {
+        const std::vector<std::size_t>& changed = history.back();
+        for (std::size_t i=0;i<changed.size();++i)
+            tiles[changed[i]]->undo();
+        history.pop_back();
+        stock_changed = true;
+    }
+    return undone;
+}
+
+std::size_t Cutsim::prune() {
+    std::size_t pruned = 0;
+    for (std::size_t t=0;t<tiles.size();++t)
+        pruned += tiles[t]->prune();
+    stock_changed = stock_changed || pruned;
+    return pruned;
+}
+
+int Cutsim::material_at(float x, float y, float z) const {
+    for (std::size_t t=0;t<tiles.size();++t) {
+        GLVertex p(x,y,z);
+        Octnode* leaf = tiles[t]->find_leaf(p);
+        if (leaf)
+            return leaf->material_at(p);
+    }
+    return -1;
+}
+
+std::size_t Cutsim::leaf_count() const {
+    return get_tree_stats().leaf_count;
+}
+
+OctreeStats Cutsim::get_tree_stats() const {
+    OctreeStats s, tile;
+    for (std::size_t t=0;t<tiles.size();++t) {
+        tiles[t]->get_stats(tile);
+        s += tile;
+    }
+    s.gldata_bytes = g->bytes();
+    return s;
+}
+
 std::string Cutsim::str() const {
-    std::string out = tree->str();
-    return out;
+    if (tiles.size() == 1)
+        return tiles[0]->str();
+    std::ostringstream o;
+    o << " Octree: " << tiles.size() << " tiles, " << get_tree_stats().str();
+    return o.str();
+}
+
+#ifdef CUTSIM_STATS
+// run the operation and record its counters and elapsed time in stats.kind
+#define CUTSIM_TIMED(kind, operation)                                        \
+    {                                                                        \
+        OpStats before = counters();                                         \
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now(); \
+        operation;                                                           \
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0; \
+        record(stats.kind, before, dt.count());                              \
+    }
+#else
+#define CUTSIM_TIMED(kind, operation) operation;
+#endif
+
+OpStats Cutsim::counters() const {
+    OpStats c = iso_algo->stats;
+    for (std::size_t t=0;t<tiles.size();++t)
+        c += tiles[t]->stats;
+    c += g->stats;
+    return c;
+}
+
+void Cutsim::record(OpStats &kind, const OpStats &before, double seconds) {
+    stats.last = counters() - before;
+    stats.last.calls = 1;
+    stats.last.seconds = seconds;
+    kind += stats.last;
 }
 
 void Cutsim::updateGL() {
-    //std::clock_t start, stop;
-    //start = std::clock();
-    iso_algo->updateGL();
-    //stop = std::clock();
-    //std::cout << "cutsim.cpp updateGL() : " << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<"\n";
+    TraceScope trace("updateGL");
+    CUTSIM_TIMED(update,
+        for (std::size_t t=0;t<tiles.size();++t)
+            if (tiles[t]->get_lazy_prune() && tiles[t]->prune())
+                stock_changed = true;
+        iso_algo->updateGL(); );
+    trace.set_args(stats.last);
 }
 
+// sum and diff only change the tiles that the volume overlaps
 void Cutsim::sum_volume( const Volume* volume ) {
-    //std::clock_t start, stop;
-    //start = std::clock();
-    tree->sum( volume );
-    //stop = std::clock();
-    //std::cout << "Cutsim::sum_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<" s\n";
+    if (!usable(volume, "sum_volume"))
+        return;
+    TraceScope trace("sum_volume");
+    unsigned char material = palette.material(volume->color);
+    std::vector<std::size_t> changed;
+    CUTSIM_TIMED(sum,
+        for (std::size_t t=0;t<tiles.size();++t)
+            if ( volume->bb.overlaps( tiles[t]->root->bbox() ) ) {
+                tiles[t]->sum( volume, material );
+                changed.push_back(t);
+            } );
+    add_history(changed);
+    record_cut(volume->bb);
+    check_memory();
+    trace.set_args(stats.last);
 }
 
 void Cutsim::diff_volume( const Volume* volume ) {
-    //std::clock_t start, stop;
-    //start = std::clock();
-    tree->diff( volume );
-    //stop = std::clock();
-    //std::cout << "cutsim.cpp diff_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<"\n";
+    if (!usable(volume, "diff_volume"))
+        return;
+    TraceScope trace("diff_volume");
+    unsigned char material = palette.material(volume->color);
+    std::vector<std::size_t> changed;
+    CUTSIM_TIMED(diff,
+        for (std::size_t t=0;t<tiles.size();++t)
+            if ( volume->bb.overlaps( tiles[t]->root->bbox() ) ) {
+                tiles[t]->diff( volume, material );
+                changed.push_back(t);
+            } );
+    add_history(changed);
+    record_cut(volume->bb);
+    check_memory();
+    trace.set_args(stats.last);
+}
+
+namespace {
+
+// diff the volumes listed for one tile, in order
+void diff_tile(std::size_t index, Octree* tile, const std::vector<const Volume*>& volumes,
+               const std::vector<unsigned char>& materials, const std::vector<std::size_t>& list) {
+    TraceScope trace("diff_tile");
+    for (std::size_t n=0;n<list.size();++n)
+        tile->diff( volumes[list[n]], materials[list[n]] );
+    if (Trace::enabled()) {
+        std::ostringstream args;
+        args << "\"tile\": " << index << ", \"volumes\": " << list.size();
+        trace.set_args(args.str());
+    }
+}
+
+} // end anonymous namespace
+
+void Cutsim::diff_volumes( const std::vector<const Volume*>& volumes ) {
+    for (std::size_t n=0;n<volumes.size();++n)
+        if (!usable(volumes[n], "diff_volumes"))
+            return;
+    TraceScope trace("diff_volumes");
+    std::vector<unsigned char> materials;
+    for (std::size_t n=0;n<volumes.size();++n)
+        materials.push_back( palette.material(volumes[n]->color) );
+    // the volumes overlapping each tile, and the tiles that have work
+    std::vector< std::vector<std::size_t> > lists(tiles.size());
+    std::vector< std::vector<std::size_t> > changed(volumes.size()); // the tiles of each volume
+    std::vector<std::size_t> busy;
+    for (std::size_t t=0;t<tiles.size();++t) {
+        Bbox tile_bb = tiles[t]->root->bbox();
+        for (std::size_t n=0;n<volumes.size();++n)
+            if ( volumes[n]->bb.overlaps(tile_bb) ) {
+                lists[t].push_back(n);
+                changed[n].push_back(t);
+            }
+        if (!lists[t].empty())
+            busy.push_back(t);
+    }
+    // workers take the next busy tile until all are done. A tile is only touched by
+    // the worker that took it, the GLData is shared under GLData::mutex.
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]() {
+        for (std::size_t i = next++; i < busy.size(); i = next++)
+            diff_tile(busy[i], tiles[busy[i]], volumes, materials, lists[busy[i]]);
+    };
+    std::size_t nworkers = std::min<std::size_t>(threads, busy.size());
+    CUTSIM_TIMED(diff,
+        std::vector<std::thread> pool;
+        for (std::size_t n=1;n<nworkers;++n)
+            pool.push_back( std::thread(worker) );
+        worker();
+        for (std::size_t n=0;n<pool.size();++n)
+            pool[n].join(); );
+    // a tile journals its volumes in order, so each volume is one operation to undo
+    for (std::size_t n=0;n<volumes.size();++n) {
+        add_history(changed[n]);
+        record_cut(volumes[n]->bb);
+    }
+    check_memory();
+    trace.set_args(stats.last);
 }
 
+// intersect removes everything outside the volume, so it goes to all tiles
 void Cutsim::intersect_volume( const Volume* volume ) {
-    //std::clock_t start, stop;
-    //start = std::clock();
-    tree->intersect( volume );
-    //stop = std::clock();
-    //std::cout << "cutsim.cpp intersect_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
+    if (!usable(volume, "intersect_volume"))
+        return;
+    TraceScope trace("intersect_volume");
+    unsigned char material = palette.material(volume->color);
+    std::vector<std::size_t> changed;
+    CUTSIM_TIMED(intersect,
+        for (std::size_t t=0;t<tiles.size();++t) {
+            tiles[t]->intersect( volume, material );
+            changed.push_back(t);
+        } );
+    add_history(changed);
+    record_cut(volume->bb);
+    check_memory();
+    trace.set_args(stats.last);
 }
 
 } // end namespace
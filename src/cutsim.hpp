@@ -19,14 +19,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <cmath>
 #include <vector>
 #include <ctime>
-
-#include <boost/bind.hpp>
-#include <boost/timer.hpp>
+#include <deque>
+#include <future>
 
 #include "octree.hpp"
 #include "octnode.hpp"
@@ -34,10 +34,33 @@
 #include "marching_cubes.hpp"
 #include "cube_wireframe.hpp"
 #include "gldata.hpp"
+#include "bbox.hpp"
+#include "palette.hpp"
+#include "stats.hpp"
+#include "checkpoint.hpp"
 
 namespace cutsim
 {
 
+    /// an unchangeable copy of the stock of a Cutsim, see Cutsim::snapshot().
+    class Snapshot
+    {
+    public:
+        ~Snapshot();
+        /// number of octree tiles of the stock
+        std::size_t tile_count() const { return tiles.size(); }
+        /// node counts of the snapshot. The nodes it shares are also counted by the Cutsims that share them.
+        OctreeStats get_tree_stats() const;
+
+    private:
+        friend class Cutsim;
+        Snapshot() {}
+        Snapshot(const Snapshot &);
+        Snapshot &operator=(const Snapshot &);
+        std::vector<Octree *> tiles; // forks of the tiles, without GLData
+        Palette palette;             // materials of the stock
+    };
+
     /// a Cutsim stores/manipulates an Octree stock model, uses an IsoSurfaceAlgorithm
     /// algorithm to generate surface triangles, and communicates with
     /// the corresponding GLData surface which is used for rendering
@@ -49,6 +72,11 @@ namespace cutsim
     ///
     /// after a boolean operation, calling updateGL() will update the graphics object
     ///
+    /// The stock is either one cubic Octree, or a grid of cubic Octree tiles covering an
+    /// axis-aligned box, for long or flat workpieces. sum and diff are only applied to
+    /// the tiles that the Volume overlaps. All tiles have the same size and depth, so
+    /// the leaf nodes on both sides of a tile border line up and the mesh is seamless.
+    ///
     class Cutsim
     {
 
@@ -61,19 +89,212 @@ namespace cutsim
         ///        in practice max_depth= 6 or 7 works for testing, and 9 or 10 looks very smooth (but is slower)
         /// \param gld the GLData used to draw the stock
         Cutsim(double octree_size, unsigned int octree_max_depth, GLData *gld, IsoSurfaceAlgorithm *iso);
+        /// create a cutting simulation with a tiled stock
+        /// \param stock the box to cover with tiles
+        /// \param tile_size octree size of each tile, as octree_size above.
+        ///        The tiles are cubes with side 2*tile_size, in a grid starting at stock.minpt.
+        ///        Leave a margin around the stock material, the surface is only meshed inside the tiles.
+        /// \param octree_max_depth maximum sub-division depth of each tile
+        Cutsim(const Bbox &stock, double tile_size, unsigned int octree_max_depth, GLData *gld, IsoSurfaceAlgorithm *iso);
+        /// create a cutting simulation that starts from a snapshot of another one, e.g. to
+        /// try a variant of a toolpath. The new stock shares the nodes of the snapshot, see snapshot().
+        /// The settings of the octree tiles are those of the snapshot, the mesh is made at the first updateGL().
+        Cutsim(const Snapshot &s, GLData *gld, IsoSurfaceAlgorithm *iso);
         virtual ~Cutsim();
         void diff_volume(const Volume *vol);      ///< subtract/diff given Volume
+        /// diff several Volumes, e.g. the cutters of a multi-spindle machine or a batch of moves.
+        /// The result is the same as calling diff_volume() for each Volume in order.
+        /// Each tile is owned by one worker thread at a time, which applies the Volumes that overlap
+        /// the tile, so Volumes in different tiles are cut in parallel, see set_threads().
+        void diff_volumes(const std::vector<const Volume *> &volumes);
         void sum_volume(const Volume *vol);       ///< sum/union given Volume
         void intersect_volume(const Volume *vol); ///< intersect/"and" given Volume
         void updateGL();                          ///< update the GL-data
 
         void init(unsigned int n);
+        /// replace the stock with the given volume, starting from an empty tree.
+        /// Only the nodes along the surface of the stock are created, there is no need for init().
+        /// Best with volumes that have an exact Volume::classify(), e.g. BoxVolume,
+        /// CylinderVolume or ExtrusionVolume. An invalid Volume, see Volume::valid(), is refused
+        /// with an error, here and in the operations above.
+        void init_stock(const Volume *stock);
+        /// the material index at point (x,y,z), i.e. the index of the Volume that last
+        /// changed the stock there, or -1 if the point is outside the octree.
+        /// Look up the color of the material with get_palette().color()
+        int material_at(float x, float y, float z) const;
+        /// an unchangeable copy of the current stock.
+        /// The snapshot shares all octree nodes with the stock, so it is cheap to take. Later operations
+        /// copy the blocks of eight nodes that they change (copy-on-write), and memory grows in proportion
+        /// to the changes. Any number of Cutsims can be created from one snapshot and cut in parallel,
+        /// one thread each. Delete the snapshot when done, the shared nodes live on in the Cutsims.
+        /// The operations before the snapshot can no longer be undone, see undo().
+        Snapshot *snapshot();
+        /// replace the stock with a snapshot of a Cutsim with the same tiles, e.g. to undo a
+        /// toolpath variant. updateGL() remeshes the stock. Returns false if the tiles differ.
+        bool restore(const Snapshot &s);
+        /// write the stock to a binary checkpoint file, see Checkpoint. Returns false on error.
+        /// The checkpoint starts a new chain of delta checkpoints.
+        bool save_checkpoint(const std::string &path);
+        /// write the nodes changed since the previous checkpoint of the chain to a delta checkpoint
+        /// file, so that the time and size grow with the change, not with the stock.
+        /// Returns false on error, or if the stock was not written to or read from a checkpoint
+        /// since init(), init_stock() or restore(). A failed delta can be retried.
+        bool save_delta_checkpoint(const std::string &path);
+        /// write a checkpoint, or a delta if delta is true, in a background thread and return at once.
+        /// The thread writes a snapshot() of the stock, so cutting goes on meanwhile, and the undo
+        /// history ends as for snapshot(). A checkpoint still being written is waited for first.
+        /// Returns false if no delta can be written, see save_delta_checkpoint().
+        bool save_checkpoint_async(const std::string &path, bool delta = false);
+        /// wait until the checkpoint of save_checkpoint_async() is written. Returns false if
+        /// writing failed, which ends the chain of deltas, or if there is none.
+        bool wait_checkpoint();
+        /// replace the stock with a checkpoint written by a Cutsim with the same tiles, e.g. to resume
+        /// a simulation. A delta checkpoint is applied to the stock, which must be as of the previous
+        /// checkpoint of its chain, so a chain is loaded by loading its files in order.
+        /// With map the file is memory-mapped instead of read through a buffer.
+        /// updateGL() meshes the stock. Returns false, and keeps the stock, if the file is not a
+        /// checkpoint of these tiles. The undo history ends, also on failure.
+        bool load_checkpoint(const std::string &path, bool map = false);
+        /// journal the changes of the last depth boolean operations, so that undo() can revert them.
+        /// Memory grows with the nodes that the operations change, see Octree::set_undo().
+        /// Off (0) by default. init(), init_stock(), snapshot() and restore() end the history.
+        void set_undo(std::size_t depth);
+        /// revert the last n boolean operations, without simulating the others again.
+        /// Each Volume of diff_volumes() counts as one operation. Takes time in proportion to the
+        /// nodes that the operations changed, updateGL() remeshes them.
+        /// Returns the number of operations reverted.
+        std::size_t undo(std::size_t n = 1);
+        /// number of operations that undo() can revert
+        std::size_t undo_count() const { return history.size(); }
+        /// the materials of the Volumes applied to the stock
+        const Palette &get_palette() const { return palette; }
+        /// page the parts of the stock far from the recent cuts out to files, one per tile at path.N,
+        /// when the octree nodes, Bricks and packed sub-trees in memory take more than budget bytes,
+        /// see Octree::page_out(). After each operation over the budget, the sub-trees cut least
+        /// recently are paged first, then those furthest from the last cut, down to 90% of the budget.
+        /// The sub-trees of the last 8 cuts are never paged. A cut or updateGL() that reaches a paged sub-tree reads it
+        /// back. The budget counts the nodes of all Cutsims and snapshots of the process.
+        /// Paging out ends the undo history. An empty path or a zero budget reads all pages back and
+        /// turns paging off, the default. Returns false if a page file can not be created.
+        bool set_paging(const std::string &path, std::size_t budget);
+        /// page out until the memory is within the budget, return the number of sub-trees paged
+        std::size_t page_out();
+        /// pack the sub-trees of the stock that no operation has cut for idle operations in memory,
+        /// see Octree::pack(). They take a few bytes per node instead of a block of children, and are
+        /// read back when a cut or updateGL() reaches them. The stock is checked after every idle/8
+        /// operations, and a sub-tree that updateGL() has still to mesh is not packed. Packing ends
+        /// the undo history. 0 reads the packed sub-trees back and turns packing off, the default.
+        void set_packing(std::size_t idle);
+        /// pack the sub-trees idle for long enough now, return the number of sub-trees packed
+        std::size_t pack();
+        /// keep the octree nodes, Bricks and packed sub-trees in memory within budget bytes by lowering
+        /// the resolution away from the cutter, instead of running out of memory. After an operation
+        /// over 90% of the budget, the regions cut least recently lose their finest level, see
+        /// Octree::coarsen(), and so on one level at a time down to 80% of the budget. The regions
+        /// of the last 8 cuts are kept. If that is not enough, the operations subdivide one level
+        /// less after each operation over the budget, and one level more again under half of it,
+        /// see Octree::set_depth_limit(). Both print a warning the first time they reach a level.
+        /// An operation stops subdividing when it reaches the budget, see Octree::set_memory_limit().
+        /// init_stock() makes the stock at full resolution first, so the stock never cut is the first
+        /// to be coarsened. Coarsening ends the undo history. The budget counts the nodes of all
+        /// Cutsims and snapshots of the process, and applies after paging, see set_paging(): nodes
+        /// of other Cutsims over the budget make this one coarsen all it can. 0 turns it off, the default.
+        /// The mesh of a coarsened region, cut or not, is made of fewer and larger triangles. Where
+        /// it meets finer leaves it has cracks and T-junctions, since updateGL() meshes each leaf on
+        /// its own, so the exported mesh is not watertight there. The regions of the last 8 cuts keep
+        /// their mesh.
+        void set_memory_budget(std::size_t budget);
+        /// coarsen down to 80% of the memory budget now, return the number of regions coarsened
+        std::size_t coarsen();
+        /// the number of regions coarsened since construction, non-zero if the budget was reached
+        unsigned long coarsened_count() const { return coarsened; }
+        /// the depth the operations subdivide to, the octree max_depth unless over the memory budget
+        unsigned int get_depth_limit() const;
+        /// defer pruning of the stock octree, see Octree::set_lazy_prune().
+        /// The deferred prunes are done at updateGL(), or once more than max_pending
+        /// are deferred in a tile. Off by default.
+        void set_lazy_prune(bool lazy, std::size_t max_pending = 100000);
+        /// do the deferred prunes now, return the number of nodes pruned
+        std::size_t prune();
+        /// evaluate Volume::dist() once per octree lattice point and operation, see Octree::set_dist_cache().
+        /// Off by default. Used for expensive volumes such as MeshVolume only, the primitives bypass it.
+        /// Saves time, not memory.
+        void set_dist_cache(bool on);
+        /// store the bottom levels of the stock octree as dense bricks, see Octree::set_bricks().
+        /// Off by default, faster and smaller for thin shells around the surface.
+        void set_bricks(bool on);
+        /// do not subdivide the leaves of the stock where the distance field is linear within tolerance,
+        /// see Octree::set_refine_tolerance(). Flat and gently curved faces then take far fewer leaves
+        /// and triangles. 0, the default, subdivides all leaves that the surface crosses.
+        /// The leaves of a face then differ in size, and the mesh is not watertight: see
+        /// Octree::set_refine_tolerance() for the cracks and T-junctions.
+        void set_refine_tolerance(float tolerance);
+        /// the tolerance of the linear distance field in a leaf, 0 for none
+        float get_refine_tolerance() const { return tiles[0]->get_refine_tolerance(); }
+        /// maximum number of worker threads used by diff_volumes(), default 1
+        void set_threads(unsigned int n) { threads = std::max(1u, n); }
+        /// maximum number of worker threads
+        unsigned int get_threads() const { return threads; }
+        /// number of octree tiles of the stock
+        std::size_t tile_count() const { return tiles.size(); }
+        /// number of leaf nodes in the stock octree
+        std::size_t leaf_count() const;
+        /// node counts of the stock octree and memory used by it and the GLData
+        OctreeStats get_tree_stats() const;
         std::string str() const;
 
+        /// instrumentation counters, accumulated since construction or reset_stats().
+        /// all counters are zero unless built with CUTSIM_STATS
+        const CutsimStats &get_stats() const { return stats; }
+        /// counters of the most recent operation
+        const OpStats &get_last_stats() const { return stats.last; }
+        /// reset all instrumentation counters
+        void reset_stats() { stats.clear(); }
+
     private:
+        /// add a tile with the given center to the stock
+        void add_tile(double tile_size, unsigned int octree_max_depth, const GLVertex &center);
+        /// running totals of all counters in the tree, the isosurface algorithm and the GLData
+        OpStats counters() const;
+        /// record the counters of one operation, started at the given counter totals
+        void record(OpStats &kind, const OpStats &before, double seconds);
+        /// add an operation on the given tiles to the undo history
+        void add_history(const std::vector<std::size_t> &changed);
+        /// remember the box of a Volume cut from or added to the stock, for page_out() and pack()
+        void record_cut(const Bbox &bb);
+        /// pack() if it is due, page_out() if the memory is over the paging budget,
+        /// and coarsen() if it is close to the memory budget
+        void check_memory();
+        /// lower the depth limit of the tiles by one level over the memory budget, raise it by one under half
+        void limit_depth();
+        /// the id of the next checkpoint, false if a delta has no checkpoint to follow
+        bool next_checkpoint(bool delta, CheckpointId &id);
+        /// start a new epoch in the tiles after the checkpoint id was taken
+        void checkpoint_taken(const CheckpointId &id);
+
+        CutsimStats stats;             // instrumentation of this Cutsim
         IsoSurfaceAlgorithm *iso_algo; // the isosurface-extraction algorithm to use
-        Octree *tree;                  // this is the stock model
+        std::vector<Octree *> tiles;   // this is the stock model
+        Palette palette;               // materials of the Volumes applied to the stock
         GLData *g;                     // this is the graphics object, for rendering
+        unsigned int threads;          // maximum number of worker threads
+        std::size_t undo_depth;        // maximum length of the undo history
+        // the tiles changed by each operation that can be undone, oldest first.
+        // snapshot() ends the history, the forked tiles forget their journals.
+        std::deque< std::vector<std::size_t> > history;
+        std::future<bool> checkpoint;  // the result of save_checkpoint_async()
+        CheckpointId checkpoint_id;    // the checkpoint last written or read, chain 0 for none
+        bool stock_changed;            // the stock changed since checkpoint_id
+        std::size_t page_budget;       // memory budget of paging, 0 when off
+        unsigned long operations;      // the cuts given to record_cut()
+        Bbox latest_cut;               // the box of the latest of them
+        std::size_t pack_idle;         // operations before a sub-tree is packed, 0 when off
+        unsigned long pack_since;      // the operation when packing was turned on
+        unsigned long packed_at;       // the operation of the last pack()
+        std::size_t memory_budget;     // the budget of coarsen(), 0 when off
+        unsigned long coarsened;       // regions coarsened
+        unsigned int coarsest;         // the coarsest depth coarsen() warned of, 0 for none
+        bool making_stock;             // init_stock() is adding the stock, which record_cut() takes as operation 0
     };
 
 } // end Cutsim namespace
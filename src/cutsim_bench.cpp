@@ -0,0 +1,386 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// cutsim-bench: canonical machining scenarios for performance tracking
+//
+// every (scenario, depth) pair runs in a forked child process so that the
+// reported peak memory belongs to that run only. One JSON object is printed
+// per run, so the output of two builds can be compared line by line.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cutsim.hpp"
+
+namespace
+{
+    using namespace cutsim;
+
+    typedef std::chrono::steady_clock Clock;
+
+    double seconds_since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    const double octree_size = 10.0; // stock cube is 10x10x10 with the top face at z=0
+
+    /// --lazy-prune N, zero for immediate pruning
+    std::size_t lazy_prune = 0;
+    /// --dist-cache
+    bool dist_cache = false;
+    /// --bricks
+    bool bricks = false;
+
+    /// the result of one benchmark run
+    struct Result
+    {
+        Result() : moves(0), seconds(0), update_seconds(0), ns_per_dist(0), peak_leaves(0), nodes(0), tree_bytes(0), triangles(0) {}
+        OpStats ops; ///< instrumentation counters of the boolean operations (zero without CUTSIM_STATS)
+        std::size_t moves;
+        double seconds;        ///< time spent in boolean operations
+        double update_seconds; ///< time spent in updateGL
+        double ns_per_dist;    ///< isolated cost of one Volume::dist() call of the tool
+        std::size_t peak_leaves;
+        std::size_t nodes;      ///< octree nodes at the end of the run
+        std::size_t tree_bytes; ///< memory used by the octree and GLData at the end of the run
+        int triangles;
+    };
+
+    /// a scenario positions the tool and reports each move
+    struct Scenario
+    {
+        const char *name;
+        const char *description;
+        void (*run)(Cutsim &cs, Result &r, std::size_t &peak);
+    };
+
+    // sample the leaf count every this many moves
+    const std::size_t sample_every = 64;
+
+    void sample(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        if (r.moves % sample_every == 0)
+        {
+            std::size_t leaves = cs.leaf_count();
+            if (leaves > peak)
+                peak = leaves;
+        }
+    }
+
+    /// average cost of dist() for points spread over the bounding-box of the volume
+    double ns_per_dist(const Volume &vol)
+    {
+        const int n = 32;
+        GLVertex lo = vol.bb.minpt, hi = vol.bb.maxpt;
+        volatile float sink = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                for (int k = 0; k < n; ++k)
+                {
+                    GLVertex p(lo.x + (hi.x - lo.x) * i / (n - 1),
+                               lo.y + (hi.y - lo.y) * j / (n - 1),
+                               lo.z + (hi.z - lo.z) * k / (n - 1));
+                    sink = sink + vol.dist(p);
+                }
+        return 1e9 * seconds_since(start) / (n * n * n);
+    }
+
+    /// cut along a zig-zag pocket at depth z, sampled with the given step
+    void pocket(Cutsim &cs, Volume &tool, float z, float step, Result &r, std::size_t &peak)
+    {
+        r.ns_per_dist = ns_per_dist(tool);
+        Clock::time_point start = Clock::now();
+        bool forward = true;
+        for (float y = -3; y <= 3; y += 0.5)
+        {
+            for (float t = -3; t <= 3; t += step)
+            {
+                tool.setCenter(forward ? t : -t, y, z);
+                cs.diff_volume(&tool);
+                ++r.moves;
+                r.seconds += seconds_since(start);
+                sample(cs, r, peak);
+                start = Clock::now();
+            }
+            forward = !forward;
+        }
+        r.seconds += seconds_since(start);
+    }
+
+    void pocket_ball(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        SphereVolume ball;
+        ball.setRadius(0.5);
+        pocket(cs, ball, -0.3, 0.05, r, peak);
+    }
+
+    void pocket_flat(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        CylinderVolume flat;
+        flat.setRadius(0.5);
+        flat.setLength(5);
+        pocket(cs, flat, -0.8, 0.05, r, peak);
+    }
+
+    void drilling(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        CylinderVolume drill;
+        drill.setRadius(0.3);
+        drill.setLength(5);
+        r.ns_per_dist = ns_per_dist(drill);
+        Clock::time_point start = Clock::now();
+        for (float x = -3; x <= 3; x += 1.5)
+            for (float y = -3; y <= 3; y += 1.5)
+                for (float z = 0; z >= -4; z -= 0.05)
+                {
+                    drill.setCenter(x, y, z);
+                    cs.diff_volume(&drill);
+                    ++r.moves;
+                    r.seconds += seconds_since(start);
+                    sample(cs, r, peak);
+                    start = Clock::now();
+                }
+        r.seconds += seconds_since(start);
+    }
+
+    void vcarve(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        ConeVolume cone;
+        cone.setHeight(2);
+        r.ns_per_dist = ns_per_dist(cone);
+        Clock::time_point start = Clock::now();
+        for (int n = 0; n < 400; ++n)
+        {
+            float t = 2 * M_PI * n / 400.0;
+            cone.setCenter(3 * cos(t), 2 * sin(2 * t), -0.4 - 0.2 * sin(3 * t));
+            cs.diff_volume(&cone);
+            ++r.moves;
+            r.seconds += seconds_since(start);
+            sample(cs, r, peak);
+            start = Clock::now();
+        }
+        r.seconds += seconds_since(start);
+    }
+
+    /// a box-shaped tool built from 12 facets
+    void box_facets(float sx, float sy, float sz, std::vector<Facet> &facets)
+    {
+        GLVertex c[8];
+        for (int n = 0; n < 8; ++n)
+            c[n] = GLVertex((n & 1) ? sx / 2 : -sx / 2, (n & 2) ? sy / 2 : -sy / 2, (n & 4) ? sz : 0);
+        // each face as two triangles with outward normals
+        const int faces[6][4] = {{0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}};
+        const GLVertex normals[6] = {GLVertex(0, 0, -1), GLVertex(0, 0, 1), GLVertex(0, -1, 0),
+                                     GLVertex(0, 1, 0), GLVertex(-1, 0, 0), GLVertex(1, 0, 0)};
+        for (int f = 0; f < 6; ++f)
+        {
+            facets.push_back(Facet(normals[f], c[faces[f][0]], c[faces[f][1]], c[faces[f][2]]));
+            facets.push_back(Facet(normals[f], c[faces[f][0]], c[faces[f][2]], c[faces[f][3]]));
+        }
+    }
+
+    void mesh_tool(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        std::vector<Facet> facets;
+        box_facets(0.8, 0.8, 3, facets);
+        MeshVolume mesh;
+        mesh.loadMesh(facets);
+        mesh.setMeshCenter(0, 0, 0);
+        r.ns_per_dist = ns_per_dist(mesh);
+        Clock::time_point start = Clock::now();
+        for (int n = 0; n < 60; ++n)
+        {
+            float t = 2 * M_PI * n / 60.0;
+            mesh.setMeshCenter(2.5 * cos(t), 2.5 * sin(t), -0.5);
+            cs.diff_volume(&mesh);
+            ++r.moves;
+            r.seconds += seconds_since(start);
+            sample(cs, r, peak);
+            start = Clock::now();
+        }
+        r.seconds += seconds_since(start);
+    }
+
+    /// the stock itself, i.e. the cost of building it and meshing it from scratch
+    void remesh(Cutsim &cs, Result &r, std::size_t &peak)
+    {
+        r.moves = 1;
+        peak = cs.leaf_count();
+    }
+
+    const Scenario scenarios[] = {
+        {"pocket_ball", "zig-zag pocket with a ball cutter", pocket_ball},
+        {"pocket_flat", "zig-zag pocket with a flat end-mill", pocket_flat},
+        {"drilling", "peck drilling a grid of holes", drilling},
+        {"vcarve", "v-carving a closed curve with a cone", vcarve},
+        {"mesh_tool", "circular path with a MeshVolume tool", mesh_tool},
+        {"remesh", "stock creation with init_stock and a full updateGL", remesh},
+    };
+    const int scenario_count = sizeof(scenarios) / sizeof(Scenario);
+
+    /// run one scenario at one depth, in this process
+    Result run(const Scenario &s, unsigned int depth, double &stock_seconds)
+    {
+        GLData gl;
+        MarchingCubes iso;
+        Cutsim cs(octree_size, depth, &gl, &iso);
+        if (lazy_prune)
+            cs.set_lazy_prune(true, lazy_prune);
+        cs.set_dist_cache(dist_cache);
+        if (bricks)
+            cs.set_bricks(true);
+        Result r;
+
+        Clock::time_point start = Clock::now();
+        BoxVolume stock;
+        stock.setSize(octree_size, octree_size, octree_size);
+        stock.setCenter(0, 0, -octree_size / 2);
+        cs.init_stock(&stock);
+        stock_seconds = seconds_since(start);
+
+        std::size_t peak = 0;
+        OpStats stock_ops = cs.get_stats().sum;
+        cs.reset_stats();
+        s.run(cs, r, peak);
+        r.ops = cs.get_stats().diff;
+        r.ops += cs.get_stats().sum;
+
+        start = Clock::now();
+        cs.updateGL();
+        r.update_seconds = seconds_since(start);
+        if (std::strcmp(s.name, "remesh") == 0)
+        {
+            r.seconds = stock_seconds;
+            r.ops = stock_ops;
+        }
+
+        OctreeStats tree_stats = cs.get_tree_stats();
+        r.peak_leaves = tree_stats.leaf_count > peak ? tree_stats.leaf_count : peak;
+        r.nodes = tree_stats.node_count;
+        r.tree_bytes = tree_stats.total_bytes();
+        r.triangles = gl.indexCount() / 3;
+        return r;
+    }
+
+    void print_json(const Scenario &s, unsigned int depth, const Result &r, double stock_seconds, long peak_rss_kb)
+    {
+        std::printf("{\"scenario\": \"%s\", \"depth\": %u, \"moves\": %zu, \"seconds\": %.6f, "
+                    "\"ops_per_sec\": %.1f, \"ns_per_dist\": %.1f, \"stock_seconds\": %.6f, "
+                    "\"update_seconds\": %.6f, \"peak_leaves\": %zu, \"nodes\": %zu, \"tree_kb\": %zu, "
+                    "\"peak_rss_kb\": %ld, \"triangles\": %d, "
+                    "\"nodes_visited\": %lu, \"dist_calls\": %lu, \"subdivisions\": %lu, \"prunes\": %lu, \"classified\": %lu}\n",
+                    s.name, depth, r.moves, r.seconds, r.seconds > 0 ? r.moves / r.seconds : 0.0,
+                    r.ns_per_dist, stock_seconds, r.update_seconds, r.peak_leaves, r.nodes, r.tree_bytes / 1024,
+                    peak_rss_kb, r.triangles,
+                    r.ops.nodes_visited, r.ops.dist_calls, r.ops.subdivisions, r.ops.prunes, r.ops.classified);
+        std::fflush(stdout);
+    }
+
+    void usage()
+    {
+        std::cout << "usage: cutsim-bench [--depth MIN[-MAX]] [--lazy-prune N] [--dist-cache] [--bricks] [--scenario NAME]...\n"
+                  << "--lazy-prune N defers pruning until updateGL() or N deferred prunes\n"
+                  << "--dist-cache evaluates dist() of mesh tools once per lattice point and operation\n"
+                  << "--bricks stores the bottom three octree levels as dense bricks\n"
+                  << "default depths are 6-10, default is all scenarios:\n";
+        for (int n = 0; n < scenario_count; ++n)
+            std::cout << "  " << scenarios[n].name << " : " << scenarios[n].description << "\n";
+    }
+
+} // end anonymous namespace
+
+int main(int argc, char **argv)
+{
+    unsigned int min_depth = 6, max_depth = 10;
+    std::vector<std::string> selected;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        if (arg == "--depth" && n + 1 < argc)
+        {
+            std::string range = argv[++n];
+            std::size_t dash = range.find('-');
+            min_depth = std::atoi(range.substr(0, dash).c_str());
+            max_depth = (dash == std::string::npos) ? min_depth : std::atoi(range.substr(dash + 1).c_str());
+        }
+        else if (arg == "--lazy-prune" && n + 1 < argc)
+            lazy_prune = std::atoi(argv[++n]);
+        else if (arg == "--dist-cache")
+            dist_cache = true;
+        else if (arg == "--bricks")
+            bricks = true;
+        else if (arg == "--scenario" && n + 1 < argc)
+            selected.push_back(argv[++n]);
+        else
+        {
+            usage();
+            return (arg == "-h" || arg == "--help") ? 0 : 1;
+        }
+    }
+    if (min_depth < 2 || max_depth < min_depth)
+    {
+        usage();
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < scenario_count; ++i)
+    {
+        const Scenario &s = scenarios[i];
+        bool wanted = selected.empty();
+        for (const std::string &name : selected)
+            wanted = wanted || (name == s.name);
+        if (!wanted)
+            continue;
+        for (unsigned int depth = min_depth; depth <= max_depth; ++depth)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                std::cout.setstate(std::ios::failbit); // keep library messages out of the JSON output
+                double stock_seconds = 0;
+                Result r = run(s, depth, stock_seconds);
+                struct rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+                print_json(s, depth, r, stock_seconds, usage.ru_maxrss);
+                std::_Exit(0);
+            }
+            int status = 0;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                std::fprintf(stderr, "cutsim-bench: %s at depth %u failed\n", s.name, depth);
+                ++failures;
+            }
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,361 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "cutsim_c.h"
+#include "cutsim.hpp"
+#include "trace.hpp"
+
+// the opaque C handles wrap the C++ objects
+struct cutsim_t
+{
+    cutsim_t(double octree_size, unsigned int octree_max_depth)
+        : cs(octree_size, octree_max_depth, &gl, &iso) {}
+    cutsim_t(const cutsim::Bbox &stock, double tile_size, unsigned int octree_max_depth)
+        : cs(stock, tile_size, octree_max_depth, &gl, &iso) {}
+    explicit cutsim_t(const cutsim::Snapshot &snapshot)
+        : cs(snapshot, &gl, &iso) {}
+    cutsim::GLData gl;
+    cutsim::MarchingCubes iso;
+    cutsim::Cutsim cs;
+};
+
+struct cutsim_snapshot_t
+{
+    explicit cutsim_snapshot_t(cutsim::Snapshot *s) : snapshot(s) {}
+    ~cutsim_snapshot_t() { delete snapshot; }
+    cutsim::Snapshot *snapshot;
+};
+
+struct cutsim_volume_t
+{
+    explicit cutsim_volume_t(cutsim::Volume *v) : vol(v) {}
+    ~cutsim_volume_t() { delete vol; }
+    cutsim::Volume *vol;
+};
+
+extern "C"
+{
+
+    cutsim_t *cutsim_create(double octree_size, unsigned int octree_max_depth)
+    {
+        return new cutsim_t(octree_size, octree_max_depth);
+    }
+
+    cutsim_t *cutsim_create_tiled(float minx, float miny, float minz, float maxx, float maxy, float maxz,
+                                  double tile_size, unsigned int octree_max_depth)
+    {
+        cutsim::Bbox stock;
+        stock.addPoint(cutsim::GLVertex(minx, miny, minz));
+        stock.addPoint(cutsim::GLVertex(maxx, maxy, maxz));
+        return new cutsim_t(stock, tile_size, octree_max_depth);
+    }
+
+    void cutsim_destroy(cutsim_t *cs)
+    {
+        delete cs;
+    }
+
+    void cutsim_init(cutsim_t *cs, unsigned int n)
+    {
+        cs->cs.init(n);
+    }
+
+    void cutsim_init_stock(cutsim_t *cs, const cutsim_volume_t *vol)
+    {
+        cs->cs.init_stock(vol->vol);
+    }
+
+    void cutsim_sum_volume(cutsim_t *cs, const cutsim_volume_t *vol)
+    {
+        cs->cs.sum_volume(vol->vol);
+    }
+
+    void cutsim_diff_volume(cutsim_t *cs, const cutsim_volume_t *vol)
+    {
+        cs->cs.diff_volume(vol->vol);
+    }
+
+    void cutsim_diff_volumes(cutsim_t *cs, const cutsim_volume_t *const *vols, size_t n)
+    {
+        std::vector<const cutsim::Volume *> volumes;
+        for (size_t i = 0; i < n; ++i)
+            volumes.push_back(vols[i]->vol);
+        cs->cs.diff_volumes(volumes);
+    }
+
+    void cutsim_set_threads(cutsim_t *cs, unsigned int threads)
+    {
+        cs->cs.set_threads(threads);
+    }
+
+    void cutsim_set_lazy_prune(cutsim_t *cs, int lazy, size_t max_pending)
+    {
+        cs->cs.set_lazy_prune(lazy != 0, max_pending);
+    }
+
+    void cutsim_set_dist_cache(cutsim_t *cs, int on)
+    {
+        cs->cs.set_dist_cache(on != 0);
+    }
+
+    void cutsim_set_bricks(cutsim_t *cs, int on)
+    {
+        cs->cs.set_bricks(on != 0);
+    }
+
+    void cutsim_set_refine_tolerance(cutsim_t *cs, float tolerance)
+    {
+        cs->cs.set_refine_tolerance(tolerance);
+    }
+
+    int cutsim_set_paging(cutsim_t *cs, const char *path, size_t budget)
+    {
+        return cs->cs.set_paging(path ? path : "", budget);
+    }
+
+    void cutsim_set_packing(cutsim_t *cs, size_t idle)
+    {
+        cs->cs.set_packing(idle);
+    }
+
+    void cutsim_set_memory_budget(cutsim_t *cs, size_t budget)
+    {
+        cs->cs.set_memory_budget(budget);
+    }
+
+    unsigned long cutsim_coarsened_count(const cutsim_t *cs)
+    {
+        return cs->cs.coarsened_count();
+    }
+
+    void cutsim_intersect_volume(cutsim_t *cs, const cutsim_volume_t *vol)
+    {
+        cs->cs.intersect_volume(vol->vol);
+    }
+
+    void cutsim_update_gl(cutsim_t *cs)
+    {
+        cs->cs.updateGL();
+    }
+
+    void cutsim_set_undo(cutsim_t *cs, size_t depth)
+    {
+        cs->cs.set_undo(depth);
+    }
+
+    size_t cutsim_undo(cutsim_t *cs, size_t n)
+    {
+        return cs->cs.undo(n);
+    }
+
+    cutsim_snapshot_t *cutsim_snapshot(cutsim_t *cs)
+    {
+        return new cutsim_snapshot_t(cs->cs.snapshot());
+    }
+
+    cutsim_t *cutsim_fork(const cutsim_snapshot_t *snapshot)
+    {
+        return new cutsim_t(*snapshot->snapshot);
+    }
+
+    int cutsim_restore(cutsim_t *cs, const cutsim_snapshot_t *snapshot)
+    {
+        return cs->cs.restore(*snapshot->snapshot);
+    }
+
+    void cutsim_snapshot_destroy(cutsim_snapshot_t *snapshot)
+    {
+        delete snapshot;
+    }
+
+    int cutsim_save_checkpoint(cutsim_t *cs, const char *path)
+    {
+        return path && cs->cs.save_checkpoint(path);
+    }
+
+    int cutsim_save_delta_checkpoint(cutsim_t *cs, const char *path)
+    {
+        return path && cs->cs.save_delta_checkpoint(path);
+    }
+
+    int cutsim_save_checkpoint_async(cutsim_t *cs, const char *path, int delta)
+    {
+        return path && cs->cs.save_checkpoint_async(path, delta != 0);
+    }
+
+    int cutsim_wait_checkpoint(cutsim_t *cs)
+    {
+        return cs->cs.wait_checkpoint();
+    }
+
+    int cutsim_load_checkpoint(cutsim_t *cs, const char *path, int map)
+    {
+        return path && cs->cs.load_checkpoint(path, map != 0);
+    }
+
+    size_t cutsim_vertex_count(const cutsim_t *cs)
+    {
+        return cs->gl.vertexCount();
+    }
+
+    const float *cutsim_vertex_data(const cutsim_t *cs)
+    {
+        return reinterpret_cast<const float *>(cs->gl.getVertexArray());
+    }
+
+    size_t cutsim_index_count(const cutsim_t *cs)
+    {
+        return cs->gl.indexCount();
+    }
+
+    const unsigned int *cutsim_index_data(const cutsim_t *cs)
+    {
+        return cs->gl.getIndexArray();
+    }
+
+    int cutsim_write_stl(const cutsim_t *cs, const char *path, int binary)
+    {
+        if (!path || !*path)
+            return 0;
+        return !cs->gl.writeStl(path, binary != 0).empty();
+    }
+
+    int cutsim_material_at(const cutsim_t *cs, float x, float y, float z)
+    {
+        return cs->cs.material_at(x, y, z);
+    }
+
+    int cutsim_material_color(const cutsim_t *cs, int material, float *rgb)
+    {
+        const cutsim::Palette &palette = cs->cs.get_palette();
+        if (material < 0 || material >= (int)palette.size())
+            return 0;
+        const cutsim::Color &c = palette.color(material);
+        rgb[0] = c.r;
+        rgb[1] = c.g;
+        rgb[2] = c.b;
+        return 1;
+    }
+
+    int cutsim_trace_start(const char *path)
+    {
+        return path && cutsim::Trace::start(path);
+    }
+
+    int cutsim_trace_stop(void)
+    {
+        return cutsim::Trace::stop();
+    }
+
+    cutsim_volume_t *cutsim_sphere_volume(float radius)
+    {
+        cutsim::SphereVolume *s = new cutsim::SphereVolume();
+        s->setRadius(radius);
+        return new cutsim_volume_t(s);
+    }
+
+    cutsim_volume_t *cutsim_cube_volume(float side)
+    {
+        cutsim::CubeVolume *c = new cutsim::CubeVolume();
+        c->setSide(side);
+        return new cutsim_volume_t(c);
+    }
+
+    cutsim_volume_t *cutsim_box_volume(float lx, float ly, float lz)
+    {
+        cutsim::BoxVolume *b = new cutsim::BoxVolume();
+        b->setSize(lx, ly, lz);
+        return new cutsim_volume_t(b);
+    }
+
+    cutsim_volume_t *cutsim_extrusion_volume(const float *profile, size_t npoints, float length)
+    {
+        if (npoints < 3)
+            return NULL;
+        cutsim::ExtrusionVolume *e = new cutsim::ExtrusionVolume();
+        for (size_t i = 0; i < npoints; ++i)
+            e->addPoint(profile[2 * i], profile[2 * i + 1]);
+        e->setLength(length);
+        return new cutsim_volume_t(e);
+    }
+
+    cutsim_volume_t *cutsim_cone_volume(float height)
+    {
+        cutsim::ConeVolume *c = new cutsim::ConeVolume();
+        c->setHeight(height);
+        return new cutsim_volume_t(c);
+    }
+
+    cutsim_volume_t *cutsim_cylinder_volume(float radius, float length)
+    {
+        cutsim::CylinderVolume *c = new cutsim::CylinderVolume();
+        c->setRadius(radius);
+        c->setLength(length);
+        return new cutsim_volume_t(c);
+    }
+
+    cutsim_volume_t *cutsim_mesh_volume(const float *facets, size_t nfacets)
+    {
+        std::vector<cutsim::Facet> meshFacets;
+        for (size_t i = 0; i < nfacets; ++i)
+        {
+            const float *f = facets + 12 * i;
+            meshFacets.push_back(cutsim::Facet(cutsim::GLVertex(f[0], f[1], f[2]),
+                                               cutsim::GLVertex(f[3], f[4], f[5]),
+                                               cutsim::GLVertex(f[6], f[7], f[8]),
+                                               cutsim::GLVertex(f[9], f[10], f[11])));
+        }
+        cutsim::MeshVolume *m = new cutsim::MeshVolume();
+        if (!m->loadMesh(meshFacets))
+        {
+            delete m;
+            return NULL;
+        }
+        return new cutsim_volume_t(m);
+    }
+
+    cutsim_volume_t *cutsim_stl_volume(const char *path)
+    {
+        cutsim::MeshVolume *m = new cutsim::MeshVolume();
+        if (!path || !m->loadStl(path))
+        {
+            delete m;
+            return NULL;
+        }
+        return new cutsim_volume_t(m);
+    }
+
+    void cutsim_volume_destroy(cutsim_volume_t *vol)
+    {
+        delete vol;
+    }
+
+    void cutsim_volume_set_center(cutsim_volume_t *vol, float x, float y, float z)
+    {
+        vol->vol->setCenter(x, y, z);
+    }
+
+    void cutsim_volume_set_color(cutsim_volume_t *vol, float r, float g, float b)
+    {
+        vol->vol->setColor(r, g, b);
+    }
+
+} // extern "C"
@@ -0,0 +1,138 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CUTSIM_C_H
+#define CUTSIM_C_H
+
+/* C API for embedding libcutsim without C++ or Python.
+ *
+ * A cutsim_t owns its Cutsim, GLData and MarchingCubes objects.
+ * Volumes are created separately and may be reused for any number of operations.
+ * Functions returning int return 1 on success and 0 on failure.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct cutsim_t cutsim_t;
+    typedef struct cutsim_volume_t cutsim_volume_t;
+    typedef struct cutsim_snapshot_t cutsim_snapshot_t;
+
+    /* simulation */
+    cutsim_t *cutsim_create(double octree_size, unsigned int octree_max_depth);
+    /* a stock of cubic octree tiles of size tile_size covering the box (minx,miny,minz)-(maxx,maxy,maxz) */
+    cutsim_t *cutsim_create_tiled(float minx, float miny, float minz, float maxx, float maxy, float maxz,
+                                  double tile_size, unsigned int octree_max_depth);
+    void cutsim_destroy(cutsim_t *cs);
+    void cutsim_init(cutsim_t *cs, unsigned int n);
+    /* replace the stock with vol, creating only the nodes along its surface */
+    void cutsim_init_stock(cutsim_t *cs, const cutsim_volume_t *vol);
+    void cutsim_sum_volume(cutsim_t *cs, const cutsim_volume_t *vol);
+    void cutsim_diff_volume(cutsim_t *cs, const cutsim_volume_t *vol);
+    /* diff n volumes, tiles of the stock are cut in parallel with up to cutsim_set_threads() threads */
+    void cutsim_diff_volumes(cutsim_t *cs, const cutsim_volume_t *const *vols, size_t n);
+    void cutsim_set_threads(cutsim_t *cs, unsigned int threads);
+    /* defer pruning to cutsim_update_gl, or until more than max_pending prunes are deferred */
+    void cutsim_set_lazy_prune(cutsim_t *cs, int lazy, size_t max_pending);
+    /* evaluate the distance of a mesh volume once per octree lattice point and operation, saves time not memory */
+    void cutsim_set_dist_cache(cutsim_t *cs, int on);
+    /* store the bottom three octree levels as dense 8x8x8 bricks, needs octree_max_depth >= 5 */
+    void cutsim_set_bricks(cutsim_t *cs, int on);
+    /* leave the leaves where the distance field is linear within tolerance unsubdivided, 0 turns it off.
+     * The mesh then has T-junctions and cracks where coarse and fine leaves meet, it is not watertight. */
+    void cutsim_set_refine_tolerance(cutsim_t *cs, float tolerance);
+    /* page the parts of the stock far from the recent cuts out to files path.N, one per tile, once
+     * the octree nodes in memory take more than budget bytes. NULL or 0 turns paging off. */
+    int cutsim_set_paging(cutsim_t *cs, const char *path, size_t budget);
+    /* pack the parts of the stock that idle operations did not cut in memory, 0 turns it off */
+    void cutsim_set_packing(cutsim_t *cs, size_t idle);
+    /* keep the octree within budget bytes by coarsening the stock away from the cutter, and then by
+     * subdividing less, instead of running out of memory. 0 turns it off. cutsim_coarsened_count
+     * returns the number of regions coarsened, non-zero once the budget was reached. The mesh of
+     * the coarsened regions is coarser, and not watertight where they meet finer ones. */
+    void cutsim_set_memory_budget(cutsim_t *cs, size_t budget);
+    unsigned long cutsim_coarsened_count(const cutsim_t *cs);
+    void cutsim_intersect_volume(cutsim_t *cs, const cutsim_volume_t *vol);
+    void cutsim_update_gl(cutsim_t *cs);
+
+    /* journal the last depth boolean operations, 0 turns it off. cutsim_undo reverts the last
+     * n operations and returns the number reverted. A snapshot ends the history. */
+    void cutsim_set_undo(cutsim_t *cs, size_t depth);
+    size_t cutsim_undo(cutsim_t *cs, size_t n);
+
+    /* snapshots share the octree nodes with the stock, which copies the nodes it changes later.
+     * cutsim_fork creates a new simulation from a snapshot, with its own mesh.
+     * cutsim_restore returns 0 if the snapshot is of a stock with other tiles. */
+    cutsim_snapshot_t *cutsim_snapshot(cutsim_t *cs);
+    cutsim_t *cutsim_fork(const cutsim_snapshot_t *snapshot);
+    int cutsim_restore(cutsim_t *cs, const cutsim_snapshot_t *snapshot);
+    void cutsim_snapshot_destroy(cutsim_snapshot_t *snapshot);
+
+    /* binary checkpoints of the stock. cutsim_save_delta_checkpoint writes the changes since the
+     * previous checkpoint of the chain that cutsim_save_checkpoint starts. cutsim_save_checkpoint_async
+     * writes a snapshot in a background thread, a delta if delta is nonzero, and cutsim_wait_checkpoint
+     * returns its result. cutsim_load_checkpoint memory-maps the file if map is nonzero, and needs a
+     * stock with the same tiles. A delta is loaded after the checkpoint before it. */
+    int cutsim_save_checkpoint(cutsim_t *cs, const char *path);
+    int cutsim_save_delta_checkpoint(cutsim_t *cs, const char *path);
+    int cutsim_save_checkpoint_async(cutsim_t *cs, const char *path, int delta);
+    int cutsim_wait_checkpoint(cutsim_t *cs);
+    int cutsim_load_checkpoint(cutsim_t *cs, const char *path, int map);
+
+    /* mesh output. vertices are GLVertex records of 9 floats: x,y,z, r,g,b, nx,ny,nz */
+    size_t cutsim_vertex_count(const cutsim_t *cs);
+    const float *cutsim_vertex_data(const cutsim_t *cs);
+    size_t cutsim_index_count(const cutsim_t *cs);
+    const unsigned int *cutsim_index_data(const cutsim_t *cs);
+    int cutsim_write_stl(const cutsim_t *cs, const char *path, int binary);
+
+    /* materials. material_at returns the index of the Volume color that last changed the
+     * stock at (x,y,z), or -1 outside the octree. material_color writes the r,g,b of a material
+     * index to rgb[3] and returns 0 for an index that is not in the palette. */
+    int cutsim_material_at(const cutsim_t *cs, float x, float y, float z);
+    int cutsim_material_color(const cutsim_t *cs, int material, float *rgb);
+
+    /* Chrome trace event recording, see trace.hpp */
+    int cutsim_trace_start(const char *path);
+    int cutsim_trace_stop(void);
+
+    /* volumes */
+    cutsim_volume_t *cutsim_sphere_volume(float radius);
+    cutsim_volume_t *cutsim_cube_volume(float side);
+    cutsim_volume_t *cutsim_box_volume(float lx, float ly, float lz);
+    /* profile holds npoints (x, y) pairs of a closed polygon, extruded along z. NULL for npoints < 3 */
+    cutsim_volume_t *cutsim_extrusion_volume(const float *profile, size_t npoints, float length);
+    cutsim_volume_t *cutsim_cone_volume(float height);
+    cutsim_volume_t *cutsim_cylinder_volume(float radius, float length);
+    /* facets holds nfacets records of 12 floats: normal, v1, v2, v3 */
+    cutsim_volume_t *cutsim_mesh_volume(const float *facets, size_t nfacets);
+    cutsim_volume_t *cutsim_stl_volume(const char *path);
+    void cutsim_volume_destroy(cutsim_volume_t *vol);
+    void cutsim_volume_set_center(cutsim_volume_t *vol, float x, float y, float z);
+    void cutsim_volume_set_color(cutsim_volume_t *vol, float r, float g, float b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CUTSIM_C_H */
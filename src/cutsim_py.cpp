@@ -24,24 +24,243 @@ namespace bp = boost::python;
 #include "gldata.hpp"
 #include "volume.hpp"
 #include "isosurface.hpp"
+#include "facet.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 // python wrapper for libcutsim classes & functions
+// the core library is pure C++, the conversions to and from python types live here.
+
+namespace
+{
+    using namespace cutsim;
+
+    /// export triangle-list to python
+    bp::list get_triangles(const GLData &gl)
+    {
+        bp::list out;
+        const GLVertex *vertexArray = gl.getVertexArray();
+        const unsigned int *indexArray = gl.getIndexArray();
+        for (int n = 0; n < gl.indexCount(); n += 3)
+        {
+            bp::list tri;
+            tri.append(vertexArray[indexArray[n]]);
+            tri.append(vertexArray[indexArray[n + 1]]);
+            tri.append(vertexArray[indexArray[n + 2]]);
+            out.append(tri);
+        }
+        return out;
+    }
+
+    /// export line-list to python
+    bp::list get_lines(const GLData &gl)
+    {
+        bp::list out;
+        const GLVertex *vertexArray = gl.getVertexArray();
+        const unsigned int *indexArray = gl.getIndexArray();
+        for (int n = 0; n < gl.indexCount(); n += 2)
+        {
+            bp::list line;
+            line.append(vertexArray[indexArray[n]]);
+            line.append(vertexArray[indexArray[n + 1]]);
+            out.append(line);
+        }
+        return out;
+    }
+
+    /// export stl file and return the path to python
+    bp::str get_stl(const GLData &gl, bp::str fPath, bool binary)
+    {
+        std::string filePath = bp::extract<std::string>(fPath);
+        return bp::str(gl.writeStl(filePath, binary));
+    }
+
+    /// load mesh from python facets
+    /// expected input [[(normal),(v1), (v2), (v3)],...]
+    bool loadMesh(MeshVolume &mesh, bp::list pyfacets)
+    {
+        std::vector<Facet> facets;
+        bp::ssize_t len = bp::len(pyfacets);
+        for (bp::ssize_t i = 0; i < len; i++)
+        {
+            if (bp::len(pyfacets[i]) != 4)
+                continue;
+            GLVertex vertexData[4];
+            for (int j = 0; j < 4; j++)
+            {
+                vertexData[j].x = bp::extract<float>(pyfacets[i][j][0]);
+                vertexData[j].y = bp::extract<float>(pyfacets[i][j][1]);
+                vertexData[j].z = bp::extract<float>(pyfacets[i][j][2]);
+            }
+            facets.push_back(Facet(vertexData[0], vertexData[1], vertexData[2], vertexData[3]));
+        }
+        return mesh.loadMesh(facets);
+    }
+
+    /// load mesh from stl file
+    bool loadStl(MeshVolume &mesh, bp::str fPath)
+    {
+        std::string filePath = bp::extract<std::string>(fPath);
+        return mesh.loadStl(filePath);
+    }
+
+    /// export a per-depth count to python
+    bp::list to_list(const std::vector<unsigned long> &counts)
+    {
+        bp::list out;
+        for (std::size_t n = 0; n < counts.size(); ++n)
+            out.append(counts[n]);
+        return out;
+    }
+
+    bp::list nodes_per_depth(const OctreeStats &s) { return to_list(s.nodes); }
+    bp::list inside_per_depth(const OctreeStats &s) { return to_list(s.inside); }
+    bp::list outside_per_depth(const OctreeStats &s) { return to_list(s.outside); }
+    bp::list undecided_per_depth(const OctreeStats &s) { return to_list(s.undecided); }
+    bp::list invalid_per_depth(const OctreeStats &s) { return to_list(s.invalid); }
+    bp::list leaves_per_depth(const OctreeStats &s) { return to_list(s.leaves); }
+
+    /// create a Cutsim with a tiled stock covering the box (minx, miny, minz) - (maxx, maxy, maxz)
+    Cutsim *make_tiled(float minx, float miny, float minz, float maxx, float maxy, float maxz,
+                       double tile_size, unsigned int max_depth, GLData *gl, IsoSurfaceAlgorithm *iso)
+    {
+        Bbox stock;
+        stock.addPoint(GLVertex(minx, miny, minz));
+        stock.addPoint(GLVertex(maxx, maxy, maxz));
+        return new Cutsim(stock, tile_size, max_depth, gl, iso);
+    }
+
+    /// diff a python list of Volumes, see Cutsim::diff_volumes
+    void diff_volumes(Cutsim &cs, bp::list pyvolumes)
+    {
+        std::vector<const Volume *> volumes;
+        bp::ssize_t len = bp::len(pyvolumes);
+        for (bp::ssize_t i = 0; i < len; i++)
+            volumes.push_back(bp::extract<Volume *>(pyvolumes[i]));
+        cs.diff_volumes(volumes);
+    }
+
+    /// start recording a Chrome trace to the given file
+    bool trace_start(bp::str fPath)
+    {
+        std::string filePath = bp::extract<std::string>(fPath);
+        return Trace::start(filePath);
+    }
+
+} // end anonymous namespace
 
 BOOST_PYTHON_MODULE(libcutsim)
 {
     using namespace cutsim;
 
-    bp::class_<Cutsim>("Cutsim", bp::no_init)
+    bp::def("trace_start", &trace_start);
+    bp::def("trace_stop", &Trace::stop);
+
+    bp::class_<Cutsim, boost::noncopyable>("Cutsim", bp::no_init)
         .def(bp::init<double, unsigned int, GLData *, IsoSurfaceAlgorithm *>())
+        .def("__init__", bp::make_constructor(&make_tiled))
+        .def(bp::init<const Snapshot &, GLData *, IsoSurfaceAlgorithm *>())
+        .def("snapshot", &Cutsim::snapshot, bp::return_value_policy<bp::manage_new_object>())
+        .def("restore", &Cutsim::restore)
+        .def("save_checkpoint", &Cutsim::save_checkpoint)
+        .def("save_delta_checkpoint", &Cutsim::save_delta_checkpoint)
+        .def("save_checkpoint_async", &Cutsim::save_checkpoint_async)
+        .def("wait_checkpoint", &Cutsim::wait_checkpoint)
+        .def("load_checkpoint", &Cutsim::load_checkpoint)
+        .def("set_undo", &Cutsim::set_undo)
+        .def("undo", &Cutsim::undo)
+        .def("undo_count", &Cutsim::undo_count)
         .def("init", &Cutsim::init)
+        .def("init_stock", &Cutsim::init_stock)
         .def("diff_volume", &Cutsim::diff_volume)
+        .def("diff_volumes", &diff_volumes)
+        .def("set_lazy_prune", &Cutsim::set_lazy_prune)
+        .def("prune", &Cutsim::prune)
+        .def("set_dist_cache", &Cutsim::set_dist_cache)
+        .def("set_bricks", &Cutsim::set_bricks)
+        .def("set_refine_tolerance", &Cutsim::set_refine_tolerance)
+        .def("get_refine_tolerance", &Cutsim::get_refine_tolerance)
+        .def("set_paging", &Cutsim::set_paging)
+        .def("page_out", &Cutsim::page_out)
+        .def("set_packing", &Cutsim::set_packing)
+        .def("pack", &Cutsim::pack)
+        .def("set_memory_budget", &Cutsim::set_memory_budget)
+        .def("coarsen", &Cutsim::coarsen)
+        .def("coarsened_count", &Cutsim::coarsened_count)
+        .def("get_depth_limit", &Cutsim::get_depth_limit)
+        .def("set_threads", &Cutsim::set_threads)
+        .def("get_threads", &Cutsim::get_threads)
         .def("sum_volume", &Cutsim::sum_volume)
+        .def("intersect_volume", &Cutsim::intersect_volume)
         .def("updateGL", &Cutsim::updateGL)
+        .def("get_stats", &Cutsim::get_stats, bp::return_value_policy<bp::copy_const_reference>())
+        .def("get_last_stats", &Cutsim::get_last_stats, bp::return_value_policy<bp::copy_const_reference>())
+        .def("reset_stats", &Cutsim::reset_stats)
+        .def("get_tree_stats", &Cutsim::get_tree_stats)
+        .def("leaf_count", &Cutsim::leaf_count)
+        .def("tile_count", &Cutsim::tile_count)
+        .def("material_at", &Cutsim::material_at)
+        .def("get_palette", &Cutsim::get_palette, bp::return_value_policy<bp::copy_const_reference>())
         .def("__str__", &Cutsim::str);
-    bp::class_<GLData>("GLData")
-        .def("get_triangles", &GLData::get_triangles)
-        .def("get_lines", &GLData::get_lines)
-        .def("get_stl", &GLData::get_stl)
+    bp::class_<Snapshot, boost::noncopyable>("Snapshot", bp::no_init)
+        .def("tile_count", &Snapshot::tile_count)
+        .def("get_tree_stats", &Snapshot::get_tree_stats);
+    bp::class_<OpStats>("OpStats")
+        .def_readonly("calls", &OpStats::calls)
+        .def_readonly("nodes_visited", &OpStats::nodes_visited)
+        .def_readonly("dist_calls", &OpStats::dist_calls)
+        .def_readonly("subdivisions", &OpStats::subdivisions)
+        .def_readonly("prunes", &OpStats::prunes)
+        .def_readonly("classified", &OpStats::classified)
+        .def_readonly("linear", &OpStats::linear)
+        .def_readonly("vertices_added", &OpStats::vertices_added)
+        .def_readonly("vertices_removed", &OpStats::vertices_removed)
+        .def_readonly("polygons_added", &OpStats::polygons_added)
+        .def_readonly("polygons_removed", &OpStats::polygons_removed)
+        .def_readonly("seconds", &OpStats::seconds)
+        .def("__str__", &OpStats::str);
+    bp::class_<CutsimStats>("CutsimStats")
+        .def_readonly("diff", &CutsimStats::diff)
+        .def_readonly("sum", &CutsimStats::sum)
+        .def_readonly("intersect", &CutsimStats::intersect)
+        .def_readonly("update", &CutsimStats::update)
+        .def_readonly("last", &CutsimStats::last)
+        .def("__str__", &CutsimStats::str);
+    bp::class_<OctreeStats>("OctreeStats")
+        .add_property("nodes", &nodes_per_depth)
+        .add_property("inside", &inside_per_depth)
+        .add_property("outside", &outside_per_depth)
+        .add_property("undecided", &undecided_per_depth)
+        .add_property("invalid", &invalid_per_depth)
+        .add_property("leaves", &leaves_per_depth)
+        .def_readonly("node_count", &OctreeStats::node_count)
+        .def_readonly("leaf_count", &OctreeStats::leaf_count)
+        .def_readonly("brick_count", &OctreeStats::brick_count)
+        .def_readonly("paged_count", &OctreeStats::paged_count)
+        .def_readonly("packed_count", &OctreeStats::packed_count)
+        .def_readonly("node_bytes", &OctreeStats::node_bytes)
+        .def_readonly("brick_bytes", &OctreeStats::brick_bytes)
+        .def_readonly("shared_bytes", &OctreeStats::shared_bytes)
+        .def_readonly("vertexset_bytes", &OctreeStats::vertexset_bytes)
+        .def_readonly("gldata_bytes", &OctreeStats::gldata_bytes)
+        .def_readonly("distcache_bytes", &OctreeStats::distcache_bytes)
+        .def_readonly("journal_bytes", &OctreeStats::journal_bytes)
+        .def_readonly("page_bytes", &OctreeStats::page_bytes)
+        .def_readonly("packed_bytes", &OctreeStats::packed_bytes)
+        .def("total_bytes", &OctreeStats::total_bytes)
+        .def("__str__", &OctreeStats::str);
+    bp::class_<Palette>("Palette")
+        .def("color", &Palette::color, bp::return_value_policy<bp::copy_const_reference>())
+        .def("size", &Palette::size)
+        .def("__str__", &Palette::str);
+    bp::class_<Color>("Color")
+        .def_readonly("r", &Color::r)
+        .def_readonly("g", &Color::g)
+        .def_readonly("b", &Color::b);
+    bp::class_<GLData, boost::noncopyable>("GLData")
+        .def("get_triangles", &get_triangles)
+        .def("get_lines", &get_lines)
+        .def("get_stl", &get_stl)
 
         .def("__str__", &GLData::str);
     bp::class_<GLVertex>("GLVertex")
@@ -52,16 +271,26 @@ BOOST_PYTHON_MODULE(libcutsim)
         .add_property("g", &GLVertex::g)
         .add_property("b", &GLVertex::b);
     bp::class_<Volume>("Volume")
-        .def("setCenter", &Volume::setCenter);
+        .def("setCenter", &Volume::setCenter)
+        .def("setColor", &Volume::setColor);
     bp::class_<SphereVolume, bp::bases<Volume>>("SphereVolume")
         .def("setRadius", &SphereVolume::setRadius);
     bp::class_<CubeVolume, bp::bases<Volume>>("CubeVolume")
         .def("setSide", &CubeVolume::setSide);
     bp::class_<ConeVolume, bp::bases<Volume>>("ConeVolume")
         .def("setHeight", &ConeVolume::setHeight);
+    bp::class_<CylinderVolume, bp::bases<Volume>>("CylinderVolume")
+        .def("setRadius", &CylinderVolume::setRadius)
+        .def("setLength", &CylinderVolume::setLength);
+    bp::class_<BoxVolume, bp::bases<Volume>>("BoxVolume")
+        .def("setSize", &BoxVolume::setSize);
+    bp::class_<ExtrusionVolume, bp::bases<Volume>>("ExtrusionVolume")
+        .def("addPoint", &ExtrusionVolume::addPoint)
+        .def("clearProfile", &ExtrusionVolume::clearProfile)
+        .def("setLength", &ExtrusionVolume::setLength);
     bp::class_<MeshVolume, bp::bases<Volume>>("MeshVolume")
-        .def("loadMesh", &MeshVolume::loadMesh)
-        .def("loadStl", &MeshVolume::loadStl)
+        .def("loadMesh", &loadMesh)
+        .def("loadStl", &loadStl)
         .def("setMeshCenter", &MeshVolume::setMeshCenter);
     bp::class_<IsoSurfaceAlgorithm>("IsoSurfaceAlgorithm");
     bp::class_<MarchingCubes, bp::bases<IsoSurfaceAlgorithm>>("MarchingCubes");
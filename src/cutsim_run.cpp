@@ -0,0 +1,560 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// cutsim-run: headless command-line cutting simulation
+//
+// reads a toolpath, subtracts the tool at every toolpath point from the stock,
+// optionally writes the resulting surface, and prints timing and statistics.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cutsim.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    using namespace cutsim;
+
+    typedef std::chrono::steady_clock Clock;
+
+    double seconds_since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /// the file of delta checkpoint n after the checkpoint at path
+    std::string delta_path(const std::string &path, std::size_t n)
+    {
+        std::ostringstream s;
+        s << path << "." << n;
+        return s.str();
+    }
+
+    void usage()
+    {
+        std::cout
+            << "usage: cutsim-run [options] TOOLPATH\n"
+            << "\n"
+            << "TOOLPATH is a text file with one tool position per line, either as\n"
+            << "three numbers 'x y z' or as G-code words (G0/G1 X.. Y.. Z..).\n"
+            << "Text after ';', '#' or inside '( )' is ignored.\n"
+            << "\n"
+            << "options:\n"
+            << "  --size S        octree size, i.e. root node scale (default 10)\n"
+            << "  --depth N       maximum octree depth (default 8)\n"
+            << "  --tile S        cover the stock with octree tiles of size S instead of one\n"
+            << "                  octree of size --size, for long or flat stock\n"
+            << "  --threads N     cut the tiles in parallel with N threads, in batches of 64 moves\n"
+            << "  --init N        initial octree subdivisions before adding the stock (default 0,\n"
+            << "                  only the nodes along the stock surface are created)\n"
+            << "  --stock SPEC    cube:SIDE[,X,Y,Z], box:LX,LY,LZ[,X,Y,Z], cylinder:R[,X,Y,Z]\n"
+            << "                  or sphere:R[,X,Y,Z]\n"
+            << "                  (default cube:SIZE,0,0,-SIZE/2)\n"
+            << "  --tool SPEC     sphere:R, cylinder:R, cube:SIDE, cone:HEIGHT or stl:PATH\n"
+            << "                  (default sphere:1)\n"
+            << "  --update N      run updateGL() every N moves (default 0, only at the end)\n"
+            << "  --stl PATH      write the result as binary stl\n"
+            << "  --ascii-stl     write ascii instead of binary stl\n"
+            << "  --ply PATH      write the result as ascii ply\n"
+            << "  --no-mesh       do not run updateGL() at all\n"
+            << "  --checkpoint PATH  write a binary checkpoint of the stock after the toolpath\n"
+            << "  --checkpoint-every N  also write it every N moves, in the background\n"
+            << "  --delta         write the checkpoints after the first as deltas PATH.1, PATH.2, ...\n"
+            << "                  with only the nodes changed since the previous one\n"
+            << "  --resume PATH   start from a checkpoint written with the same --size, --depth,\n"
+            << "                  --tile and --stock, instead of from the stock. The deltas\n"
+            << "                  PATH.1, PATH.2, ... that follow it are applied too\n"
+            << "  --page PATH     page the parts of the stock away from the tool out to the\n"
+            << "                  files PATH.0, PATH.1, ... (one per tile) over the --page-budget\n"
+            << "  --page-budget MB  memory for the octree nodes before paging (default 256)\n"
+            << "  --pack N        pack the parts of the stock that N moves did not cut in memory\n"
+            << "  --budget MB     coarsen the stock away from the tool to keep the octree within MB.\n"
+            << "                  The mesh of the coarsened parts is coarser and has cracks\n"
+            << "  --tolerance T   do not subdivide where the distance field is linear within T,\n"
+            << "                  e.g. on flat faces (default 0, subdivide to --depth everywhere).\n"
+            << "                  The mesh then has T-junctions and cracks, it is not watertight\n"
+            << "  --trace PATH    write a Chrome trace (chrome://tracing, ui.perfetto.dev)\n"
+            << "  -h, --help      show this help\n";
+    }
+
+    /// split "kind:a,b,c" into kind and the comma-separated arguments
+    bool parse_spec(const std::string &spec, std::string &kind, std::vector<std::string> &args)
+    {
+        std::size_t colon = spec.find(':');
+        if (colon == std::string::npos)
+            return false;
+        kind = spec.substr(0, colon);
+        std::stringstream rest(spec.substr(colon + 1));
+        std::string item;
+        while (std::getline(rest, item, ','))
+            args.push_back(item);
+        return !args.empty();
+    }
+
+    /// a tool (or stock) volume together with the function that positions it
+    struct Tool
+    {
+        std::unique_ptr<Volume> volume;
+        std::function<void(float, float, float)> moveTo;
+    };
+
+    bool make_volume(const std::string &spec, Tool &tool)
+    {
+        std::string kind;
+        std::vector<std::string> args;
+        if (!parse_spec(spec, kind, args))
+            return false;
+        if (kind == "stl")
+        {
+            MeshVolume *mesh = new MeshVolume();
+            tool.volume.reset(mesh);
+            if (!mesh->loadStl(args[0]))
+                return false;
+            tool.moveTo = [mesh](float x, float y, float z) { mesh->setMeshCenter(x, y, z); };
+            return true;
+        }
+        if (kind == "box")
+        {
+            if (args.size() != 3 && args.size() != 6)
+                return false;
+            BoxVolume *b = new BoxVolume();
+            b->setSize(std::atof(args[0].c_str()), std::atof(args[1].c_str()), std::atof(args[2].c_str()));
+            tool.volume.reset(b);
+            tool.moveTo = [b](float x, float y, float z) { b->setCenter(x, y, z); };
+            if (args.size() == 6)
+                tool.moveTo(std::atof(args[3].c_str()), std::atof(args[4].c_str()), std::atof(args[5].c_str()));
+            return b->lx > 0 && b->ly > 0 && b->lz > 0;
+        }
+
+        float size = std::atof(args[0].c_str());
+        if (size <= 0)
+            return false;
+        if (kind == "sphere")
+        {
+            SphereVolume *s = new SphereVolume();
+            s->setRadius(size);
+            tool.volume.reset(s);
+        }
+        else if (kind == "cylinder")
+        {
+            CylinderVolume *c = new CylinderVolume();
+            c->setRadius(size);
+            tool.volume.reset(c);
+        }
+        else if (kind == "cube")
+        {
+            CubeVolume *c = new CubeVolume();
+            c->setSide(size);
+            tool.volume.reset(c);
+        }
+        else if (kind == "cone")
+        {
+            ConeVolume *c = new ConeVolume();
+            c->setHeight(size);
+            tool.volume.reset(c);
+        }
+        else
+            return false;
+
+        Volume *v = tool.volume.get();
+        tool.moveTo = [v](float x, float y, float z) { v->setCenter(x, y, z); };
+        if (args.size() == 4)
+            tool.moveTo(std::atof(args[1].c_str()), std::atof(args[2].c_str()), std::atof(args[3].c_str()));
+        else if (args.size() != 1)
+            return false;
+        return true;
+    }
+
+    /// read tool positions from a toolpath file
+    bool read_toolpath(const std::string &path, std::vector<GLVertex> &points)
+    {
+        std::ifstream in(path.c_str());
+        if (!in)
+            return false;
+        GLVertex pos(0, 0, 0);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            // strip comments
+            std::size_t cut = line.find_first_of(";#");
+            if (cut != std::string::npos)
+                line.erase(cut);
+            std::size_t open;
+            while ((open = line.find('(')) != std::string::npos)
+            {
+                std::size_t close = line.find(')', open);
+                line.erase(open, close == std::string::npos ? std::string::npos : close - open + 1);
+            }
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+
+            if (line.find_first_of("GgXxYyZz") != std::string::npos)
+            {
+                // G-code words, coordinates are modal
+                bool moved = false;
+                for (std::size_t n = 0; n < line.size(); ++n)
+                {
+                    char c = std::toupper(line[n]);
+                    if (c != 'X' && c != 'Y' && c != 'Z')
+                        continue;
+                    char *end;
+                    float value = std::strtof(line.c_str() + n + 1, &end);
+                    if (end == line.c_str() + n + 1)
+                        continue;
+                    if (c == 'X')
+                        pos.x = value;
+                    else if (c == 'Y')
+                        pos.y = value;
+                    else
+                        pos.z = value;
+                    moved = true;
+                }
+                if (moved)
+                    points.push_back(pos);
+            }
+            else
+            {
+                std::istringstream words(line);
+                if (!(words >> pos.x >> pos.y >> pos.z))
+                {
+                    std::cerr << "cutsim-run: cannot parse toolpath line: " << line << "\n";
+                    return false;
+                }
+                points.push_back(pos);
+            }
+        }
+        return true;
+    }
+
+} // end anonymous namespace
+
+int main(int argc, char **argv)
+{
+    double size = 10.0;
+    double tile = 0;
+    unsigned int threads = 1;
+    const std::size_t batch_size = 64;
+    unsigned int depth = 8;
+    unsigned int init = 0;
+    unsigned int update_every = 0;
+    std::string stock_spec, tool_spec = "sphere:1", stl_path, ply_path, trace_path, toolpath;
+    std::string checkpoint_path, resume_path, page_path;
+    double page_budget = 256;
+    std::size_t pack_idle = 0;
+    double memory_budget = 0;
+    double tolerance = 0;
+    std::size_t checkpoint_every = 0;
+    bool delta = false;
+    bool binary_stl = true;
+    bool mesh = true;
+
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if (arg == "-h" || arg == "--help")
+        {
+            usage();
+            return 0;
+        }
+        else if (arg == "--size" && has_value)
+            size = std::atof(argv[++n]);
+        else if (arg == "--depth" && has_value)
+            depth = std::atoi(argv[++n]);
+        else if (arg == "--tile" && has_value)
+            tile = std::atof(argv[++n]);
+        else if (arg == "--threads" && has_value)
+            threads = std::atoi(argv[++n]);
+        else if (arg == "--init" && has_value)
+            init = std::atoi(argv[++n]);
+        else if (arg == "--stock" && has_value)
+            stock_spec = argv[++n];
+        else if (arg == "--tool" && has_value)
+            tool_spec = argv[++n];
+        else if (arg == "--update" && has_value)
+            update_every = std::atoi(argv[++n]);
+        else if (arg == "--stl" && has_value)
+            stl_path = argv[++n];
+        else if (arg == "--ascii-stl")
+            binary_stl = false;
+        else if (arg == "--ply" && has_value)
+            ply_path = argv[++n];
+        else if (arg == "--no-mesh")
+            mesh = false;
+        else if (arg == "--trace" && has_value)
+            trace_path = argv[++n];
+        else if (arg == "--checkpoint" && has_value)
+            checkpoint_path = argv[++n];
+        else if (arg == "--checkpoint-every" && has_value)
+            checkpoint_every = std::atoi(argv[++n]);
+        else if (arg == "--delta")
+            delta = true;
+        else if (arg == "--resume" && has_value)
+            resume_path = argv[++n];
+        else if (arg == "--page" && has_value)
+            page_path = argv[++n];
+        else if (arg == "--page-budget" && has_value)
+            page_budget = std::atof(argv[++n]);
+        else if (arg == "--pack" && has_value)
+            pack_idle = std::atoi(argv[++n]);
+        else if (arg == "--budget" && has_value)
+            memory_budget = std::atof(argv[++n]);
+        else if (arg == "--tolerance" && has_value)
+            tolerance = std::atof(argv[++n]);
+        else if (!arg.empty() && arg[0] != '-' && toolpath.empty())
+            toolpath = arg;
+        else
+        {
+            std::cerr << "cutsim-run: bad argument " << arg << "\n";
+            usage();
+            return 1;
+        }
+    }
+    if (toolpath.empty() || size <= 0 || tile < 0 || depth < 1 || threads < 1 || page_budget <= 0 || memory_budget < 0 || tolerance < 0)
+    {
+        usage();
+        return 1;
+    }
+    if (stock_spec.empty())
+    {
+        std::ostringstream s;
+        s << "cube:" << size << ",0,0," << -size / 2;
+        stock_spec = s.str();
+    }
+
+    Tool stock, tool;
+    if (!make_volume(stock_spec, stock))
+    {
+        std::cerr << "cutsim-run: bad stock " << stock_spec << "\n";
+        return 1;
+    }
+    if (!make_volume(tool_spec, tool))
+    {
+        std::cerr << "cutsim-run: bad tool " << tool_spec << "\n";
+        return 1;
+    }
+    std::vector<GLVertex> points;
+    if (!read_toolpath(toolpath, points))
+    {
+        std::cerr << "cutsim-run: cannot read toolpath " << toolpath << "\n";
+        return 1;
+    }
+
+    if (!trace_path.empty())
+        Trace::start(trace_path);
+
+    GLData gl;
+    MarchingCubes iso;
+    std::unique_ptr<Cutsim> tiled;
+    if (tile > 0)
+    { // tiles around the stock, with a margin so that the stock surface is inside the tiles
+        Bbox bb = stock.volume->bb;
+        double margin = 2 * tile / (1 << depth);
+        bb.addPoint(GLVertex(bb.minpt.x - margin, bb.minpt.y - margin, bb.minpt.z - margin));
+        bb.addPoint(GLVertex(bb.maxpt.x + margin, bb.maxpt.y + margin, bb.maxpt.z + margin));
+        tiled.reset(new Cutsim(bb, tile, depth, &gl, &iso));
+    }
+    else
+        tiled.reset(new Cutsim(size, depth, &gl, &iso));
+    Cutsim &cs = *tiled;
+    cs.set_threads(threads);
+    if (!page_path.empty() && !cs.set_paging(page_path, (std::size_t)(page_budget * 1024 * 1024)))
+    {
+        std::cerr << "cutsim-run: cannot create page files " << page_path << ".N\n";
+        return 1;
+    }
+    cs.set_packing(pack_idle);
+    cs.set_memory_budget((std::size_t)(memory_budget * 1024 * 1024));
+    cs.set_refine_tolerance(tolerance);
+
+    // the deltas written to checkpoint_path after its full checkpoint, -1 before that is written
+    long sequence = -1;
+    std::size_t deltas = 0;
+    Clock::time_point start = Clock::now();
+    if (!resume_path.empty())
+    {
+        if (!cs.load_checkpoint(resume_path, true))
+        {
+            std::cerr << "cutsim-run: cannot resume from " << resume_path << "\n";
+            return 1;
+        }
+        // a delta of another chain, e.g. left by an earlier run, is refused and ends the chain
+        while (std::ifstream(delta_path(resume_path, deltas + 1)) &&
+               cs.load_checkpoint(delta_path(resume_path, deltas + 1), true))
+            ++deltas;
+        if (resume_path == checkpoint_path)
+            sequence = deltas; // continue the chain
+    }
+    else if (init)
+    {
+        cs.init(init);
+        cs.sum_volume(stock.volume.get());
+    }
+    else
+        cs.init_stock(stock.volume.get());
+    double stock_time = seconds_since(start);
+
+    // a full checkpoint to checkpoint_path, or with --delta the next delta after it.
+    // returns the file written, empty on error
+    auto write_checkpoint = [&](bool async) {
+        for (;;)
+        {
+            bool next_delta = delta && sequence >= 0;
+            std::string path = next_delta ? delta_path(checkpoint_path, sequence + 1) : checkpoint_path;
+            bool ok = async ? cs.save_checkpoint_async(path, next_delta)
+                            : (next_delta ? cs.save_delta_checkpoint(path) : cs.save_checkpoint(path));
+            if (ok)
+            {
+                sequence = next_delta ? sequence + 1 : 0;
+                return path;
+            }
+            if (!next_delta)
+                return std::string();
+            sequence = -1; // a failed write ended the chain, start a new one
+        }
+    };
+
+    // with threads the moves are cut in batches by diff_volumes(), each move with its own tool copy
+    std::vector<Tool> batch(threads > 1 ? batch_size : 0);
+    for (std::size_t n = 0; n < batch.size(); ++n)
+        make_volume(tool_spec, batch[n]);
+    std::vector<const Volume *> volumes;
+
+    double diff_time = 0, update_time = 0;
+    std::size_t next_checkpoint = checkpoint_every;
+    for (std::size_t n = 0; n < points.size();)
+    {
+        std::size_t end = n + 1;
+        if (batch.empty())
+        {
+            tool.moveTo(points[n].x, points[n].y, points[n].z);
+            start = Clock::now();
+            cs.diff_volume(tool.volume.get());
+            diff_time += seconds_since(start);
+        }
+        else
+        { // a batch ends at the next updateGL()
+            end = std::min(points.size(), n + batch.size());
+            if (mesh && update_every)
+                end = std::min(end, (n / update_every + 1) * update_every);
+            volumes.clear();
+            for (std::size_t m = n; m < end; ++m)
+            {
+                batch[m - n].moveTo(points[m].x, points[m].y, points[m].z);
+                volumes.push_back(batch[m - n].volume.get());
+            }
+            start = Clock::now();
+            cs.diff_volumes(volumes);
+            diff_time += seconds_since(start);
+        }
+        n = end;
+        if (mesh && update_every && (n % update_every == 0))
+        {
+            start = Clock::now();
+            cs.updateGL();
+            update_time += seconds_since(start);
+        }
+        if (!checkpoint_path.empty() && checkpoint_every && n >= next_checkpoint && n < points.size())
+        {
+            write_checkpoint(true);
+            next_checkpoint = n + checkpoint_every;
+        }
+    }
+    if (mesh)
+    {
+        start = Clock::now();
+        cs.updateGL();
+        update_time += seconds_since(start);
+    }
+
+    std::cout << "cutsim-run: " << points.size() << " moves, ";
+    if (tile > 0)
+        std::cout << cs.tile_count() << " tiles of size " << tile;
+    else
+        std::cout << "octree size " << size;
+    std::cout << " depth " << depth;
+    if (threads > 1)
+        std::cout << ", " << threads << " threads";
+    std::cout << "\n";
+    std::cout << "  " << (resume_path.empty() ? "stock     : " : "resume    : ") << stock_time << " s";
+    if (deltas)
+        std::cout << " (" << deltas << " deltas)";
+    std::cout << "\n";
+    std::cout << "  diff      : " << diff_time << " s";
+    if (diff_time > 0)
+        std::cout << " (" << points.size() / diff_time << " moves/s)";
+    std::cout << "\n";
+    std::cout << "  updateGL  : " << update_time << " s\n";
+    OctreeStats tree_stats = cs.get_tree_stats();
+    std::cout << "  nodes     : " << tree_stats.node_count << " (" << tree_stats.leaf_count << " leaves)\n";
+    std::cout << "  memory    : " << tree_stats.total_bytes() / 1024 << " kB ("
+              << (tree_stats.node_bytes + tree_stats.vertexset_bytes) / 1024 << " kB octree, "
+              << tree_stats.gldata_bytes / 1024 << " kB GLData)\n";
+    if (tree_stats.paged_count)
+        std::cout << "  paged     : " << tree_stats.paged_count << " sub-trees, "
+                  << tree_stats.page_bytes / 1024 << " kB in page files\n";
+    if (tree_stats.packed_count)
+        std::cout << "  packed    : " << tree_stats.packed_count << " sub-trees, "
+                  << tree_stats.packed_bytes / 1024 << " kB\n";
+    if (cs.coarsened_count())
+        std::cout << "  coarsened : " << cs.coarsened_count() << " regions over the --budget, subdividing to depth "
+                  << cs.get_depth_limit() << " of " << depth << "\n";
+    std::cout << "  triangles : " << gl.indexCount() / 3 << " (" << gl.vertexCount() << " vertices)\n";
+#ifdef CUTSIM_STATS
+    std::cout << cs.get_stats().str();
+#endif
+
+    if (!checkpoint_path.empty())
+    {
+        cs.wait_checkpoint();
+        start = Clock::now();
+        std::string path = write_checkpoint(false);
+        if (path.empty())
+            return 1;
+        std::cout << "  wrote " << path << " in " << seconds_since(start) << " s\n";
+    }
+    if (!stl_path.empty())
+        std::cout << "  wrote " << gl.writeStl(stl_path, binary_stl) << "\n";
+    if (!ply_path.empty())
+    {
+        if (gl.writePly(ply_path).empty())
+            return 1;
+        std::cout << "  wrote " << ply_path << "\n";
+    }
+    if (!trace_path.empty())
+    {
+        if (!Trace::stop())
+        {
+            std::cerr << "cutsim-run: cannot write trace " << trace_path << "\n";
+            return 1;
+        }
+        std::cout << "  wrote " << trace_path << "\n";
+    }
+    return 0;
+}
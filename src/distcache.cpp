@@ -0,0 +1,89 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+
+#include "distcache.hpp"
+
+namespace cutsim
+{
+
+    DistCache::DistCache() : evaluations(0), slots(4096), shift(64 - 12), used(0), op(1), x0(0), y0(0), z0(0), inv_spacing(1)
+    {
+        for (std::size_t n = 0; n < slots.size(); ++n)
+            slots[n].op = 0;
+    }
+
+    void DistCache::set_lattice(const GLVertex &root_center, double root_scale, unsigned int max_depth)
+    {
+        // leaves are at depth max_depth-1, with side 2*root_scale/2^(max_depth-1)
+        double spacing = 2 * root_scale / std::pow(2.0, (int)max_depth - 1);
+        x0 = root_center.x - root_scale;
+        y0 = root_center.y - root_scale;
+        z0 = root_center.z - root_scale;
+        inv_spacing = 1 / spacing;
+        next_op();
+    }
+
+    void DistCache::next_op()
+    {
+        if (slots.size() > 4096 && 16 * used < slots.size())
+        { // the table grew for a large operation, e.g. init_stock(). shrink it to 4x the last use
+            std::size_t size = 4096;
+            while (size < 4 * used)
+                size *= 2;
+            std::vector<Slot>(size).swap(slots);
+            shift = 64;
+            for (std::size_t n = size; n > 1; n /= 2)
+                --shift;
+            for (std::size_t n = 0; n < slots.size(); ++n)
+                slots[n].op = 0;
+        }
+        used = 0;
+        if (++op == 0)
+        { // the operation counter wrapped around, clear the stamps
+            for (std::size_t n = 0; n < slots.size(); ++n)
+                slots[n].op = 0;
+            op = 1;
+        }
+    }
+
+    void DistCache::grow()
+    {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        --shift;
+        for (std::size_t n = 0; n < slots.size(); ++n)
+            slots[n].op = 0;
+        used = 0;
+        for (std::size_t n = 0; n < old.size(); ++n)
+        {
+            if (old[n].op != op)
+                continue;
+            std::size_t i = (old[n].key * 0x9E3779B97F4A7C15ull) >> shift;
+            while (slots[i].op == op)
+                i = (i + 1) & (slots.size() - 1);
+            slots[i] = old[n];
+            ++used;
+        }
+    }
+
+} // end namespace
+
+// end file distcache.cpp
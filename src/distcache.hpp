@@ -0,0 +1,107 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glvertex.hpp"
+#include "volume.hpp"
+
+namespace cutsim
+{
+
+    /// Memo of Volume::dist() for one boolean operation, keyed on the octree lattice.
+    ///
+    /// The corners of all nodes of an Octree lie on the lattice of the leaf corners, and a
+    /// lattice point is a corner of up to eight leaves and of their ancestors. With a DistCache
+    /// each lattice point is evaluated once per operation instead of once per node.
+    /// The nodes keep their own copies of the corner values: the cache removes duplicate
+    /// evaluations, not duplicate storage. A lookup costs more than the dist() of a primitive,
+    /// so Octree uses the cache for volumes with Volume::expensive_dist() only.
+    /// The values live in an open-addressing hash table keyed on the integer lattice coordinates.
+    /// Slots are stamped with the operation number, so next_op() forgets all values without
+    /// clearing the table. A table that grew for one large operation shrinks again at next_op().
+    class DistCache
+    {
+    public:
+        DistCache();
+        /// the lattice of an Octree with the given root center, root scale and max depth
+        void set_lattice(const GLVertex &root_center, double root_scale, unsigned int max_depth);
+        /// forget all values, call at the start of each operation
+        void next_op();
+        /// Volume::dist(p) for a lattice point p, evaluated only on the first call in this operation
+        inline float dist(const Volume *vol, const GLVertex &p)
+        {
+            uint64_t key = (uint64_t)lattice(p.x, x0) | ((uint64_t)lattice(p.y, y0) << 21) | ((uint64_t)lattice(p.z, z0) << 42);
+            std::size_t i = (key * 0x9E3779B97F4A7C15ull) >> shift;
+            for (;;)
+            {
+                Slot &s = slots[i];
+                if (s.op != op)
+                { // an empty slot, p is not in the table
+                    if (2 * (used + 1) > slots.size())
+                    {
+                        grow();
+                        return dist(vol, p);
+                    }
+                    s.key = key;
+                    s.op = op;
+                    s.value = vol->dist(p);
+                    ++used;
+                    ++evaluations;
+                    return s.value;
+                }
+                if (s.key == key)
+                    return s.value;
+                i = (i + 1) & (slots.size() - 1);
+            }
+        }
+        /// memory used by the table
+        std::size_t bytes() const { return slots.capacity() * sizeof(Slot); }
+        /// number of dist() evaluations, i.e. cache misses, since construction
+        unsigned long evaluations;
+
+    private:
+        /// one table entry, 16 bytes
+        struct Slot
+        {
+            uint64_t key;  ///< packed lattice coordinates
+            uint32_t op;   ///< the operation that stored the value, the slot is empty for other operations
+            float value;   ///< the distance
+        };
+        /// integer lattice coordinate of x, for a lattice starting at origin
+        inline uint32_t lattice(float x, float origin) const { return (uint32_t)((x - origin) * inv_spacing + 0.5f) & 0x1FFFFF; }
+        /// double the table size, keeping the values of this operation
+        void grow();
+
+        std::vector<Slot> slots; ///< the table, size is a power of two
+        unsigned int shift;      ///< 64 - log2(table size), for the multiplicative hash
+        std::size_t used;        ///< slots used by this operation
+        uint32_t op;             ///< the current operation
+        float x0;                ///< lattice origin x
+        float y0;                ///< lattice origin y
+        float z0;                ///< lattice origin z
+        float inv_spacing;       ///< 1 / lattice spacing
+    };
+
+} // end namespace
+
+// end file distcache.hpp
@@ -18,15 +18,16 @@
  */
 
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <filesystem>
 #include <iostream>
 #include <sstream>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/python.hpp>
 
 #include "fileio.hpp"
+#include "trace.hpp"
 
 namespace cutsim
 {
@@ -49,12 +50,12 @@ namespace cutsim
 		return facets;
 	}
 
-	bool FileIO::loadStl(boost::python::str fPath)
+	bool FileIO::loadStl(const std::string &filePath)
 	{
+		TraceScope trace("loadStl");
 
 		// Load mesh data from binary stl file
 		std::cout << "Loading Data From STL File" << std::endl;
-		std::string filePath = boost::python::extract<std::string>(fPath);
 
 		// clear the facets
 		facets.clear();
@@ -246,64 +247,37 @@ namespace cutsim
 		return vertex;
 	}
 
-	bool FileIO::loadMesh(boost::python::list pyfacets)
+	bool FileIO::loadMesh(const std::vector<Facet> &meshFacets)
 	{
-		// Load mesh data from python facets
-		// expected input
-		// [[(normal),(v1), (v2), (v3)],...]
+		// Load mesh data from (normal, v1, v2, v3) facets
 		// TODO: check the face data structure is valid
 
 		// clear the facets
 		facets.clear();
 
-		boost::python::ssize_t len = boost::python::len(pyfacets);
-
-		if (!len)
+		if (meshFacets.empty())
 		{
 			std::cout << "Mesh data invalid" << std::endl;
 			return false;
 		}
 
-		std::cout << " Load Mesh Shape from " << len << " Facets" << std::endl;
-
-		GLVertex vertexData[4] = {};
-
-		for (int i = 0; i < len; i++)
-		{
-			boost::python::ssize_t dataLen = boost::python::len(pyfacets[i]);
-			if (dataLen == 4)
-			{
-				// std::cout << " Loading Data from facet:" << i << std::endl;
-				for (int j = 0; j < dataLen; j++)
-				{
-
-					float f0 = boost::python::extract<float>(pyfacets[i][j][0]);
-					float f1 = boost::python::extract<float>(pyfacets[i][j][1]);
-					float f2 = boost::python::extract<float>(pyfacets[i][j][2]);
-
-					// std::cout << "Facet " << i << " vertex " << j << " x " << f0 << " y " << f1 << " z " << f2 << std::endl;
-
-					vertexData[j].x = f0;
-					vertexData[j].y = f1;
-					vertexData[j].z = f2;
-				}
+		std::cout << " Load Mesh Shape from " << meshFacets.size() << " Facets" << std::endl;
 
-				facets.push_back(new Facet(vertexData[0], vertexData[1], vertexData[2], vertexData[3]));
-			}
-		}
+		for (const Facet &f : meshFacets)
+			facets.push_back(new Facet(f));
 
 		// file loaded successfully, return true
 		return true;
 	}
 
-	/// export stl file and return the path to python
-	std::string FileIO::writeStl(std::vector<unsigned int> indexArray, std::vector<GLVertex> vertexArray, boost::python::str fPath, bool binary)
+	/// export stl file and return the path written
+	std::string FileIO::writeStl(const std::vector<unsigned int> &indexArray, const std::vector<GLVertex> &vertexArray, const std::string &fPath, bool binary)
 	{
+		TraceScope trace("writeStl");
 
-		boost::python::str out;
 		std::ofstream stlFile;
 
-		std::string filePath = boost::python::extract<std::string>(fPath);
+		std::string filePath = fPath;
 
 		/// make sure the last charater isn't a seperator
 		std::string lastchar = filePath.substr(filePath.length() - 1);
@@ -313,7 +287,7 @@ namespace cutsim
 		}
 
 		/// check for a .stl file extension
-		std::string ext = filePath.substr(filePath.length() - 4);
+		std::string ext = filePath.substr(filePath.length() < 4 ? 0 : filePath.length() - 4);
 		boost::algorithm::to_lower(ext);
 
 		if (ext != ".stl")
@@ -323,11 +297,11 @@ namespace cutsim
 
 		/// split the filename from the path name and check the path exists
 		std::size_t pos = filePath.find_last_of("/\\");
-		std::string path = filePath.substr(0, pos);
-
-		if (!std::filesystem::exists(path))
+		if (pos != std::string::npos)
 		{
-			std::filesystem::create_directory(path);
+			std::string path = filePath.substr(0, pos);
+			if (!path.empty() && !std::filesystem::exists(path))
+				std::filesystem::create_directory(path);
 		}
 
 		if (binary)
@@ -351,9 +325,9 @@ namespace cutsim
 		for (unsigned int n = 0; n < indexArray.size(); n += 3)
 		{
 
-			GLVertex p1 = vertexArray[n];
-			GLVertex p2 = vertexArray[n + 1];
-			GLVertex p3 = vertexArray[n + 2];
+			const GLVertex &p1 = vertexArray[indexArray[n]];
+			const GLVertex &p2 = vertexArray[indexArray[n + 1]];
+			const GLVertex &p3 = vertexArray[indexArray[n + 2]];
 
 			if (binary)
 			{
@@ -399,7 +373,47 @@ namespace cutsim
 		}
 
 		stlFile.close();
-		//return boost::python::str(filePath);
+		return filePath;
+	}
+
+	/// export an ascii ply file with shared vertices and return the path written
+	std::string FileIO::writePly(const std::vector<unsigned int> &indexArray, const std::vector<GLVertex> &vertexArray, const std::string &filePath)
+	{
+		TraceScope trace("writePly");
+		std::ofstream plyFile(filePath.c_str());
+		if (!plyFile)
+		{
+			std::cout << "Error opening ply file" << std::endl;
+			return std::string();
+		}
+
+		plyFile << "ply" << std::endl;
+		plyFile << "format ascii 1.0" << std::endl;
+		plyFile << "comment libcutsim" << std::endl;
+		plyFile << "element vertex " << vertexArray.size() << std::endl;
+		plyFile << "property float x" << std::endl;
+		plyFile << "property float y" << std::endl;
+		plyFile << "property float z" << std::endl;
+		plyFile << "property float nx" << std::endl;
+		plyFile << "property float ny" << std::endl;
+		plyFile << "property float nz" << std::endl;
+		plyFile << "property uchar red" << std::endl;
+		plyFile << "property uchar green" << std::endl;
+		plyFile << "property uchar blue" << std::endl;
+		plyFile << "element face " << indexArray.size() / 3 << std::endl;
+		plyFile << "property list uchar uint vertex_indices" << std::endl;
+		plyFile << "end_header" << std::endl;
+
+		for (const GLVertex &v : vertexArray)
+		{
+			plyFile << v.x << " " << v.y << " " << v.z << " "
+					<< v.nx << " " << v.ny << " " << v.nz << " "
+					<< (int)(255 * v.r) << " " << (int)(255 * v.g) << " " << (int)(255 * v.b) << std::endl;
+		}
+		for (unsigned int n = 0; n + 2 < indexArray.size(); n += 3)
+			plyFile << "3 " << indexArray[n] << " " << indexArray[n + 1] << " " << indexArray[n + 2] << std::endl;
+
+		plyFile.close();
 		return filePath;
 	}
 
@@ -20,6 +20,7 @@
 #ifndef FILEIO_H
 #define FILEIO_H
 
+#include <string>
 #include <vector>
 
 #include "facet.hpp"
@@ -34,10 +35,15 @@ class FileIO {
    public:
     FileIO();
     ~FileIO();
-    bool loadStl(boost::python::str);
-    bool loadMesh(boost::python::list);
+    /// load facets from an ascii or binary stl file
+    bool loadStl(const std::string &filePath);
+    /// load facets from an in-memory list of (normal, v1, v2, v3) facets
+    bool loadMesh(const std::vector<Facet> &meshFacets);
     std::vector<Facet*> getFacets();
-    std::string writeStl(std::vector<unsigned int> indexArray, std::vector<GLVertex> vertexArray, boost::python::str fPath, bool binary);
+    /// write the given triangles to an stl file and return the path written
+    std::string writeStl(const std::vector<unsigned int> &indexArray, const std::vector<GLVertex> &vertexArray, const std::string &fPath, bool binary);
+    /// write the given triangles to an ascii ply file and return the path written
+    std::string writePly(const std::vector<unsigned int> &indexArray, const std::vector<GLVertex> &vertexArray, const std::string &filePath);
 
    private:
     GLVertex parseStlData(std::ifstream&);
@@ -19,6 +19,7 @@
 
 #include <cassert>
 #include <set>
+#include <sstream>
 #include <vector>
 
 #include "gldata.hpp"
@@ -44,6 +45,7 @@ unsigned int GLData::addVertex(GLVertex v, Octnode* n) {
     vertexDataArray.push_back( VertexData() );
     vertexDataArray[idx].node = n;
     assert( vertexArray.size() == vertexDataArray.size() );
+    CUTSIM_STAT( ++stats.vertices_added );
     return idx; // return index of newly appended vertex
 }
 
@@ -95,6 +97,7 @@ void GLData::removeVertex( unsigned int vertexIdx ) {
     vertexArray.resize( vertexArray.size()-1 );
     vertexDataArray.resize( vertexDataArray.size()-1 );
     assert( vertexArray.size() == vertexDataArray.size() );
+    CUTSIM_STAT( ++stats.vertices_removed );
 }
 
 /// add a polygon, return its index
@@ -105,6 +108,7 @@ int GLData::addPolygon( std::vector<unsigned int>& verts) {
         indexArray.push_back(vertex);
         vertexDataArray[vertex].addPolygon(polygonIdx); // add index to vertex i1
     }
+    CUTSIM_STAT( ++stats.polygons_added );
     return polygonIdx;
 }
 
@@ -127,6 +131,7 @@ void GLData::removePolygon( unsigned int polygonIdx) {
         }
     }
     indexArray.resize( indexArray.size()-polygonVertices() ); // shorten array
+    CUTSIM_STAT( ++stats.polygons_removed );
 } 
 
 /// string output
@@ -138,13 +143,28 @@ std::string GLData::str() {
     return s;
 }
 
+/// memory used by the vertex, vertex-data and index arrays, including the polygon sets
+std::size_t GLData::bytes() const {
+    const std::size_t set_node_bytes = 4 * sizeof(void *) + sizeof(unsigned int);
+    std::size_t b = vertexArray.capacity() * sizeof(GLVertex)
+                  + vertexDataArray.capacity() * sizeof(VertexData)
+                  + indexArray.capacity() * sizeof(unsigned int);
+    BOOST_FOREACH( const VertexData& v, vertexDataArray ) {
+        b += v.polygons.size() * set_node_bytes;
+    }
+    return b;
+}
 
-/// export stl file and return the path to python
-boost::python::str GLData::get_stl(boost::python::str fPath, bool binary = true) {
+/// export stl file and return the path written
+std::string GLData::writeStl(const std::string &filePath, bool binary) const {
     FileIO stl;
-	std::string filePath;
-    filePath = stl.writeStl(indexArray, vertexArray, fPath, binary);
-	return boost::python::str(filePath);
+    return stl.writeStl(indexArray, vertexArray, filePath, binary);
+}
+
+/// export ply file and return the path written
+std::string GLData::writePly(const std::string &filePath) const {
+    FileIO ply;
+    return ply.writePly(indexArray, vertexArray, filePath);
 }
 
 } // end cutsim namespace
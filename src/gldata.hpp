@@ -20,16 +20,16 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
 #include <set>
 #include <cmath>
+#include <string>
 #include <vector>
 
 #include <boost/foreach.hpp>
-#include <boost/python.hpp>
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/case_conv.hpp>
 
 #include "glvertex.hpp"
+#include "stats.hpp"
 
 namespace cutsim
 {
@@ -116,46 +116,17 @@ namespace cutsim
         void setNormal(unsigned int vertexIdx, float nx, float ny, float nz);
         void modifyVertex(unsigned int id, float x, float y, float z, float r, float g, float b, float nx, float ny, float nz);
         void removeVertex(unsigned int vertexIdx);
+        /// set the Octnode that created vertex id, when the node was copied to a new address
+        void setNode(unsigned int vertexIdx, Octnode *n) { vertexDataArray[vertexIdx].node = n; }
         int addPolygon(std::vector<unsigned int> &verts);
         void removePolygon(unsigned int polygonIdx);
         std::string str();
-        boost::python::str get_stl(boost::python::str, bool);
-
-        /// export triangle-list to python
-        boost::python::list get_triangles()
-        {
-            boost::python::list out;
-            for (unsigned int n = 0; n < indexArray.size(); n += 3)
-            {
-                GLVertex p1 = vertexArray[n];
-                GLVertex p2 = vertexArray[n + 1];
-                GLVertex p3 = vertexArray[n + 2];
-                boost::python::list tri;
-                tri.append(p1);
-                tri.append(p2);
-                tri.append(p3);
-                out.append(tri);
-            }
-            return out;
-        }
-
-        /// export line-list to python
-        boost::python::list get_lines()
-        {
-            boost::python::list out;
-            for (unsigned int n = 0; n < indexArray.size(); n += 2)
-            {
-                GLVertex p1 = vertexArray[n];
-                GLVertex p2 = vertexArray[n + 1];
-                //GLVertex p3 = vertexArray[n+2];
-                boost::python::list tri;
-                tri.append(p1);
-                tri.append(p2);
-                //tri.append(p3);
-                out.append(tri);
-            }
-            return out;
-        }
+        /// memory used by the vertex, vertex-data and index arrays
+        std::size_t bytes() const;
+        /// write the triangles to an stl file, return the path written
+        std::string writeStl(const std::string &filePath, bool binary = true) const;
+        /// write the triangles to a ply file, return the path written
+        std::string writePly(const std::string &filePath) const;
 
         // type of GLData
         void setTriangles()
@@ -187,6 +158,14 @@ namespace cutsim
         inline const int polygonVertices() const { return polyVerts; }
         /// length of indexArray
         inline const int indexCount() const { return indexArray.size(); }
+        /// length of vertexArray
+        inline const int vertexCount() const { return vertexArray.size(); }
+
+        /// running totals of vertices and polygons added and removed
+        OpStats stats;
+        /// held while an Octnode removes its vertices. Tiles of a Cutsim that are cut in parallel
+        /// share the GLData, and removeVertex() renumbers vertices of nodes in any tile.
+        std::mutex mutex;
 
     protected:
         std::vector<GLVertex> vertexArray;       ///< vertex coordinates
@@ -25,29 +25,42 @@
 #include "gldata.hpp"
 #include "octree.hpp"
 #include "octnode.hpp"
+#include "palette.hpp"
 
 namespace cutsim
 {
 
     /// abstract base class for isosurface extraction algorithms
     ///
-    /// isosurface algorithms produce vertices and polygons based on an Octree.
+    /// isosurface algorithms produce vertices and polygons based on one or more Octrees,
+    /// e.g. the tiles of a Cutsim stock.
     /// Vertices and polygons are added to a GLData using addVertex, addPolygon, etc.
     ///
     class IsoSurfaceAlgorithm
     {
     public:
         /// create algorithm wich writes to given GLData and reads from given Octree
-        IsoSurfaceAlgorithm() {}
+        IsoSurfaceAlgorithm() : g(NULL), palette(NULL) {}
         virtual ~IsoSurfaceAlgorithm() {}
         void set_gl(GLData *gl) { g = gl; }
-        void set_tree(Octree *tr) { tree = tr; }
+        /// read from the given Octree only
+        void set_tree(Octree *tr) { trees.assign(1, tr); }
+        /// read also from the given Octree
+        void add_tree(Octree *tr) { trees.push_back(tr); }
+        /// colors of the node material indices
+        void set_palette(const Palette *p) { palette = p; }
         virtual void set_polyVerts() {} ///< set vertices per polygon (2, 3, or 4)
         /// update GLData
-        virtual void updateGL() { updateGL(tree->root); }
+        virtual void updateGL()
+        {
+            for (std::size_t n = 0; n < trees.size(); ++n)
+                updateGL(trees[n]->root);
+        }
+        /// running totals of the nodes visited by updateGL
+        OpStats stats;
 
     protected:
-        /// update the GLData for the given Octnode. re-implement in sub-class
+        /// update the GLData for the sub-tree at the given Octnode. re-implement in sub-class
         virtual void updateGL(Octnode *node) {}
 
         // DATA
@@ -55,7 +68,8 @@ namespace cutsim
         int valid_count;  ///< how many valid nodes? for debug
 
         GLData *g;    ///< the GLData to which we udpate vertices/polygons
-        Octree *tree; ///< the Octree which we traverse to update GLData
+        std::vector<Octree *> trees; ///< the Octrees which we traverse to update GLData
+        const Palette *palette;      ///< the colors of the node materials
     };
 
 } // end namespace
@@ -0,0 +1,184 @@
+/*
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "journal.hpp"
+#include "octnode.hpp"
+#include "traversal.hpp"
+
+namespace cutsim
+{
+
+    Journal::Journal(std::size_t d, GLData *gl) : depth(d), brick_copies(0), g(gl) {}
+
+    Journal::~Journal()
+    {
+        clear();
+    }
+
+    namespace
+    {
+        /// stamps all nodes of a sub-tree as changed
+        struct StampVisitor
+        {
+            unsigned int epoch;
+            bool pre(Octnode *current)
+            {
+                current->set_epoch(epoch);
+                return true;
+            }
+            void post(Octnode *) {}
+        };
+    } // end anonymous namespace
+
+    void Journal::next_op(unsigned long epoch)
+    {
+        ops.push_back(Op{0, 0, epoch});
+        while (ops.size() > depth)
+            pop_oldest();
+    }
+
+    void Journal::record(const Octnode *node)
+    {
+        if (ops.empty())
+            return; // nothing to undo
+        Entry e;
+        e.node = const_cast<Octnode *>(node);
+        e.brick_leaf = node->brick_leaf;
+        if (node->brick_leaf)
+        { // the operation changes the samples in place
+            e.brick = new Brick(*node->brick);
+            ++brick_copies;
+        }
+        else
+            e.children = node->children;
+        std::copy(node->fq, node->fq + 8, e.fq);
+        e.mat = node->mat;
+        e.node_state = node->node_state;
+        e.prev_node_state = node->prev_node_state;
+        e.touched = node->touched;
+        entries.push_back(e);
+        ++ops.back().entries;
+    }
+
+    void Journal::keep(const Octnode *node)
+    {
+        if (ops.empty() || node->brick_leaf || !node->children)
+            return;
+        Octnode::hold_block(node->children);
+        kept.push_back(node->children);
+        ++ops.back().kept;
+    }
+
+    bool Journal::undo(unsigned long epoch)
+    {
+        if (ops.empty())
+            return false;
+        Op op = ops.back();
+        ops.pop_back();
+        // blocks put back from before the last checkpoint may differ from what it wrote
+        bool crossed = op.epoch != epoch;
+        for (std::size_t n = 0; n < op.entries; ++n)
+        {
+            revert(entries.back(), epoch & 255, crossed);
+            entries.pop_back();
+        }
+        // the blocks put back in place have a reference from their node now
+        for (std::size_t n = 0; n < op.kept; ++n)
+        {
+            Octnode::drop_block(kept.back());
+            kept.pop_back();
+        }
+        return true;
+    }
+
+    void Journal::revert(Entry &e, unsigned int epoch, bool subtree)
+    {
+        Octnode *node = e.node;
+        bool replaced = true;
+        if (e.brick_leaf)
+        {
+            node->delete_brick();
+            node->release_children(g, true);
+            node->brick = e.brick;
+            node->brick_leaf = true;
+            --brick_copies;
+        }
+        else
+        {
+            replaced = node->brick_leaf || node->children != e.children;
+            node->delete_brick(); // made by the operation
+            if (node->children != e.children)
+            { // the operation released the children, or replaced them with new ones or a copy
+                node->release_children(g, true);
+                node->children = e.children;
+                if (node->children) // stale mesh state, see Octnode::unshare_children()
+                    Octnode::hold_block(node->children);
+            }
+        }
+        std::copy(e.fq, e.fq + 8, node->fq);
+        node->mat = e.mat;
+        node->node_state = e.node_state;
+        node->prev_node_state = e.prev_node_state;
+        node->touched = e.touched;
+        // a node with the same children is meshed by them, the reverted ones invalidate it
+        if (replaced || node->isLeaf())
+            node->setInvalid();
+        node->set_epoch(epoch); // the ancestors are reverted too, see Octree
+        if (replaced && subtree && !node->isLeaf())
+        {
+            StampVisitor visitor = {epoch};
+            traverse(node, visitor);
+        }
+    }
+
+    void Journal::pop_oldest()
+    {
+        Op op = ops.front();
+        ops.pop_front();
+        for (std::size_t n = 0; n < op.entries; ++n)
+        {
+            if (entries.front().brick_leaf)
+            {
+                delete entries.front().brick;
+                --brick_copies;
+            }
+            entries.pop_front();
+        }
+        for (std::size_t n = 0; n < op.kept; ++n)
+        {
+            Octnode::drop_block(kept.front());
+            kept.pop_front();
+        }
+    }
+
+    void Journal::clear()
+    {
+        while (!ops.empty())
+            pop_oldest();
+    }
+
+    std::size_t Journal::bytes() const
+    {
+        return entries.size() * sizeof(Entry) + brick_copies * sizeof(Brick) + kept.size() * Octnode::block_bytes();
+    }
+
+} // end namespace
+// end of file journal.cpp
@@ -0,0 +1,105 @@
+/*
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+namespace cutsim
+{
+
+    class Octnode;
+    class GLData;
+    struct Brick;
+
+    /// The changes that the boolean operations made to an Octree, so that the most recent
+    /// operations can be undone, see Octree::set_undo().
+    ///
+    /// Before an operation changes a node, the Octree records it: the distance field, material
+    /// and state, and the children block or a copy of the Brick. A children block that the
+    /// operation releases, or copies because it is shared, is kept alive by the Journal instead
+    /// of deleted, so the nodes recorded in it stay valid. undo() writes the records back in
+    /// reverse order and puts the kept blocks back in place, so it takes time in proportion
+    /// to the nodes that the operation changed, not to the size of the tree.
+    /// The reverted nodes are stamped as changed for delta checkpoints, see Octree::save_delta(),
+    /// and so are the sub-trees of the kept blocks, if a checkpoint was taken since the operation.
+    class Journal
+    {
+    public:
+        /// a journal of the last depth operations on a tree drawn to g
+        Journal(std::size_t depth, GLData *g);
+        ~Journal();
+        /// start the record of a new operation, forgetting the oldest operation beyond depth
+        void next_op(unsigned long epoch);
+        /// record node before the current operation changes it.
+        /// A node recorded more than once in an operation is reverted to its first record.
+        void record(const Octnode *node);
+        /// keep the children block of node alive, call before it is released or copied
+        void keep(const Octnode *node);
+        /// revert the most recent operation, false if there is none.
+        /// The reverted nodes are invalid and need meshing, and are stamped with epoch.
+        bool undo(unsigned long epoch);
+        /// forget all operations
+        void clear();
+        /// number of operations that can be undone
+        std::size_t steps() const { return ops.size(); }
+        /// memory used by the records and the Brick copies. The kept blocks count with one block each.
+        std::size_t bytes() const;
+
+    private:
+        /// a node as it was before the operation changed it
+        struct Entry
+        {
+            Octnode *node;
+            union
+            {
+                Octnode *children; ///< the children block, kept alive if the operation released it
+                Brick *brick;      ///< a copy of the Brick, owned by the Journal
+            };
+            int16_t fq[8];
+            uint8_t mat;
+            unsigned int node_state : 2;
+            unsigned int prev_node_state : 2;
+            unsigned int touched : 1;
+            unsigned int brick_leaf : 1;
+        };
+        /// the number of entries and kept blocks of one operation
+        struct Op
+        {
+            std::size_t entries;
+            std::size_t kept;
+            unsigned long epoch; ///< the epoch of the tree at the operation
+        };
+        /// write entry e back to its node, stamping it with epoch, and the children put back if subtree
+        void revert(Entry &e, unsigned int epoch, bool subtree);
+        /// forget the oldest operation
+        void pop_oldest();
+
+        std::deque<Entry> entries;  ///< records of all operations, oldest first
+        std::deque<Octnode *> kept; ///< blocks kept alive, oldest first
+        std::deque<Op> ops;         ///< the operations, oldest first
+        std::size_t depth;          ///< maximum number of operations
+        std::size_t brick_copies;   ///< number of Bricks copied into the entries
+        GLData *g;                  ///< the GLData of the tree
+    };
+
+} // end namespace
+
+// end file journal.hpp
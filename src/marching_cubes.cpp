@@ -18,55 +18,129 @@
  */
 
 #include "marching_cubes.hpp"
+#include "traversal.hpp"
 
 namespace cutsim
 {
 
-    // this could maybe moved to the base-class, if all sub-classes do it the same way?
+    namespace
+    {
+        /// visits the invalid nodes and updates their triangles
+        struct UpdateVisitor
+        {
+            MarchingCubes &mc;
+            bool pre(Octnode *node) { return mc.update_node(node); }
+            void post(Octnode *) {}
+        };
+    } // end anonymous namespace
+
     void MarchingCubes::updateGL(Octnode *node)
     {
-        // traverse tree here and call polygonize_node
+        UpdateVisitor visitor = {*this};
+        traverse(node, visitor);
+    }
+
+    bool MarchingCubes::update_node(Octnode *node)
+    {
+        CUTSIM_STAT(++stats.nodes_visited);
         if (node->valid())
-            return; // don't process valid nodes
+            return false; // don't process valid nodes
+        if (!node->page_in(g))
+            return false; // the sub-tree of an invalid paged node needs meshing, see Octree::page_out()
 
         if (node->is_undecided() && node->isLeaf())
         {
             assert(!node->valid());
-            node->clearVertexSet();
-            mc_node(node); // create triangles for undecided leaf-node
+            node->clearVertexSet(g);
+            if (node->hasBrick())
+                mc_brick(node); // create triangles for each cell of the brick
+            else
+                mc_node(node); // create triangles for undecided leaf-node
+            node->setValid();
+        }
+        else if (node->isLeaf())
+        { // inside or outside leaf, contributes no triangles
+            node->clearVertexSet(g);
             node->setValid();
         }
 
-        // current node done, now recurse into tree.
-        if (node->childcount == 8)
+        // current node done, now descend into the invalid children
+        if (!node->isLeaf())
         {
+            if (!node->children_owned(g))
+                node->unshare_children(g); // meshed for another GLData, or never meshed, see Octree::fork()
             for (unsigned int m = 0; m < 8; m++)
             {
-                if (!node->child[m]->valid())
+                if (!node->child(m)->valid())
                 {
-                    node->clearVertexSet();   // remove old vertices
-                    updateGL(node->child[m]); // create new ones
+                    node->unshare_children(g);
+                    node->clearVertexSet(g); // remove old vertices
+                    return true;
                 }
             }
         }
+        return false;
     }
 
     /// run mc on one Octnode
     /// this generates one or more triangles which are pushed to the GLData
     void MarchingCubes::mc_node(Octnode *node)
     {
-        assert(node->childcount == 0); // don't call this on non-leafs!
+        assert(node->isLeaf()); // don't call this on non-leafs!
         assert(node->is_undecided());  // must be undecided, completelu inside/outside nodes don't contribute to the surface
-        unsigned int edgeTableIndex = mc_edgeTableIndex(node);
+        Cell cell;
+        for (int n = 0; n < 8; ++n)
+        {
+            cell.vertex[n] = node->vertex(n);
+            cell.f[n] = node->f(n);
+        }
+        mc_cell(cell, palette->color(node->material()), node);
+    }
+
+    /// run mc on each cell of the brick of an Octnode
+    void MarchingCubes::mc_brick(Octnode *node)
+    {
+        const Brick *brick = node->getBrick();
+        for (int k = 0; k < Brick::cells; ++k)
+            for (int j = 0; j < Brick::cells; ++j)
+                for (int i = 0; i < Brick::cells; ++i)
+                {
+                    // the sample of each cell corner, in the corner order of Octnode::direction
+                    int corner[8];
+                    bool inside = false, outside = false;
+                    for (int n = 0; n < 8; ++n)
+                    {
+                        corner[n] = Brick::sample(i + Brick::corner[n][0], j + Brick::corner[n][1], k + Brick::corner[n][2]);
+                        if (brick->f[corner[n]] < 0)
+                            outside = true;
+                        else
+                            inside = true;
+                    }
+                    if (!(inside && outside))
+                        continue; // the surface does not cross this cell
+                    Cell cell;
+                    for (int n = 0; n < 8; ++n)
+                    {
+                        cell.vertex[n] = node->brick_vertex(i + Brick::corner[n][0], j + Brick::corner[n][1], k + Brick::corner[n][2]);
+                        cell.f[n] = node->brick_f(corner[n]);
+                    }
+                    mc_cell(cell, palette->color(brick->mat[Brick::cell(i, j, k)]), node);
+                }
+    }
+
+    /// the triangles of one cube, owned by the given node
+    void MarchingCubes::mc_cell(const Cell &cell, const Color &color, Octnode *node)
+    {
+        unsigned int edgeTableIndex = mc_edgeTableIndex(cell);
         unsigned int edges = edgeTable[edgeTableIndex];
-        std::vector<GLVertex> vertices = interpolated_vertices(node, edges);
+        std::vector<GLVertex> vertices = interpolated_vertices(cell, edges);
         for (unsigned int i = 0; triTable[edgeTableIndex][i] != -1; i += 3)
         {
             std::vector<unsigned int> triangle;
             GLVertex p1 = vertices[triTable[edgeTableIndex][i]];
             GLVertex p2 = vertices[triTable[edgeTableIndex][i + 1]];
             GLVertex p3 = vertices[triTable[edgeTableIndex][i + 2]];
-            GLVertex::set_normal_and_color(p1, p2, p3, node->color);
+            GLVertex::set_normal_and_color(p1, p2, p3, color);
             triangle.push_back(g->addVertex(p1, node));
             triangle.push_back(g->addVertex(p2, node));
             triangle.push_back(g->addVertex(p3, node));
@@ -77,79 +151,61 @@ namespace cutsim
         }
     }
 
-    std::vector<GLVertex> MarchingCubes::interpolated_vertices(const Octnode *node, unsigned int edges)
+    std::vector<GLVertex> MarchingCubes::interpolated_vertices(const Cell &cell, unsigned int edges)
     {
         std::vector<GLVertex> vertices(12);
-        vertices[0] = *(node->vertex[0]); // intialize these to the node-vertex positions (?why?)
-        vertices[1] = *(node->vertex[1]);
-        vertices[2] = *(node->vertex[2]);
-        vertices[3] = *(node->vertex[3]);
-        vertices[4] = *(node->vertex[4]);
-        vertices[5] = *(node->vertex[5]);
-        vertices[6] = *(node->vertex[6]);
-        vertices[7] = *(node->vertex[7]);
+        for (int n = 0; n < 8; ++n) // intialize these to the node-vertex positions (?why?)
+            vertices[n] = cell.vertex[n];
         if (edges & 1)
-            vertices[0] = interpolate(node, 0, 1);
+            vertices[0] = interpolate(cell, 0, 1);
         if (edges & 2)
-            vertices[1] = interpolate(node, 1, 2);
+            vertices[1] = interpolate(cell, 1, 2);
         if (edges & 4)
-            vertices[2] = interpolate(node, 2, 3);
+            vertices[2] = interpolate(cell, 2, 3);
         if (edges & 8)
-            vertices[3] = interpolate(node, 3, 0);
+            vertices[3] = interpolate(cell, 3, 0);
         if (edges & 16)
-            vertices[4] = interpolate(node, 4, 5);
+            vertices[4] = interpolate(cell, 4, 5);
         if (edges & 32)
-            vertices[5] = interpolate(node, 5, 6);
+            vertices[5] = interpolate(cell, 5, 6);
         if (edges & 64)
-            vertices[6] = interpolate(node, 6, 7);
+            vertices[6] = interpolate(cell, 6, 7);
         if (edges & 128)
-            vertices[7] = interpolate(node, 7, 4);
+            vertices[7] = interpolate(cell, 7, 4);
         if (edges & 256)
-            vertices[8] = interpolate(node, 0, 4);
+            vertices[8] = interpolate(cell, 0, 4);
         if (edges & 512)
-            vertices[9] = interpolate(node, 1, 5);
+            vertices[9] = interpolate(cell, 1, 5);
         if (edges & 1024)
-            vertices[10] = interpolate(node, 2, 6);
+            vertices[10] = interpolate(cell, 2, 6);
         if (edges & 2048)
-            vertices[11] = interpolate(node, 3, 7);
+            vertices[11] = interpolate(cell, 3, 7);
         return vertices;
     }
 
     /// use linear interpolation of the distance-field between vertices idx1 and idx2
     /// to generate a new iso-surface vertex on the idx1-idx2 edge
-    GLVertex MarchingCubes::interpolate(const Octnode *node, int idx1, int idx2)
+    GLVertex MarchingCubes::interpolate(const Cell &cell, int idx1, int idx2)
     {
         // p = p1 - f1 (p2-p1)/(f2-f1)
-        if (!(fabs(node->f[idx2] - node->f[idx1]) > 1e-16))
-            std::cout << "mc::interpolate error " << node->f[idx2] << " and " << node->f[idx1] << " don't differ in sign!\n";
+        float f1 = cell.f[idx1], f2 = cell.f[idx2];
+        if (!(fabs(f2 - f1) > 1e-16))
+            std::cout << "mc::interpolate error " << f2 << " and " << f1 << " don't differ in sign!\n";
 
-        //assert( ( (node->f[idx2] * node->f[idx1] )  < 0 ) ); // should have unequal sign!
-        assert(fabs(node->f[idx2] - node->f[idx1]) > 1e-16);
-        return *(node->vertex[idx1]) - (*(node->vertex[idx2]) - (*(node->vertex[idx1]))) *
-                                           (1.0 / (node->f[idx2] - node->f[idx1])) * node->f[idx1];
+        //assert( ( (f2 * f1 )  < 0 ) ); // should have unequal sign!
+        assert(fabs(f2 - f1) > 1e-16);
+        GLVertex v1 = cell.vertex[idx1];
+        return v1 - (cell.vertex[idx2] - v1) * (1.0 / (f2 - f1)) * f1;
     }
 
-    // based on the funcion values (positive or negative) at the corners of the node,
+    // based on the funcion values (positive or negative) at the corners of the cube,
     // calculate the edgeTableIndex
-    unsigned int MarchingCubes::mc_edgeTableIndex(const Octnode *node)
+    unsigned int MarchingCubes::mc_edgeTableIndex(const Cell &cell)
     {
         unsigned int edgeTableIndex = 0;
-        if (node->f[0] < 0.0)
-            edgeTableIndex |= 1;
-        if (node->f[1] < 0.0)
-            edgeTableIndex |= 2;
-        if (node->f[2] < 0.0)
-            edgeTableIndex |= 4;
-        if (node->f[3] < 0.0)
-            edgeTableIndex |= 8;
-        if (node->f[4] < 0.0)
-            edgeTableIndex |= 16;
-        if (node->f[5] < 0.0)
-            edgeTableIndex |= 32;
-        if (node->f[6] < 0.0)
-            edgeTableIndex |= 64;
-        if (node->f[7] < 0.0)
-            edgeTableIndex |= 128;
+        for (int n = 0; n < 8; ++n)
+            if (cell.f[n] < 0.0)
+                edgeTableIndex |= (1 << n);
         return edgeTableIndex;
     }
 
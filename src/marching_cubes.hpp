@@ -42,19 +42,31 @@ namespace cutsim
         MarchingCubes() : IsoSurfaceAlgorithm() {}
         virtual void set_polyVerts(unsigned int) { g->setTriangles(); }
         virtual ~MarchingCubes() {}
+        /// update the triangles of one node, return true if its children need updating
+        bool update_node(Octnode *node);
 
     protected:
         void updateGL(Octnode *node);
+        /// corner positions and distances of one cube, a leaf node or a cell of a Brick
+        struct Cell
+        {
+            GLVertex vertex[8]; ///< corners, in the order of Octnode::direction
+            float f[8];         ///< distance-field at the corners
+        };
         /// run MC algorithm and create triangles for given node
         void mc_node(Octnode *node);
+        /// run MC algorithm on the cells of the brick of the given node
+        void mc_brick(Octnode *node);
+        /// create the triangles of one cube with the given color, owned by node
+        void mc_cell(const Cell &cell, const Color &color, Octnode *node);
         /// based on the f[] values, generate a list of interpolated vertices,
-        /// all on the cube-edges of the node.
+        /// all on the cube-edges of the cell.
         /// These vertices are later used for defining triangles.
-        std::vector<GLVertex> interpolated_vertices(const Octnode *node, unsigned int edges);
-        GLVertex interpolate(const Octnode *node, int idx1, int idx2);
+        std::vector<GLVertex> interpolated_vertices(const Cell &cell, unsigned int edges);
+        GLVertex interpolate(const Cell &cell, int idx1, int idx2);
         // DATA
         /// get table-index based on the funcion values (positive or negative) at the corners
-        unsigned int mc_edgeTableIndex(const Octnode *node);
+        unsigned int mc_edgeTableIndex(const Cell &cell);
         /// Marching-Cubes edge table
         static const unsigned int edgeTable[256];
         /// Marching-Cubes triangle table
@@ -17,6 +17,11 @@
  *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cmath>
+#include <cstring>
 #include <list>
 #include <cassert>
 #include <iostream>
@@ -25,11 +30,17 @@
 #include <boost/foreach.hpp>
 
 #include "octnode.hpp"
+#include "checkpoint.hpp"
+#include "pager.hpp"
+#include "traversal.hpp"
 
 namespace cutsim
 {
     //**************** Octnode ********************/
 
+    // deep trees have many millions of nodes, keep each within a cache line
+    static_assert(sizeof(Octnode) <= 64, "Octnode should fit in 64 bytes");
+
     // this defines the position of each octree-vertex with relation to the center of the node
     // this also determines in which direction the center of a child node is
     const GLVertex Octnode::direction[8] = {
@@ -62,111 +73,352 @@ namespace cutsim
         64,
         128};
 
-    Octnode::Octnode(Octnode *nodeparent, unsigned int index, float nodescale, unsigned int nodedepth, GLData *gl)
+    Octnode::Octnode(const GLVertex &nodecenter, float nodescale)
     {
-        g = gl;
-        parent = nodeparent;
-        idx = index;
+        parent = NULL;
+        children = NULL;
+        vertexSet = NULL;
         scale = nodescale;
-        depth = nodedepth;
+        cx = nodecenter.x;
+        cy = nodecenter.y;
+        cz = nodecenter.z;
+        index = 0;
+        node_depth = 0;
+        node_state = UNDECIDED;
+        prev_node_state = OUTSIDE;
+        mat = 0;
+        for (int n = 0; n < 8; ++n)
+            set_f(n, -1);
+        isosurface_valid = false;
+        childStatus = 0;
+        touched = false;
+        brick_leaf = false;
+        change_epoch = 0;
+        paged = false;
+    }
 
-        //child.resize(8);
-        //vertex.resize(8);
-        //f.resize(8);
-        if (parent)
-        {
-            center = parent->childcenter(idx);
-            state = parent->prev_state;
-            prev_state = state;
-            color = parent->color;
+    void Octnode::place_child(Octnode *nodeparent, unsigned int idx)
+    {
+        parent = nodeparent;
+        children = NULL;
+        vertexSet = NULL;
+        scale = parent->scale / 2.0;
+        index = idx;
+        node_depth = parent->node_depth + 1;
+        // the center of the child is half-way from the parent center to the parent corner idx
+        cx = parent->cx + direction[idx].x * scale;
+        cy = parent->cy + direction[idx].y * scale;
+        cz = parent->cz + direction[idx].z * scale;
+        mat = parent->mat;
+        node_state = OUTSIDE; // the distance field is left to the caller
+        prev_node_state = OUTSIDE;
+        isosurface_valid = false;
+        childStatus = 0;
+        touched = false;
+        brick_leaf = false;
+        change_epoch = parent->change_epoch;
+        paged = false;
+    }
+
+    void Octnode::init_child(Octnode *nodeparent, unsigned int idx)
+    {
+        place_child(nodeparent, idx);
+
+        assert(parent->node_state == UNDECIDED);
+        if (parent->prev_node_state == UNDECIDED)
+        { // a coarse leaf, see set_coarse()
+            int inside = 0;
+            for (int n = 0; n < 8; ++n)
+            {
+                set_f(n, parent->interpolate((direction[idx].x + direction[n].x) / 2,
+                                             (direction[idx].y + direction[n].y) / 2,
+                                             (direction[idx].z + direction[n].z) / 2));
+                inside += (fq[n] >= 0);
+            }
+            node_state = (inside == 8) ? INSIDE : (inside == 0) ? OUTSIDE : UNDECIDED;
+            prev_node_state = node_state;
+            return;
         }
+        node_state = parent->prev_node_state;
+        prev_node_state = node_state;
+        float value = 0;
+        if (parent->prev_node_state == INSIDE)
+            value = 1;
+        else if (parent->prev_node_state == OUTSIDE)
+            value = -1;
+        else
+            assert(0);
+        for (int n = 0; n < 8; ++n)
+            set_f(n, value);
+        //f[n]= parent->f[n];  // why does this make a big diggerence in the speed of sum() and dif() ??
+        // sum() sum(): 0.15s + 0.27s   compared to 1.18 + 0.47
+        // sum() diff(): 0.15 + 0.2     compared to 1.2 + 0.46
+    }
+
+    // release the children or delete the brick, and delete the vertex set
+    Octnode::~Octnode()
+    {
+        if (brick_leaf)
+            delete brick;
         else
-        {                                   // root node has no parent
-            center = new GLVertex(0, 0, 0); // default center for root is (0,0,0)
-            state = UNDECIDED;
-            prev_state = OUTSIDE;
+            release_children(NULL, false);
+        children = NULL;
+        delete vertexSet;
+        vertexSet = NULL;
+    }
+
+    namespace
+    {
+        /// precedes the eight nodes of a block of children
+        struct BlockHeader
+        {
+            std::atomic<unsigned int> refs;    ///< nodes, of any tree, that have the block as children
+            std::atomic<const GLData *> owner; ///< the GLData that the mesh state belongs to, or NULL
+        };
+        static_assert(sizeof(BlockHeader) % alignof(Octnode) == 0, "the nodes of a block must stay aligned");
+
+        /// number of blocks in memory, of all trees
+        std::atomic<std::size_t> live_blocks{0};
+
+        inline BlockHeader *header(const Octnode *block)
+        {
+            return reinterpret_cast<BlockHeader *>(const_cast<char *>(reinterpret_cast<const char *>(block)) - sizeof(BlockHeader));
         }
+    } // end anonymous namespace
 
+    std::size_t Octnode::block_bytes()
+    {
+        return sizeof(BlockHeader) + 8 * sizeof(Octnode);
+    }
+
+    std::size_t Octnode::resident_bytes()
+    {
+        return live_blocks * block_bytes() + Brick::live * sizeof(Brick) + Page::memory;
+    }
+
+    Octnode *Octnode::alloc_block(const GLData *g)
+    {
+        char *memory = static_cast<char *>(::operator new(block_bytes()));
+        BlockHeader *h = new (memory) BlockHeader;
+        h->refs = 1;
+        h->owner = g;
+        Octnode *block = reinterpret_cast<Octnode *>(memory + sizeof(BlockHeader));
         for (int n = 0; n < 8; ++n)
-        {
-            child[n] = NULL;
-            vertex[n] = new GLVertex(*center + direction[n] * scale);
-            if (parent)
-            {
-                assert(parent->state == UNDECIDED);
-                assert(parent->prev_state != UNDECIDED);
-                //std::cout << parent->prev_state << "\n";
-                if (parent->prev_state == INSIDE)
-                {
-                    f[n] = 1;
-                    state = INSIDE;
-                }
-                else if (parent->prev_state == OUTSIDE)
-                {
-                    f[n] = -1;
-                    state = OUTSIDE;
-                }
-                else
-                    assert(0);
+            new (block + n) Octnode();
+        ++live_blocks;
+        return block;
+    }
 
-                //f[n]= parent->f[n];  // why does this make a big diggerence in the speed of sum() and dif() ??
-                // sum() sum(): 0.15s + 0.27s   compared to 1.18 + 0.47
-                // sum() diff(): 0.15 + 0.2     compared to 1.2 + 0.46
-            }
+    void Octnode::free_block(Octnode *block, GLData *g, bool clear_gl)
+    {
+        BlockHeader *h = header(block);
+        // vertex sets of a block without owner are stale copies of those of another block
+        bool mine = g && (h->owner == g);
+        for (int n = 0; n < 8; ++n)
+        {
+            Octnode &c = block[n];
+            if (c.brick_leaf)
+                c.delete_brick();
             else
+                c.release_children(g, clear_gl);
+            if (mine && c.vertexSet)
             {
-                f[n] = -1;
+                if (clear_gl)
+                    remove_vertices(c.vertexSet, g);
+                delete c.vertexSet;
             }
+            c.vertexSet = NULL;
+            c.~Octnode();
         }
-        bb.clear();
-        bb.addPoint(*vertex[2]); // vertex[2] has the minimum x,y,z coordinates
-        bb.addPoint(*vertex[4]); // vertex[4] has the max x,y,z
+        h->~BlockHeader();
+        ::operator delete(h);
+        --live_blocks;
+    }
 
-        isosurface_valid = false;
+    void Octnode::drop_mesh(Octnode *block, GLData *g, bool clear_gl)
+    {
+        BlockHeader *h = header(block);
+        if (!g || h->owner != g)
+            return; // the vertices of g are only in the blocks it owns
+        // the nodes are not written, the other trees ignore the stale vertex sets
+        for (int n = 0; n < 8; ++n)
+        {
+            const Octnode &c = block[n];
+            if (c.vertexSet)
+            {
+                if (clear_gl)
+                    remove_vertices(c.vertexSet, g);
+                delete c.vertexSet;
+            }
+            if (!c.isLeaf()) // the vertices of a paged sub-tree are in the vertex set of c
+                drop_mesh(c.children, g, clear_gl);
+        }
+        h->owner = NULL;
+    }
 
-        childcount = 0;
+    void Octnode::release_children(GLData *g, bool clear_gl)
+    {
+        if (paged)
+        {
+            drop_page(page);
+            children = NULL;
+            paged = false;
+            childStatus = 0;
+            return;
+        }
+        if (brick_leaf || !children)
+            return;
+        Octnode *block = children;
+        children = NULL;
         childStatus = 0;
+        BlockHeader *h = header(block);
+        if (h->refs > 1) // other trees keep the nodes
+            drop_mesh(block, g, clear_gl);
+        if (h->refs.fetch_sub(1) == 1)
+            free_block(block, g, clear_gl);
     }
 
-    // call delete on children, vertices, and center
-    Octnode::~Octnode()
+    void Octnode::hold_block(Octnode *block)
     {
-        if (childcount == 8)
+        ++header(block)->refs;
+    }
+
+    void Octnode::drop_block(Octnode *block)
+    {
+        if (header(block)->refs.fetch_sub(1) == 1)
+            free_block(block, NULL, false);
+    }
+
+    void Octnode::drop_page(Page *p)
+    {
+        if (p->refs.fetch_sub(1) == 1)
         {
-            for (int n = 0; n < 8; ++n)
-            {
-                delete child[n];
-                child[n] = 0;
-                delete vertex[n];
-                vertex[n] = 0;
-            }
+            if (p->pager)
+                p->pager->release(p->offset, p->packed_bytes);
+            else
+                Page::memory -= p->packed_bytes;
+            delete p;
         }
-        delete center;
-        center = 0;
     }
 
-    // return centerpoint of child with index n
-    GLVertex *Octnode::childcenter(int n)
+    void Octnode::copy_from(const Octnode &src, bool mesh)
     {
-        return new GLVertex(*center + (direction[n] * 0.5 * scale));
+        parent = src.parent;
+        cx = src.cx;
+        cy = src.cy;
+        cz = src.cz;
+        scale = src.scale;
+        std::copy(src.fq, src.fq + 8, fq);
+        mat = src.mat;
+        node_state = src.node_state;
+        prev_node_state = src.prev_node_state;
+        index = src.index;
+        node_depth = src.node_depth;
+        touched = src.touched;
+        brick_leaf = src.brick_leaf;
+        change_epoch = src.change_epoch;
+        paged = src.paged;
+        if (brick_leaf)
+            brick = new Brick(*src.brick);
+        else if (paged)
+        {
+            page = src.page;
+            ++page->refs;
+        }
+        else
+        {
+            children = src.children;
+            if (children)
+                ++header(children)->refs;
+        }
+        vertexSet = mesh ? src.vertexSet : NULL;
+        isosurface_valid = mesh ? src.isosurface_valid : false;
+        childStatus = mesh ? src.childStatus : 0;
+    }
+
+    void Octnode::share(const Octnode &src)
+    {
+        assert(isLeaf() && vertexSetEmpty());
+        delete vertexSet;
+        copy_from(src, false);
+        parent = NULL;
+    }
+
+    bool Octnode::children_shared() const
+    {
+        return !isLeaf() && header(children)->refs > 1;
+    }
+
+    bool Octnode::children_owned(const GLData *g) const
+    {
+        return isLeaf() || header(children)->owner == g;
+    }
+
+    void Octnode::unshare_children(GLData *g)
+    {
+        if (isLeaf())
+            return;
+        BlockHeader *h = header(children);
+        if (h->refs == 1)
+        { // only this node refers to the block, which may come from another tree
+            if (h->owner != g)
+            { // the mesh state is stale, remesh the children
+                for (int n = 0; n < 8; ++n)
+                {
+                    children[n].vertexSet = NULL;
+                    children[n].isosurface_valid = false;
+                    children[n].childStatus = 0;
+                }
+                h->owner = g;
+                childStatus = 0;
+                setInvalid();
+            }
+            if (children[0].parent != this)
+                for (int n = 0; n < 8; ++n)
+                    children[n].parent = this;
+            return;
+        }
+        // copy on write
+        Octnode *block = children;
+        bool mine = g && h->owner == g;
+        children = alloc_block(g);
+        for (int n = 0; n < 8; ++n)
+        {
+            children[n].copy_from(block[n], mine);
+            children[n].parent = this;
+        }
+        if (mine)
+        { // the vertices move to the copy
+            std::lock_guard<std::mutex> lock(g->mutex);
+            for (int n = 0; n < 8; ++n)
+                if (children[n].vertexSet)
+                    for (std::size_t i = 0; i < children[n].vertexSet->size(); ++i)
+                        g->setNode((*children[n].vertexSet)[i], children + n);
+            h->owner = NULL;
+        }
+        else
+        {
+            childStatus = 0;
+            setInvalid();
+        }
+        if (h->refs.fetch_sub(1) == 1) // the other trees let go of the block meanwhile
+            free_block(block, g, false);
     }
 
     // create the 8 children of this node
     void Octnode::subdivide()
     {
-        if (this->childcount == 0)
+        if (isLeaf())
         {
-            if (state != UNDECIDED)
-                std::cout << " subdivide() error: state==" << state << "\n";
+            if (node_state != UNDECIDED)
+                std::cout << " subdivide() error: state==" << node_state << "\n";
 
-            assert(state == UNDECIDED);
+            assert(node_state == UNDECIDED);
+            delete_brick(); // the children start from prev_node_state
 
+            children = alloc_block(NULL); // owned by the GLData that first meshes them
             for (int n = 0; n < 8; ++n)
-            {
-                Octnode *newnode = new Octnode(this, n, scale / 2.0, depth + 1, g); // parent,  idx, scale,   depth, GLdata
-                this->child[n] = newnode;
-                ++childcount;
-            }
+                children[n].init_child(this, n);
         }
         else
         {
@@ -174,56 +426,294 @@ namespace cutsim
             assert(0);
         }
     }
+
     // A union B = max( d(A), d(B) )
-    void Octnode::sum(const Volume *vol)
+    int Octnode::sum(const Volume *vol, unsigned char m, DistCache *cache)
     {
+        unsigned long evaluations = cache ? cache->evaluations : 0;
         for (int n = 0; n < 8; ++n)
         {
-            if (vol->dist(*(vertex[n])) > f[n])
-                color = vol->color;
-            f[n] = std::max(f[n], vol->dist(*(vertex[n])));
+            int16_t d = quantize(corner_dist(vol, n, cache));
+            if (d > fq[n])
+            {
+                mat = m;
+                fq[n] = d;
+            }
         }
         set_state();
+        return cache ? cache->evaluations - evaluations : 8;
     }
     // A \ B = min( d(A), -d(B)
-    void Octnode::diff(const Volume *vol)
+    int Octnode::diff(const Volume *vol, unsigned char m, DistCache *cache)
     {
+        unsigned long evaluations = cache ? cache->evaluations : 0;
         for (int n = 0; n < 8; ++n)
         {
-            if (-1 * vol->dist(*(vertex[n])) < f[n])
-                color = vol->color;
-            f[n] = std::min(f[n], -vol->dist(*(vertex[n])));
+            int16_t d = quantize(-corner_dist(vol, n, cache));
+            if (d < fq[n])
+            {
+                mat = m;
+                fq[n] = d;
+            }
         }
         set_state();
+        return cache ? cache->evaluations - evaluations : 8;
     }
     // A intersect B = min( d(A), d(B) )
-    void Octnode::intersect(const Volume *vol)
+    int Octnode::intersect(const Volume *vol, unsigned char m, DistCache *cache)
     {
+        unsigned long evaluations = cache ? cache->evaluations : 0;
         for (int n = 0; n < 8; ++n)
         {
-            if (vol->dist(*(vertex[n])) < f[n])
-                color = vol->color;
-            f[n] = std::min(f[n], vol->dist(*(vertex[n])));
+            int16_t d = quantize(corner_dist(vol, n, cache));
+            if (d < fq[n])
+            {
+                mat = m;
+                fq[n] = d;
+            }
         }
         set_state();
+        return cache ? cache->evaluations - evaluations : 8;
+    }
+
+    void Octnode::make_brick()
+    {
+        assert(isLeaf() && !brick_leaf);
+        Brick *b = new Brick;
+        if (prev_node_state == UNDECIDED)
+        { // a coarse leaf, see set_coarse()
+            const float factor = 32767 / (band * scale / Brick::cells);
+            for (int k = 0; k < Brick::samples; ++k)
+                for (int j = 0; j < Brick::samples; ++j)
+                    for (int i = 0; i < Brick::samples; ++i)
+                        b->f[Brick::sample(i, j, k)] = quantize(interpolate(2.0f * i / Brick::cells - 1,
+                                                                            2.0f * j / Brick::cells - 1,
+                                                                            2.0f * k / Brick::cells - 1),
+                                                                factor);
+        }
+        else
+        {
+            int16_t value = (prev_node_state == INSIDE) ? 32767 : -32767;
+            std::fill(b->f, b->f + Brick::samples * Brick::samples * Brick::samples, value);
+        }
+        std::fill(b->mat, b->mat + Brick::cells * Brick::cells * Brick::cells, mat);
+        brick = b;
+        brick_leaf = true;
+    }
+
+    float Octnode::interpolate(const int16_t *q, float u, float v, float w)
+    {
+        float value = 0;
+        for (int n = 0; n < 8; ++n)
+            value += q[n] * (1 + direction[n].x * u) * (1 + direction[n].y * v) * (1 + direction[n].z * w);
+        return value / 8;
+    }
+
+    void Octnode::delete_brick()
+    {
+        if (brick_leaf)
+        {
+            delete brick;
+            brick = NULL;
+            brick_leaf = false;
+        }
+    }
+
+    template <class Combine>
+    int Octnode::brick_op(const Volume *vol, unsigned char m, DistCache *cache, float sign, bool whole, Combine combine)
+    {
+        static const int n_samples = Brick::samples * Brick::samples * Brick::samples;
+        bool created = !brick_leaf;
+        if (created)
+            make_brick();
+        const float h = 2 * scale / Brick::cells;
+        const float origin[3] = {cx - scale, cy - scale, cz - scale};
+        // the samples within one cell of the bounding-box of the Volume.
+        // the samples further out are not on a cell-edge that the surface crosses.
+        int lo[3] = {0, 0, 0};
+        int hi[3] = {Brick::cells, Brick::cells, Brick::cells};
+        if (!whole)
+        {
+            const float minpt[3] = {vol->bb.minpt.x, vol->bb.minpt.y, vol->bb.minpt.z};
+            const float maxpt[3] = {vol->bb.maxpt.x, vol->bb.maxpt.y, vol->bb.maxpt.z};
+            for (int a = 0; a < 3; ++a)
+            {
+                lo[a] = std::max(0, (int)std::floor((minpt[a] - origin[a]) / h) - 1);
+                hi[a] = std::min((int)Brick::cells, (int)std::ceil((maxpt[a] - origin[a]) / h) + 1);
+            }
+        }
+        unsigned long cached = cache ? cache->evaluations : 0;
+        int evaluations = 0;
+        bool changed[n_samples] = {};
+        bool any = false;
+        float d[Brick::samples];
+        int16_t q[Brick::samples];
+        const float factor = 32767 / (band * scale / Brick::cells);
+        // a sample at the end of the band that combine() moves towards cannot change,
+        // e.g. a sample deep in the air for diff(). These need no dist().
+        const int16_t saturated = combine(-32767, 32767);
+        for (int k = lo[2]; k <= hi[2]; ++k)
+        {
+            for (int j = lo[1]; j <= hi[1]; ++j)
+            {
+                int16_t *f = brick->f + Brick::sample(0, j, k);
+                bool *c = changed + Brick::sample(0, j, k);
+                for (int i = lo[0]; i <= hi[0]; ++i)
+                {
+                    if (f[i] == saturated)
+                    {
+                        d[i] = saturated / factor;
+                        continue;
+                    }
+                    GLVertex p(origin[0] + i * h, origin[1] + j * h, origin[2] + k * h);
+                    d[i] = sign * (cache ? cache->dist(vol, p) : vol->dist(p));
+                    ++evaluations;
+                }
+                // no calls and no early exits below, so the compiler can vectorize the row
+                for (int i = lo[0]; i <= hi[0]; ++i)
+                    q[i] = quantize(d[i], factor);
+                for (int i = lo[0]; i <= hi[0]; ++i)
+                {
+                    int16_t value = combine(f[i], q[i]);
+                    c[i] = (value != f[i]);
+                    f[i] = value;
+                }
+                for (int i = lo[0]; i <= hi[0]; ++i)
+                    any |= c[i];
+            }
+        }
+        if (any)
+        { // the cells around a changed sample get the new material
+            mat = m;
+            for (int k = lo[2]; k <= hi[2]; ++k)
+                for (int j = lo[1]; j <= hi[1]; ++j)
+                    for (int i = lo[0]; i <= hi[0]; ++i)
+                    {
+                        if (!changed[Brick::sample(i, j, k)])
+                            continue;
+                        for (int ck = std::max(0, k - 1); ck < std::min((int)Brick::cells, k + 1); ++ck)
+                            for (int cj = std::max(0, j - 1); cj < std::min((int)Brick::cells, j + 1); ++cj)
+                                for (int ci = std::max(0, i - 1); ci < std::min((int)Brick::cells, i + 1); ++ci)
+                                    brick->mat[Brick::cell(ci, cj, ck)] = m;
+                    }
+        }
+        if (any || created)
+        {
+            // the corners of the node are the corners of the brick
+            for (int n = 0; n < 8; ++n)
+            {
+                int s = Brick::sample(direction[n].x > 0 ? Brick::cells : 0,
+                                      direction[n].y > 0 ? Brick::cells : 0,
+                                      direction[n].z > 0 ? Brick::cells : 0);
+                set_f(n, brick_f(s));
+            }
+            int negative = 0;
+            for (int s = 0; s < n_samples; ++s)
+                negative += (brick->f[s] < 0);
+            if (negative == 0 || negative == n_samples)
+            { // no surface in the brick, the node is an INSIDE or OUTSIDE leaf
+                delete_brick();
+                set_state();
+            }
+            else
+            {
+                setUndecided();
+                setInvalid();
+            }
+        }
+        return cache ? cache->evaluations - cached : evaluations;
+    }
+
+    namespace
+    {
+        /// the combine-functions of the brick operations, on fixed-point samples
+        inline int16_t max16(int16_t a, int16_t b) { return a > b ? a : b; }
+        inline int16_t min16(int16_t a, int16_t b) { return a < b ? a : b; }
+    } // end anonymous namespace
+
+    int Octnode::brick_sum(const Volume *vol, unsigned char m, DistCache *cache)
+    {
+        return brick_op(vol, m, cache, 1.0f, false, max16);
+    }
+    int Octnode::brick_diff(const Volume *vol, unsigned char m, DistCache *cache)
+    {
+        return brick_op(vol, m, cache, -1.0f, false, min16);
+    }
+    int Octnode::brick_intersect(const Volume *vol, unsigned char m, DistCache *cache)
+    {
+        return brick_op(vol, m, cache, 1.0f, true, min16);
+    }
+
+    template <class Combine>
+    int Octnode::check_linear(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache,
+                              float sign, Combine combine, bool &linear) const
+    {
+        linear = false;
+        unsigned long cached = cache ? cache->evaluations : 0;
+        int evaluations = 0;
+        const float factor = 32767 / (band * scale);
+        const float limit = tolerance * factor;
+        // the new children start from the prev_node_state, or a coarse leaf from its corners
+        const int16_t outer = (prev_node_state == INSIDE) ? 32767 : -32767;
+        // the points of the 3x3x3 lattice of the node that are not corners, the center first
+        static const int order[3] = {0, -1, 1};
+        for (int k = 0; k < 3; ++k)
+            for (int j = 0; j < 3; ++j)
+                for (int i = 0; i < 3; ++i)
+                {
+                    int u = order[i], v = order[j], w = order[k];
+                    if (u && v && w)
+                        continue;
+                    GLVertex p(cx + u * scale, cy + v * scale, cz + w * scale);
+                    float d = sign * (cache ? cache->dist(vol, p) : vol->dist(p));
+                    ++evaluations;
+                    int16_t old = (prev_node_state == UNDECIDED) ? (int16_t)std::lround(interpolate(before, u, v, w)) : outer;
+                    if (std::fabs(combine(old, quantize(d, factor)) - interpolate(fq, u, v, w)) > limit)
+                        return cache ? cache->evaluations - cached : evaluations;
+                }
+        linear = true;
+        return cache ? cache->evaluations - cached : evaluations;
+    }
+
+    int Octnode::linear_sum(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache, bool &linear) const
+    {
+        return check_linear(vol, before, tolerance, cache, 1.0f, max16, linear);
+    }
+    int Octnode::linear_diff(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache, bool &linear) const
+    {
+        return check_linear(vol, before, tolerance, cache, -1.0f, min16, linear);
+    }
+    int Octnode::linear_intersect(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache, bool &linear) const
+    {
+        return check_linear(vol, before, tolerance, cache, 1.0f, min16, linear);
+    }
+
+    unsigned char Octnode::material_at(const GLVertex &p) const
+    {
+        if (!brick_leaf)
+            return mat;
+        float h = 2 * scale / Brick::cells;
+        int i = std::min(std::max((int)((p.x - (cx - scale)) / h), 0), Brick::cells - 1);
+        int j = std::min(std::max((int)((p.y - (cy - scale)) / h), 0), Brick::cells - 1);
+        int k = std::min(std::max((int)((p.z - (cz - scale)) / h), 0), Brick::cells - 1);
+        return brick->mat[Brick::cell(i, j, k)];
     }
 
     // look at the f-values in the corner of the cube and set state
     // to inside, outside, or undecided
     void Octnode::set_state()
     {
-        NodeState old_state = state;
+        NodeState old_state = state();
         bool outside = true;
         bool inside = true;
         for (int n = 0; n < 8; n++)
         {
-            if (f[n] >= 0.0)
+            if (fq[n] >= 0)
             {                    // if one vertex is inside
                 outside = false; // then it's not an outside-node
             }
             else
             { // if one vertex is outside
-                assert(f[n] < 0.0);
                 inside = false; // then it's not an inside node anymore
             }
         }
@@ -243,8 +733,8 @@ namespace cutsim
                (!is_inside() && is_outside() && !is_undecided()) ||
                (!is_inside() && !is_outside() && is_undecided()));
 
-        if (((old_state == INSIDE) && (state == INSIDE)) ||
-            ((old_state == OUTSIDE) && (state == OUTSIDE)))
+        if (((old_state == INSIDE) && (node_state == INSIDE)) ||
+            ((old_state == OUTSIDE) && (node_state == OUTSIDE)))
         {
             // do nothing if state did not change
         }
@@ -256,45 +746,45 @@ namespace cutsim
 
     void Octnode::setInside()
     {
-        if ((state != INSIDE) && (all_child_state(INSIDE)))
+        if ((node_state != INSIDE) && (all_child_state(INSIDE)))
         {
-            state = INSIDE;
-            if (parent && (parent->state != INSIDE))
+            node_state = INSIDE;
+            if (parent && (parent->node_state != INSIDE))
                 parent->setInside();
         }
     }
 
     void Octnode::setOutside()
     {
-        if ((state != OUTSIDE) && (all_child_state(OUTSIDE)))
+        if ((node_state != OUTSIDE) && (all_child_state(OUTSIDE)))
         {
-            state = OUTSIDE;
-            if (parent && (parent->state != OUTSIDE))
+            node_state = OUTSIDE;
+            if (parent && (parent->node_state != OUTSIDE))
                 parent->setOutside();
         }
     }
     void Octnode::setUndecided()
     {
-        if (state != UNDECIDED)
+        if (node_state != UNDECIDED)
         {
-            prev_state = state;
-            state = UNDECIDED;
+            prev_node_state = node_state;
+            node_state = UNDECIDED;
             setInvalid();
         }
     }
 
     bool Octnode::all_child_state(NodeState s) const
     {
-        if (childcount == 8)
+        if (!isLeaf())
         {
-            return (child[0]->state == s) &&
-                   (child[1]->state == s) &&
-                   (child[2]->state == s) &&
-                   (child[3]->state == s) &&
-                   (child[4]->state == s) &&
-                   (child[5]->state == s) &&
-                   (child[6]->state == s) &&
-                   (child[7]->state == s);
+            return (children[0].node_state == s) &&
+                   (children[1].node_state == s) &&
+                   (children[2].node_state == s) &&
+                   (children[3].node_state == s) &&
+                   (children[4].node_state == s) &&
+                   (children[5].node_state == s) &&
+                   (children[6].node_state == s) &&
+                   (children[7].node_state == s);
         }
         else
         {
@@ -302,46 +792,345 @@ namespace cutsim
         }
     }
 
-    void Octnode::delete_children()
+    void Octnode::delete_children(GLData *g)
     {
-        if (childcount == 8)
+        if (!isLeaf())
         {
-            NodeState s0 = child[0]->state;
-            //std::cout << spaces() << depth << ":" << idx << " delete_children\n";
-            //std::cout << "before: s0= " << s0 << " \n";
-            //std::cout << " delete_children() states: ";
-            //for ( int m=0;m<8;m++ ) {
-            //    std::cout << child[m]->state << " ";
-            //}
-
+            unsigned int s0 = children[0].node_state;
             for (int n = 0; n < 8; n++)
             {
-                //std::cout << depth << " deleting " << n << "\n";
-                if (s0 != child[n]->state)
+                if (s0 != children[n].node_state)
                 {
                     std::cout << " delete_children() error: ";
-                    //for ( int m=0;m<8;m++ ) {
-                    //    std::cout << child[m]->state << " ";
-                    //}
                     std::cout << "\n";
                     std::cout << " s0= " << s0 << " \n";
                 }
-                assert(s0 == child[n]->state);
-                child[n]->clearVertexSet();
-                delete child[n];
-                child[n] = 0;
-                childcount--;
+                assert(s0 == children[n].node_state);
             }
-            assert(childcount == 0);
+            release_children(g, true);
         }
     }
 
+    void Octnode::collapse(GLData *g)
+    {
+        delete_brick();
+        release_children(g, true);
+    }
+
+    void Octnode::save(CheckpointWriter &out) const
+    {
+        char record[Checkpoint::node_bytes];
+        std::memcpy(record, fq, sizeof(fq));
+        record[16] = mat;
+        uint8_t flags = node_state | (prev_node_state << 2);
+        if (brick_leaf)
+            flags |= Checkpoint::has_brick;
+        else if (children)
+            flags |= Checkpoint::has_children;
+        record[17] = flags;
+        out.write(record, sizeof(record));
+        if (brick_leaf)
+        {
+            out.write(brick->f, sizeof(brick->f));
+            out.write(brick->mat, sizeof(brick->mat));
+        }
+    }
+
+    bool Octnode::load(CheckpointReader &in)
+    {
+        if (paged && !page_in(NULL)) // the sub-tree follows, or a mark of it in a delta
+            return false;
+        const char *record = in.next(Checkpoint::node_bytes);
+        if (!record)
+            return false;
+        uint8_t flags = record[17];
+        if ((flags & 3) > UNDECIDED || ((flags >> 2) & 3) > UNDECIDED || (flags >> 6) ||
+            ((flags & Checkpoint::has_brick) && (flags & Checkpoint::has_children)))
+            return false;
+        std::memcpy(fq, record, sizeof(fq));
+        mat = record[16];
+        node_state = flags & 3;
+        prev_node_state = (flags >> 2) & 3;
+        isosurface_valid = false;
+        childStatus = 0;
+        touched = false;
+        if (flags & Checkpoint::has_brick)
+        {
+            if (!brick_leaf)
+            {
+                release_children(NULL, false);
+                brick = new Brick;
+                brick_leaf = true;
+            }
+            if (!in.read(brick->f, sizeof(brick->f)) || !in.read(brick->mat, sizeof(brick->mat)))
+                return false;
+        }
+        else
+        {
+            delete_brick();
+            if (!(flags & Checkpoint::has_children))
+                release_children(NULL, false);
+            else if (!children)
+            {
+                children = alloc_block(NULL);
+                for (int n = 0; n < 8; ++n)
+                    children[n].place_child(this, n);
+            }
+        }
+        return true;
+    }
+
+    bool Octnode::owned(const GLData *g) const
+    {
+        return node_depth == 0 || header(this - index)->owner == g;
+    }
+
+    bool Octnode::page_out(const std::shared_ptr<Pager> &pager, GLData *g)
+    {
+        if (node_depth > 0 && header(this - index)->refs > 1)
+            return false; // this node is written
+        if (paged)
+        { // a page in memory moves to the file as it is
+            if (!pager || page->pager)
+                return false;
+            Page *p = new Page;
+            p->packed_bytes = page->packed_bytes;
+            p->node_bytes = page->node_bytes;
+            p->nodes = page->nodes;
+            p->own_vertices = page->own_vertices;
+            p->refs = 1;
+            if (!pager->write(page->packed, p->offset))
+            {
+                delete p;
+                return false;
+            }
+            p->pager = pager;
+            drop_page(page);
+            page = p;
+            return true;
+        }
+        if (isLeaf())
+            return false;
+        if (!owned(g))
+            g = NULL; // the vertex sets are stale, the sub-tree needs meshing anyway
+        // the nodes below this one, with the vertex count of each, and its vertices
+        struct Visitor
+        {
+            CheckpointWriter &out;
+            std::vector<uint32_t> &counts;
+            std::vector<unsigned int> &moved;
+            const GLData *g;
+            bool nested;
+            bool pre(Octnode *current)
+            {
+                nested = nested || current->paged;
+                current->save(out);
+                uint32_t count = 0;
+                // vertex sets of a block that g does not own are stale
+                if (g && current->vertexSet && header(current - current->index)->owner == g)
+                {
+                    count = current->vertexSet->size();
+                    moved.insert(moved.end(), current->vertexSet->begin(), current->vertexSet->end());
+                }
+                counts.push_back(count);
+                return !nested;
+            }
+            void post(Octnode *) {}
+        };
+        std::ostringstream stream;
+        CheckpointWriter out(stream);
+        std::vector<uint32_t> counts;
+        std::vector<unsigned int> moved;
+        Visitor visitor = {out, counts, moved, g, false};
+        for (int n = 0; n < 8 && !visitor.nested; ++n)
+            traverse(children + n, visitor);
+        if (visitor.nested || !out.flush())
+            return false;
+        const std::string &nodes = stream.str();
+        std::vector<char> data(nodes.begin(), nodes.end());
+        data.resize(nodes.size() + counts.size() * sizeof(uint32_t));
+        std::memcpy(data.data() + nodes.size(), counts.data(), counts.size() * sizeof(uint32_t));
+        std::vector<char> packed;
+        PageCodec::pack(data, packed);
+        uint64_t offset = 0;
+        if (pager && !pager->write(packed, offset))
+            return false;
+        Page *p = new Page;
+        p->pager = pager;
+        p->offset = offset;
+        p->packed_bytes = packed.size();
+        if (!pager)
+        {
+            p->packed.swap(packed);
+            Page::memory += p->packed_bytes;
+        }
+        p->node_bytes = nodes.size();
+        p->nodes = counts.size();
+        p->own_vertices = g ? vertexSetSize() : 0;
+        p->refs = 1;
+        if (!moved.empty())
+        { // the mesh stays, drawn by this node
+            std::lock_guard<std::mutex> lock(g->mutex);
+            if (!vertexSet)
+                vertexSet = new std::vector<unsigned int>();
+            vertexSet->insert(vertexSet->end(), moved.begin(), moved.end());
+            for (std::size_t i = 0; i < moved.size(); ++i)
+                g->setNode(moved[i], this);
+        }
+        release_children(g, false);
+        page = p;
+        paged = true;
+        return true;
+    }
+
+    bool Octnode::page_in(GLData *g)
+    {
+        if (!paged)
+            return true;
+        Page *p = page;
+        std::vector<char> data;
+        if (!p->read(data))
+            return false;
+        std::vector<uint32_t> counts(p->nodes);
+        std::memcpy(counts.data(), data.data() + p->node_bytes, counts.size() * sizeof(uint32_t));
+        std::size_t total = p->own_vertices;
+        for (std::size_t i = 0; i < counts.size(); ++i)
+            total += counts[i];
+        // the vertices of the sub-tree are after those of this node, in the order of the counts
+        bool mesh = g && owned(g) && isosurface_valid && vertexSetSize() == total;
+        struct Visitor
+        {
+            CheckpointReader &in;
+            const std::vector<uint32_t> &counts;
+            const std::vector<unsigned int> *vertices;
+            std::size_t next;     ///< the next count
+            std::size_t position; ///< of the next vertex
+            const GLData *g;      ///< the owner of the blocks, if the mesh is restored
+            bool ok;
+            bool pre(Octnode *current)
+            {
+                ok = ok && next < counts.size() && current->load(in);
+                if (!ok)
+                    return false;
+                if (g)
+                {
+                    uint32_t count = counts[next];
+                    if (count)
+                        current->vertexSet = new std::vector<unsigned int>(vertices->begin() + position,
+                                                                           vertices->begin() + position + count);
+                    position += count;
+                    current->isosurface_valid = true;
+                    if (!current->isLeaf())
+                    {
+                        current->childStatus = 255;
+                        header(current->children)->owner = g;
+                    }
+                }
+                ++next;
+                return true;
+            }
+            void post(Octnode *) {}
+        };
+        CheckpointReader in(data.data(), p->node_bytes);
+        Octnode *block = alloc_block(mesh ? g : NULL);
+        for (int n = 0; n < 8; ++n)
+            block[n].place_child(this, n);
+        Visitor visitor = {in, counts, vertexSet, 0, p->own_vertices, mesh ? g : NULL, true};
+        for (int n = 0; n < 8 && visitor.ok; ++n)
+            traverse(block + n, visitor);
+        if (!visitor.ok || visitor.next != counts.size() || in.next(1))
+        {
+            std::cout << "Octnode::page_in(): bad page\n";
+            free_block(block, mesh ? g : NULL, false);
+            return false;
+        }
+        children = block;
+        paged = false;
+        if (mesh)
+        { // the vertices go back to the nodes that made them
+            std::lock_guard<std::mutex> lock(g->mutex);
+            struct Owner
+            {
+                GLData *g;
+                bool pre(Octnode *current)
+                {
+                    if (current->vertexSet)
+                        for (std::size_t i = 0; i < current->vertexSet->size(); ++i)
+                            g->setNode((*current->vertexSet)[i], current);
+                    return true;
+                }
+                void post(Octnode *) {}
+            };
+            Owner owner = {g};
+            for (int n = 0; n < 8; ++n)
+                traverse(children + n, owner);
+            if (vertexSet)
+                vertexSet->resize(p->own_vertices);
+            childStatus = 255;
+        }
+        else
+        {
+            childStatus = 0;
+            if (g)
+                setInvalid();
+        }
+        drop_page(p);
+        return true;
+    }
+
+    bool Octnode::save_page(CheckpointWriter &out, bool marks) const
+    {
+        if (!paged)
+            return true;
+        std::vector<char> data;
+        if (!page->read(data))
+            return false;
+        data.resize(page->node_bytes);
+        if (!marks)
+        {
+            out.write(data.data(), data.size());
+            return true;
+        }
+        // each node of the sub-tree is changed, it is not in the previous checkpoint
+        CheckpointReader in(data.data(), data.size());
+        std::size_t pending = 8;
+        while (pending)
+        {
+            const char *record = in.next(Checkpoint::node_bytes);
+            if (!record)
+                return false;
+            out.put(Checkpoint::changed);
+            out.write(record, Checkpoint::node_bytes);
+            --pending;
+            if (record[17] & Checkpoint::has_children)
+                pending += 8;
+            if (record[17] & Checkpoint::has_brick)
+            {
+                const std::size_t size = sizeof(Brick::f) + sizeof(Brick::mat);
+                const char *b = in.next(size);
+                if (!b)
+                    return false;
+                out.write(b, size);
+            }
+        }
+        return true;
+    }
+
+    std::size_t Octnode::page_bytes() const
+    {
+        return paged ? page->packed_bytes : 0;
+    }
+
+    bool Octnode::is_packed() const
+    {
+        return paged && !page->pager;
+    }
+
     void Octnode::setValid()
     {
         isosurface_valid = true;
-        //std::cout << spaces() << depth << ":" << idx << " setValid()\n";
         if (parent)
-            parent->setChildValid(idx); // try to propagate valid up the tree:
+            parent->setChildValid(index); // try to propagate valid up the tree:
     }
     void Octnode::setChildValid(unsigned int id)
     {
@@ -363,7 +1152,7 @@ namespace cutsim
         isosurface_valid = false;
         if (parent && parent->valid())
         { // update parent status also
-            parent->setChildInvalid(idx);
+            parent->setChildInvalid(index);
         }
     }
     bool Octnode::valid() const
@@ -373,40 +1162,45 @@ namespace cutsim
 
     void Octnode::addIndex(unsigned int id)
     {
-#ifndef NDEBUG
-        std::set<unsigned int>::iterator found = vertexSet.find(id);
-        assert(found == vertexSet.end()); // we should not have id
-#endif
-        vertexSet.insert(id);
+        if (!vertexSet)
+            vertexSet = new std::vector<unsigned int>();
+        assert(std::find(vertexSet->begin(), vertexSet->end(), id) == vertexSet->end()); // we should not have id
+        vertexSet->push_back(id);
     }
     void Octnode::swapIndex(unsigned int oldId, unsigned int newId)
     {
-#ifndef NDEBUG
-        std::set<unsigned int>::iterator found = vertexSet.find(oldId);
-        assert(found != vertexSet.end()); // we must have oldId
-#endif
-        vertexSet.erase(oldId);
-        vertexSet.insert(newId);
+        std::vector<unsigned int>::iterator found = std::find(vertexSet->begin(), vertexSet->end(), oldId);
+        assert(found != vertexSet->end()); // we must have oldId
+        *found = newId;
     }
 
     void Octnode::removeIndex(unsigned int id)
     {
-#ifndef NDEBUG
-        std::set<unsigned int>::iterator found = vertexSet.find(id);
-        assert(found != vertexSet.end()); // we must have id
-#endif
-        vertexSet.erase(id);
+        std::vector<unsigned int>::iterator found = std::find(vertexSet->begin(), vertexSet->end(), id);
+        assert(found != vertexSet->end()); // we must have id
+        *found = vertexSet->back();
+        vertexSet->pop_back();
+    }
+
+    void Octnode::clearVertexSet(GLData *g)
+    {
+        if (!vertexSet)
+            return;
+        remove_vertices(vertexSet, g);
+        assert(vertexSetEmpty()); // when done, set should be empty
+        delete vertexSet;
+        vertexSet = NULL;
     }
 
-    void Octnode::clearVertexSet()
+    void Octnode::remove_vertices(std::vector<unsigned int> *set, GLData *g)
     {
-        while (!vertexSetEmpty())
+        std::lock_guard<std::mutex> lock(g->mutex);
+        while (!set->empty())
         {
-            unsigned int delId = vertexSetTop();
-            removeIndex(delId);
-            g->removeVertex(delId);
+            unsigned int delId = set->back();
+            set->pop_back();
+            g->removeVertex(delId); // may renumber a vertex of any node, through swapIndex()
         }
-        assert(vertexSetEmpty()); // when done, set should be empty
     }
 
     // string repr
@@ -421,7 +1215,7 @@ namespace cutsim
         std::ostringstream o;
         for (int n = 0; n < 8; n++)
         {
-            o << "f[" << n << "] = " << f[n] << "\n";
+            o << "f[" << n << "] = " << f(n) << "\n";
         }
         return o.str();
     }
@@ -429,7 +1223,7 @@ namespace cutsim
     std::string Octnode::spaces() const
     {
         std::ostringstream stream;
-        for (unsigned int m = 0; m < this->depth; m++)
+        for (unsigned int m = 0; m < depth(); m++)
             stream << " ";
         return stream.str();
     }
@@ -437,11 +1231,11 @@ namespace cutsim
     std::string Octnode::type() const
     {
         std::ostringstream stream;
-        if (state == INSIDE)
+        if (node_state == INSIDE)
             stream << "inside";
-        else if (state == OUTSIDE)
+        else if (node_state == OUTSIDE)
             stream << "outside";
-        else if (state == UNDECIDED)
+        else if (node_state == UNDECIDED)
             stream << "undecided";
         else
             assert(0);
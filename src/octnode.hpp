@@ -22,23 +22,44 @@
 #include <iostream>
 #include <sstream>
 
+#include <algorithm>
+#include <cstdint>
 #include <list>
-#include <set>
+#include <memory>
 #include <vector>
 
 #include "volume.hpp"
 #include "bbox.hpp"
 #include "glvertex.hpp"
 #include "gldata.hpp"
+#include "distcache.hpp"
+#include "brick.hpp"
 
 namespace cutsim
 {
 
+    class CheckpointWriter;
+    class CheckpointReader;
+    class Pager;
+    struct Page;
+
     /// \class Octnode
     /// Octnode represents a node in the octree.
     ///
-    /// each node in the octree is a cube with side length scale
+    /// each node in the octree is a cube with side length 2*scale
     /// the distance field at each corner vertex is stored.
+    ///
+    /// The node layout is compact, so that deep trees fit in memory:
+    /// - the eight children are allocated together as one block, which may be shared
+    ///   copy-on-write with other trees, see unshare_children(),
+    /// - corner positions and the bounding-box are computed from center and scale,
+    /// - the distance field is stored as 16-bit fixed point relative to the node scale,
+    ///   clamped to a narrow band of +/- band*scale around the surface,
+    /// - state, index, depth and valid-flags are packed in bit-fields,
+    /// - the color is a material index into the Palette of the Octree,
+    /// - the vertex set is only allocated for nodes that produce vertices,
+    /// - an undecided leaf may store the bottom levels of the tree below it as a Brick,
+    /// - the sub-tree below a node may be paged out to a file, see page_out().
     class Octnode
     {
     public:
@@ -49,15 +70,22 @@ namespace cutsim
             OUTSIDE,
             UNDECIDED
         };
-        NodeState state;      ///< the current state of this node
-        NodeState prev_state; ///< previous state of this node
-        Color color;          /// the color of this node
 
-        /// create suboctant idx of parent with scale nodescale and depth nodedepth
-        Octnode(Octnode *parent, unsigned int idx, float nodescale, unsigned int nodedepth, GLData *g);
-        virtual ~Octnode();
+        /// create a root node with the given center and scale
+        Octnode(const GLVertex &nodecenter, float nodescale);
+        ~Octnode();
         /// create all eight children of this node
         void subdivide();
+        /// mark an undecided leaf that is coarser than the tree, after Octree::coarsen(), under a depth
+        /// or memory limit, or where its distance field is linear. Its children or Brick are
+        /// interpolated from its corners, instead of starting from the prev_node_state.
+        void set_coarse()
+        {
+            if (isLeaf() && is_undecided())
+                prev_node_state = UNDECIDED;
+        }
+        /// true for a leaf marked by set_coarse()
+        bool is_coarse() const { return isLeaf() && is_undecided() && prev_node_state == UNDECIDED; }
         /// for subdivision even though state is not undecided. called/used from Octree::init()
         void force_subdivide()
         { // this is only called from octree-init..
@@ -65,18 +93,102 @@ namespace cutsim
             subdivide();
         }
         // BOOLEAN OPS
-        void sum(const Volume *vol);       ///< sum Volume to this Octnode
-        void diff(const Volume *vol);      ///< diff Volume from this Octnode
-        void intersect(const Volume *vol); ///< intersect this Octnode with given Volume
+        // corners that the Volume changes get the given material index.
+        // With a DistCache the distances are looked up on the octree lattice.
+        // All three return the number of Volume::dist() evaluations.
+        int sum(const Volume *vol, unsigned char m, DistCache *cache);       ///< sum Volume to this Octnode
+        int diff(const Volume *vol, unsigned char m, DistCache *cache);      ///< diff Volume from this Octnode
+        int intersect(const Volume *vol, unsigned char m, DistCache *cache); ///< intersect this Octnode with given Volume
+        // LINEARITY CHECKS of an undecided leaf after the operation, with the corners before it.
+        // linear is set if the distance field that the children of the leaf would get is within
+        // tolerance of the interpolation of the corners, at the center, face centers and edge midpoints.
+        // All three return the number of Volume::dist() evaluations.
+        int linear_sum(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache, bool &linear) const;
+        int linear_diff(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache, bool &linear) const;
+        int linear_intersect(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache, bool &linear) const;
+        // BOOLEAN OPS on the Brick, which is created for a leaf that has none.
+        // These update the samples near the Volume, and the corners and state of the node.
+        int brick_sum(const Volume *vol, unsigned char m, DistCache *cache);       ///< sum Volume to the Brick
+        int brick_diff(const Volume *vol, unsigned char m, DistCache *cache);      ///< diff Volume from the Brick
+        int brick_intersect(const Volume *vol, unsigned char m, DistCache *cache); ///< intersect the Brick with given Volume
 
-        bool is_inside() { return (state == INSIDE); }
-        bool is_outside() { return (state == OUTSIDE); }
-        bool is_undecided() { return (state == UNDECIDED); }
+        NodeState state() const { return (NodeState)node_state; } ///< the current state of this node
+        bool is_inside() const { return (node_state == INSIDE); }
+        bool is_outside() const { return (node_state == OUTSIDE); }
+        bool is_undecided() const { return (node_state == UNDECIDED); }
 
         /// return true if all children of this node in given state s
         bool all_child_state(NodeState s) const;
-        /// delete all children of this node
-        void delete_children();
+        /// delete all children of this node, and the GLData vertices they created
+        void delete_children(GLData *g);
+        /// delete the whole sub-tree below this node, and the GLData vertices it created
+        void collapse(GLData *g);
+
+        // STRUCTURAL SHARING
+        // A block of children is reference counted, and shared by the trees forked from one
+        // another, see Octree::fork(). The nodes of a shared block are never written, a tree
+        // copies the block with unshare_children() before it changes any of the children.
+        // The mesh state of the nodes in a block, i.e. the vertex sets and valid-flags, belongs
+        // to the GLData that owns the block, and means nothing to the other trees.
+        /// make the children block exclusive to this node and owned by g, copying it if it is shared.
+        /// call before writing to the children.
+        void unshare_children(GLData *g);
+        /// true if the children block is shared with another tree
+        bool children_shared() const;
+        /// true if the mesh state of this node belongs to g, i.e. g owns its block
+        bool owned(const GLData *g) const;
+        /// true if the mesh state of the children belongs to g
+        bool children_owned(const GLData *g) const;
+        /// make this root node a copy of src that shares the children of src, without mesh state
+        void share(const Octnode &src);
+        /// let go of the children block, removing the GLData vertices of the sub-tree if clear_gl is true.
+        /// The block is deleted when no other tree shares it.
+        void release_children(GLData *g, bool clear_gl);
+        /// memory of one block of children, including its reference count
+        static std::size_t block_bytes();
+
+        // CHECKPOINT, see Checkpoint for the format
+        /// write the distance field, material, state and Brick of this node
+        void save(CheckpointWriter &out) const;
+        /// read what save() wrote into this node of a tree without GLData. The children are
+        /// created if they follow and this node has none, or deleted if they do not follow.
+        /// The children are read by further calls. false if the data ends or is not a node.
+        bool load(CheckpointReader &in);
+
+        // PAGING, see Octree::page_out()
+        // A paged node keeps its distance field, state and vertices, and is a leaf until
+        // page_in() reads its children back. Like a block of children, a Page is shared by the
+        // trees forked from one another, and a tree pages in before it changes the children.
+        /// true if the children of this node are in a Page instead of in nodes
+        bool is_paged() const { return paged; }
+        /// true if the children of this node are in a Page packed in memory
+        bool is_packed() const;
+        /// write the sub-tree below this node to a Page of pager, or with a NULL pager pack it to a
+        /// Page in memory, and release the children. The vertices of g in the sub-tree move to the
+        /// vertex set of this node. A node with a Page in memory moves the Page to pager.
+        /// false, with nothing changed, on a write error or if the sub-tree holds a paged node.
+        bool page_out(const std::shared_ptr<Pager> &pager, GLData *g);
+        /// read the children of a paged node back from its Page. If this node is valid and holds
+        /// the vertices of g in the sub-tree, the nodes get their vertices and valid-flags back,
+        /// otherwise they need meshing. false on a read error, which leaves the node paged.
+        bool page_in(GLData *g);
+        /// write the sub-tree in the Page as save() would write it, with a mark before each node
+        /// as in a delta if marks is true. false on a read error.
+        bool save_page(CheckpointWriter &out, bool marks) const;
+        /// bytes of the packed Page, in the file or in memory, 0 if this node is not paged
+        std::size_t page_bytes() const;
+        /// memory of the blocks of children, the Bricks and the Pages in memory of all trees
+        static std::size_t resident_bytes();
+
+        // CHANGE TRACKING, for delta checkpoints, see Octree::save_delta().
+        // An operation stamps the nodes it changes, and all their ancestors, with the epoch
+        // of its tree. New children take the stamp of their parent. The stamps are set
+        // during a traversal from the root, as the parent pointers of nodes in a block that
+        // was shared may be stale.
+        /// the epoch of the last change of this node, modulo 256
+        unsigned int epoch() const { return change_epoch; }
+        /// stamp this node as changed in epoch e
+        void set_epoch(unsigned int e) { change_epoch = e; }
 
         // manipulate the valid-flag
         /// set valid-flag true
@@ -86,31 +198,60 @@ namespace cutsim
         /// true if the GLData for this node is valid
         bool valid() const;
 
-        /// true if this node has child n
-        inline bool hasChild(int n) { return (this->child[n] != NULL); }
-        /// true if this node has no children
-        inline bool isLeaf() { return (childcount == 0); }
+        // the touched-flag gives deferred pruning its hysteresis, see Octree::prune()
+        /// mark this node as recently cut
+        void touch() { touched = true; }
+        /// true if this node was cut since clear_touched()
+        bool was_touched() const { return touched; }
+        /// clear the touched-flag
+        void clear_touched() { touched = false; }
+
+        /// true if this node has no children in memory, a paged node is a leaf until page_in()
+        inline bool isLeaf() const { return brick_leaf || paged || (children == NULL); }
+        /// true if this leaf stores a Brick
+        inline bool hasBrick() const { return brick_leaf; }
+        /// the Brick of a node with hasBrick()
+        inline const Brick *getBrick() const { return brick; }
+        /// value of the distance-field at sample s of the Brick
+        inline float brick_f(int s) const { return brick->f[s] * (band * scale / (Brick::cells * 32767)); }
+        /// position of sample (i,j,k) of the Brick
+        inline GLVertex brick_vertex(int i, int j, int k) const
+        {
+            float h = 2 * scale / Brick::cells;
+            return GLVertex(cx - scale + i * h, cy - scale + j * h, cz - scale + k * h);
+        }
+        /// delete the Brick, the node keeps its corners and state
+        void delete_brick();
+        /// child n of a node that is not a leaf
+        inline Octnode *child(int n) const { return children + n; }
+        /// the tree-depth of this node
+        inline unsigned int depth() const { return node_depth; }
+        /// the index of this node [0,7]
+        inline unsigned int idx() const { return index; }
+        /// the center point of this node
+        inline GLVertex center() const { return GLVertex(cx, cy, cz); }
+        /// corner vertex n of this node
+        inline GLVertex vertex(int n) const { return GLVertex(cx + direction[n].x * scale, cy + direction[n].y * scale, cz + direction[n].z * scale); }
+        /// bounding-box corresponding to this node
+        inline Bbox bbox() const { return Bbox(cx - scale, cx + scale, cy - scale, cy + scale, cz - scale, cz + scale); }
+        /// value of distance-field at corner vertex n
+        inline float f(int n) const { return fq[n] * (band * scale / 32767); }
+        /// set the distance-field at corner vertex n, clamped to the narrow band
+        inline void set_f(int n, float value) { fq[n] = quantize(value); }
+        /// copy the fixed-point distance-field at the corners
+        inline void get_corners(int16_t q[8]) const { std::copy(fq, fq + 8, q); }
+        /// set the fixed-point distance-field at the corners, leaving the state as it is
+        inline void set_corners(const int16_t q[8]) { std::copy(q, q + 8, fq); }
+        /// the material index of this node, see Palette
+        inline unsigned char material() const { return mat; }
+        /// set the material index of this node
+        inline void setMaterial(unsigned char m) { mat = m; }
+        /// the material index at point p of this leaf, from the Brick cell that contains p
+        unsigned char material_at(const GLVertex &p) const;
+
         // DATA
-        /// pointers to child nodes
-        Octnode *child[8];
         /// pointer to parent node
         Octnode *parent;
-        /// number of children
-        unsigned int childcount;
-        /// The eight corners of this node
-        GLVertex *vertex[8];
-        /// value of distance-field at corner vertex
-        float f[8];
-        /// the center point of this node
-        GLVertex *center; // the centerpoint of this node
-        /// the tree-dept of this node
-        unsigned int depth; // depth of node
-        /// the index of this node [0,7]
-        unsigned int idx; // index of node
-        /// the scale of this node, i.e. distance from center out to corner vertices
-        float scale; // distance from center to vertices
-        /// bounding-box corresponding to this node
-        Bbox bb;
 
         // for manipulating vertexSet
         /// add id to the vertex set
@@ -121,11 +262,13 @@ namespace cutsim
         /// remove given id from vertex set
         void removeIndex(unsigned int id);
         /// is the vertex set empty?
-        bool vertexSetEmpty() { return vertexSet.empty(); }
-        /// return begin() for vertex set
-        unsigned int vertexSetTop() { return *(vertexSet.begin()); }
-        /// remove all vertices associated with this node. calls GLData to also remove nodes
-        void clearVertexSet();
+        bool vertexSetEmpty() const { return !vertexSet || vertexSet->empty(); }
+        /// number of vertex ids in the vertex set
+        std::size_t vertexSetSize() const { return vertexSet ? vertexSet->size() : 0; }
+        /// heap memory used by the vertex set
+        std::size_t vertexSetBytes() const { return vertexSet ? sizeof(*vertexSet) + vertexSet->capacity() * sizeof(unsigned int) : 0; }
+        /// remove all vertices associated with this node from the GLData
+        void clearVertexSet(GLData *g);
 
         // string output
         friend std::ostream &operator<<(std::ostream &stream, const Octnode &o);
@@ -137,6 +280,9 @@ namespace cutsim
         /// set node to undecided
         void setUndecided();
 
+        /// the distance field is clamped to +/- band*scale
+        static const int band = 4;
+
     protected:
         /// based on the f[]-values at the corners of this node, set the state to one of inside, outside, or undecided.
         void set_state();
@@ -149,20 +295,85 @@ namespace cutsim
         void setChildValid(unsigned int id);
         /// set the given child to invalid
         inline void setChildInvalid(unsigned int id);
+        /// distance from vol to corner n, through the cache if there is one
+        inline float corner_dist(const Volume *vol, int n, DistCache *cache) const
+        {
+            return cache ? cache->dist(vol, vertex(n)) : vol->dist(vertex(n));
+        }
+        /// allocate a block of eight uninitialized children, not shared and owned by g
+        static Octnode *alloc_block(const GLData *g);
+        /// delete the nodes of a block that no tree refers to any more
+        static void free_block(Octnode *block, GLData *g, bool clear_gl);
+        /// give up the mesh state of g in the sub-tree at a shared block
+        static void drop_mesh(Octnode *block, GLData *g, bool clear_gl);
+        /// remove the vertices in set from g
+        static void remove_vertices(std::vector<unsigned int> *set, GLData *g);
+        /// add a reference to a block, so that it outlives release_children(), see Journal
+        static void hold_block(Octnode *block);
+        /// remove a reference added by hold_block(), deleting the block if it was the last.
+        /// The block must not hold the mesh state of any GLData.
+        static void drop_block(Octnode *block);
+        /// remove a reference to a Page, releasing it in its file if it was the last
+        static void drop_page(Page *p);
+        /// copy the geometry of src and share its children. the mesh state is copied if mesh is true.
+        void copy_from(const Octnode &src, bool mesh);
+        /// fixed-point value of a distance at this node scale. negative distances stay negative.
+        inline int16_t quantize(float value) const { return quantize(value, 32767 / (band * scale)); }
+        /// fixed-point value of a distance, for the given factor of 32767/(band*scale)
+        static inline int16_t quantize(float value, float factor)
+        {
+            float q = value * factor;
+            if (q >= 0)
+                return (q >= 32767) ? 32767 : (int16_t)(q + 0.5f);
+            return (q <= -32767) ? -32767 : (int16_t)std::min(-1.0f, q - 0.5f);
+        }
+
+        /// create the Brick of this leaf, filled with the prev_node_state, as for new children
+        void make_brick();
+        /// trilinear interpolation of the corners at (u,v,w), from -1 to 1 across the node
+        float interpolate(float u, float v, float w) const { return interpolate(fq, u, v, w) * (band * scale / 32767); }
+        /// trilinear interpolation of the fixed-point corners q at (u,v,w)
+        static float interpolate(const int16_t *q, float u, float v, float w);
+        /// the field of the children of this leaf after combine(before, sign*dist), see linear_sum()
+        template <class Combine>
+        int check_linear(const Volume *vol, const int16_t *before, float tolerance, DistCache *cache,
+                         float sign, Combine combine, bool &linear) const;
+        /// apply combine(f, sign*dist) to the samples of the Brick near the Volume,
+        /// or to all samples if whole is true. returns the number of Volume::dist() evaluations.
+        template <class Combine>
+        int brick_op(const Volume *vol, unsigned char m, DistCache *cache, float sign, bool whole, Combine combine);
 
-        /// the vertex indices that this node has produced.
+        union
+        {
+            /// the eight children, allocated as one reference counted block. NULL for a leaf.
+            Octnode *children;
+            /// the Brick of a leaf with brick_leaf set
+            Brick *brick;
+            /// the sub-tree of a node with paged set
+            Page *page;
+        };
+        /// the vertex indices that this node has produced, allocated on first use.
         /// These correspond to vertex id's in the GLData vertexArray.
-        std::set<unsigned int> vertexSet;
-        /// return center of child with index n
-        GLVertex *childcenter(int n); // return position of child center
-        /// The GLData, i.e. vertices and polygons, associated with this node
-        /// when this node is deleted we notify the GLData that vertices should be removed
-        GLData *g;
-        /// flag for telling isosurface extraction is valid for this node
-        /// if false, the node needs updating.
-        bool isosurface_valid;
-        /// bit-field indicating if children have valid gldata
-        char childStatus;
+        std::vector<unsigned int> *vertexSet;
+        float cx; ///< center x
+        float cy; ///< center y
+        float cz; ///< center z
+        /// the scale of this node, i.e. distance from center out to corner vertices
+        float scale;
+        /// distance-field at the corners, in units of band*scale/32767
+        int16_t fq[8];
+        /// material index of the Volume that last changed this node, see Palette
+        uint8_t mat;
+        unsigned int node_state : 2;       ///< the current NodeState of this node
+        unsigned int prev_node_state : 2;  ///< previous NodeState of this node
+        unsigned int index : 3;            ///< the index of this node [0,7]
+        unsigned int node_depth : 5;       ///< the tree-depth of this node
+        unsigned int isosurface_valid : 1; ///< false if the isosurface of this node needs updating
+        unsigned int childStatus : 8;      ///< bit-field indicating if children have valid gldata
+        unsigned int touched : 1;          ///< true if a prune of this node was deferred since the last prune pass
+        unsigned int brick_leaf : 1;       ///< true for a leaf that stores a Brick instead of children
+        unsigned int change_epoch : 8;     ///< the epoch of the last change, see set_epoch()
+        unsigned int paged : 1;            ///< true for a node whose children are in a Page
 
         // STATIC
         /// the direction to the vertices, from the center
@@ -171,7 +382,14 @@ namespace cutsim
         static const int octant[8];
 
     private:
+        friend class Journal; // records and reverts the nodes
         Octnode() {}
+        /// initialize this node as child idx of nodeparent
+        void init_child(Octnode *nodeparent, unsigned int idx);
+        /// initialize the position of this node as child idx of nodeparent, as a leaf without distance field
+        void place_child(Octnode *nodeparent, unsigned int idx);
+        Octnode(const Octnode &);
+        Octnode &operator=(const Octnode &);
     };
 
 } // end namespace
@@ -21,12 +21,20 @@
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 
 #include <boost/foreach.hpp>
 
 #include "octree.hpp"
 #include "octnode.hpp"
 #include "volume.hpp"
+#include "traversal.hpp"
+#include "distcache.hpp"
+#include "journal.hpp"
+#include "checkpoint.hpp"
+#include "pager.hpp"
+#include "trace.hpp"
 
 namespace cutsim
 {
@@ -39,18 +47,27 @@ namespace cutsim
         max_depth = depth;
         g = gl;
         // parent, idx, scale, depth
-        root = new Octnode(NULL, 0, root_scale, 0, g);
-        root->center = new GLVertex(centerp);
-        for (int n = 0; n < 8; ++n)
-        {
-            root->child[n] = NULL;
-        }
+        root = new Octnode(centerp, root_scale);
         debug = false;
         debug_mc = false;
+        lazy_prune = false;
+        pending = 0;
+        max_pending = 0;
+        dist_cache = NULL;
+        brick_depth = 0;
+        depth_limit = depth;
+        memory_limit = 0;
+        refine_tolerance = 0;
+        journal = NULL;
+        undo_depth = 0;
+        epoch = 0;
     }
 
     Octree::~Octree()
     {
+        delete dist_cache;
+        delete journal;
+        root->release_children(g, false); // the vertex sets go, the GLData may already be gone
         delete root;
         root = 0;
     }
@@ -73,6 +90,9 @@ namespace cutsim
     /// subdivide the Octree n times
     void Octree::init(const unsigned int n)
     {
+        if (journal)
+            journal->clear();
+        page_in(); // a paged node is no leaf to subdivide
         for (unsigned int m = 0; m < n; ++m)
         {
             std::vector<Octnode *> nodelist;
@@ -83,6 +103,19 @@ namespace cutsim
             }
         }
     }
+
+    void Octree::clear()
+    {
+        if (journal)
+            journal->clear();
+        root->collapse(g);
+        root->clearVertexSet(g);
+        Octnode *empty = new Octnode(root->center(), root_scale);
+        delete root;
+        root = empty;
+        cuts.clear();
+    }
+
     /*
 void Octree::get_invalid_leaf_nodes( std::vector<Octnode*>& nodelist) const {
     get_invalid_leaf_nodes( root, nodelist );
@@ -105,22 +138,46 @@ void Octree::get_invalid_leaf_nodes(Octnode* current, std::vector<Octnode*>& nod
     }
 } */
 
-    /// put leaf nodes into nodelist
-
-    void Octree::get_leaf_nodes(Octnode *current, std::vector<Octnode *> &nodelist) const
+    namespace
     {
-        if (current->isLeaf())
+        /// collects the leaf nodes of a tree
+        struct LeafVisitor
         {
-            nodelist.push_back(current);
-        }
-        else
-        {
-            for (int n = 0; n < 8; ++n)
+            std::vector<Octnode *> &nodelist;
+            bool pre(Octnode *current)
             {
-                if (current->child[n] != 0)
-                    get_leaf_nodes(current->child[n], nodelist);
+                if (current->isLeaf())
+                    nodelist.push_back(current);
+                return true;
             }
+            void post(Octnode *) {}
+        };
+    } // end anonymous namespace
+
+    Octnode *Octree::find_leaf(const GLVertex &p) const
+    {
+        Bbox bb = root->bbox();
+        if (p.x < bb.minpt.x || p.x > bb.maxpt.x || p.y < bb.minpt.y || p.y > bb.maxpt.y || p.z < bb.minpt.z || p.z > bb.maxpt.z)
+            return NULL;
+        Octnode *current = root;
+        while (!current->isLeaf())
+        { // the child in the octant of p is the one whose center is on the same side as p
+            GLVertex c = current->center();
+            int n = 0;
+            while (n < 7 && ((p.x < c.x) != (current->child(n)->center().x < c.x) ||
+                             (p.y < c.y) != (current->child(n)->center().y < c.y) ||
+                             (p.z < c.z) != (current->child(n)->center().z < c.z)))
+                ++n;
+            current = current->child(n);
         }
+        return current;
+    }
+
+    /// put leaf nodes into nodelist
+    void Octree::get_leaf_nodes(Octnode *current, std::vector<Octnode *> &nodelist) const
+    {
+        LeafVisitor visitor = {nodelist};
+        traverse(current, visitor);
     }
 
     /// put all nodes into nodelist
@@ -135,132 +192,854 @@ void Octree::get_all_nodes(Octnode* current, std::vector<Octnode*>& nodelist) co
     }
 }*/
 
-    // sum (union) of tree and OCTVolume
-    void Octree::sum(Octnode *current, const Volume *vol)
+    namespace
     {
-        if (!vol->bb.overlaps(current->bb) || current->is_inside()) // if no overlap, or already INSIDE, then quit.
-            return;                                                 // abort if no overlap.
+        /// common part of the sum, diff and intersect visitors
+        struct OpVisitor
+        {
+            const Volume *vol;
+            unsigned char material;
+            unsigned int max_depth; ///< the depth to subdivide to, see Octree::set_depth_limit()
+            bool limited;           ///< true if max_depth is under the depth of the tree
+            OpStats &stats;
+            GLData *g;
+            bool lazy_prune;
+            std::size_t &pending;
+            DistCache *cache;
+            unsigned int brick_depth;
+            /// the brick operation of the visitor, Octnode::brick_sum, brick_diff or brick_intersect
+            int (Octnode::*brick_op)(const Volume *, unsigned char, DistCache *);
+            /// the linearity check of the visitor, Octnode::linear_sum, linear_diff or linear_intersect
+            int (Octnode::*linear_op)(const Volume *, const int16_t *, float, DistCache *, bool &) const;
+            Journal *journal;
+            unsigned int epoch;
+            std::size_t memory_limit; ///< no new nodes or Bricks over this, 0 for no limit, see Octree::set_memory_limit()
+            float tolerance;          ///< no new nodes or Bricks in a linear leaf, see Octree::set_refine_tolerance()
+            int16_t before[8];        ///< the corners of the node that descend() gets, before the operation
 
-        current->sum(vol);
-        if ((current->childcount == 8) && current->is_undecided())
-        { // recurse into existing tree
-            for (int m = 0; m < 8; ++m)
+            /// stamp current as changed and record it in the undo journal, before the operation changes it.
+            /// The ancestors of current were stamped on the way down.
+            void save(Octnode *current)
             {
-                if (!current->child[m]->is_inside()) // nodes that are already INSIDE cannot change in a sum-operation
-                    sum(current->child[m], vol);     // call sum on children
+                current->set_epoch(epoch);
+                if (journal)
+                    journal->record(current);
+                current->get_corners(before);
             }
-        }
-        else if (current->is_undecided())
-        { // no children, subdivide if undecided
-            if ((current->depth < (this->max_depth - 1)))
+            /// keep the children of current in the undo journal, before they are released or copied
+            void keep(Octnode *current)
             {
-                current->subdivide(); // smash into 8 sub-pieces
-                for (int m = 0; m < 8; ++m)
-                    sum(current->child[m], vol); // call sum on children
+                if (journal)
+                    journal->keep(current);
             }
-        }
-        // now all children of current have their status set, and we can prune.
-        if ((current->childcount == 8) && (current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE)))
+
+            /// count the Volume::dist() evaluations of one node
+            void count_dist(int evaluations) { CUTSIM_STAT(stats.dist_calls += evaluations); }
+            /// apply the operation to the Brick of current, the Brick replaces the levels below
+            bool brick(Octnode *current)
+            {
+                count_dist((current->*brick_op)(vol, material, cache));
+                return false;
+            }
+            /// descend into existing children of an undecided node, or subdivide an undecided leaf
+            bool descend(Octnode *current)
+            {
+                if (!current->isLeaf() && current->is_undecided())
+                { // recurse into existing tree
+                    if (current->children_shared())
+                        keep(current);
+                    current->unshare_children(g);
+                    return true;
+                }
+                bool at_brick = brick_depth && current->depth() == brick_depth;
+                bool refine = current->is_undecided() && (at_brick || current->depth() < (max_depth - 1));
+                if (refine && memory_limit && Octnode::resident_bytes() > memory_limit)
+                { // the leaf stays as coarse as it is
+                    current->set_coarse();
+                    post(current);
+                    return false;
+                }
+                if (refine && tolerance > 0)
+                {
+                    bool linear;
+                    count_dist((current->*linear_op)(vol, before, tolerance, cache, linear));
+                    if (linear)
+                    { // the children would give the same surface
+                        current->set_coarse();
+                        CUTSIM_STAT(++stats.linear);
+                        post(current);
+                        return false;
+                    }
+                }
+                if (refine && current->is_coarse())
+                { // the children or Brick of a coarse leaf start from its corners before the operation
+                    int16_t after[8];
+                    current->get_corners(after);
+                    current->set_corners(before);
+                    if (at_brick)
+                        return brick(current); // the Brick sets the corners again
+                    current->subdivide();
+                    current->set_corners(after);
+                    CUTSIM_STAT(++stats.subdivisions);
+                    return true;
+                }
+                if (refine && at_brick)
+                    return brick(current); // an undecided leaf at brick_depth gets a Brick instead of children
+                if (refine)
+                { // no children, subdivide if undecided
+                    current->subdivide(); // smash into 8 sub-pieces
+                    CUTSIM_STAT(++stats.subdivisions);
+                    return true;
+                }
+                if (limited)
+                    current->set_coarse();
+                post(current);
+                return false;
+            }
+            /// now all children of current have their status set, and we can prune.
+            void post(Octnode *current)
+            {
+                if (!current->isLeaf() && (current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE)))
+                {
+                    if (lazy_prune)
+                    { // leave it to Octree::prune()
+                        if (!current->was_touched())
+                            ++pending;
+                        current->touch();
+                        return;
+                    }
+                    keep(current);
+                    current->delete_children(g);
+                    CUTSIM_STAT(++stats.prunes);
+                }
+            }
+        };
+
+        /// sum (union) of tree and Volume
+        struct SumVisitor : public OpVisitor
+        {
+            bool pre(Octnode *current)
+            {
+                CUTSIM_STAT(++stats.nodes_visited);
+                if (current->is_inside()) // already INSIDE, then quit.
+                    return false;
+                Volume::Overlap overlap = vol->classify(current->bbox());
+                if (overlap == Volume::OUTSIDE) // nothing to add
+                    return false;
+                if (!current->page_in(g)) // the paged children are about to change
+                    return false;
+                save(current);
+                if (overlap == Volume::INSIDE)
+                { // all of the node becomes material, no need to subdivide
+                    keep(current);
+                    current->collapse(g);
+                    count_dist(current->sum(vol, material, cache));
+                    CUTSIM_STAT(++stats.classified);
+                    return false;
+                }
+                if (current->hasBrick()) // the Brick has the corners and state of the node
+                    return brick(current);
+                count_dist(current->sum(vol, material, cache));
+                // the surface crosses the node even if no corner is inside, so subdivide it
+                if (vol->exact_classify() && current->depth() < (max_depth - 1))
+                    current->setUndecided();
+                return descend(current);
+            }
+        };
+
+        /// diff Volume from tree
+        struct DiffVisitor : public OpVisitor
         {
-            current->delete_children();
+            bool pre(Octnode *current)
+            {
+                CUTSIM_STAT(++stats.nodes_visited);
+                if (current->is_outside()) // already OUTSIDE, then quit.
+                    return false;
+                Volume::Overlap overlap = vol->classify(current->bbox());
+                if (overlap == Volume::OUTSIDE) // nothing to remove
+                    return false;
+                if (!current->page_in(g)) // the paged children are about to change
+                    return false;
+                save(current);
+                if (overlap == Volume::INSIDE)
+                { // all material of the node is removed, no need to subdivide
+                    keep(current);
+                    current->collapse(g);
+                    count_dist(current->diff(vol, material, cache));
+                    CUTSIM_STAT(++stats.classified);
+                    return false;
+                }
+                if (current->hasBrick()) // the Brick has the corners and state of the node
+                    return brick(current);
+                count_dist(current->diff(vol, material, cache));
+                if (vol->bb.overlaps(current->bbox()))
+                    current->setUndecided();
+                return descend(current);
+            }
+        };
+
+        /// intersect tree with Volume
+        struct IntersectVisitor : public OpVisitor
+        {
+            bool pre(Octnode *current)
+            {
+                CUTSIM_STAT(++stats.nodes_visited);
+                if (current->is_outside()) // if already OUTSIDE, then quit.
+                    return false;
+                Volume::Overlap overlap = vol->classify(current->bbox());
+                if (overlap == Volume::INSIDE) // nothing to remove
+                    return false;
+                if (!current->page_in(g)) // the paged children are about to change
+                    return false;
+                save(current);
+                if (overlap == Volume::OUTSIDE)
+                { // all material of the node is removed, no need to subdivide
+                    keep(current);
+                    current->collapse(g);
+                    count_dist(current->intersect(vol, material, cache));
+                    CUTSIM_STAT(++stats.classified);
+                    return false;
+                }
+                if (current->hasBrick()) // the Brick has the corners and state of the node
+                    return brick(current);
+                count_dist(current->intersect(vol, material, cache));
+                return descend(current);
+            }
+        };
+    } // end anonymous namespace
+
+    DistCache *Octree::start_op(const Volume *vol)
+    {
+        DistCache *cache = vol->expensive_dist() ? dist_cache : NULL;
+        if (cache)
+            cache->next_op();
+        if (undo_depth && !journal)
+            journal = new Journal(undo_depth, g);
+        if (journal)
+            journal->next_op(epoch);
+        return cache;
+    }
+
+    void Octree::sum(Octnode *current, const Volume *vol, unsigned char material)
+    {
+        DistCache *cache = start_op(vol);
+        SumVisitor visitor = {{vol, material, depth_limit, depth_limit < max_depth, stats, g, lazy_prune, pending, cache, new_brick_depth(), &Octnode::brick_sum, &Octnode::linear_sum, journal, stamp(), memory_limit, refine_tolerance}};
+        traverse(current, visitor);
+        check_pending();
+    }
+
+    void Octree::diff(Octnode *current, const Volume *vol, unsigned char material)
+    {
+        DistCache *cache = start_op(vol);
+        DiffVisitor visitor = {{vol, material, depth_limit, depth_limit < max_depth, stats, g, lazy_prune, pending, cache, new_brick_depth(), &Octnode::brick_diff, &Octnode::linear_diff, journal, stamp(), memory_limit, refine_tolerance}};
+        traverse(current, visitor);
+        check_pending();
+    }
+
+    void Octree::intersect(Octnode *current, const Volume *vol, unsigned char material)
+    {
+        DistCache *cache = start_op(vol);
+        IntersectVisitor visitor = {{vol, material, depth_limit, depth_limit < max_depth, stats, g, lazy_prune, pending, cache, new_brick_depth(), &Octnode::brick_intersect, &Octnode::linear_intersect, journal, stamp(), memory_limit, refine_tolerance}};
+        traverse(current, visitor);
+        check_pending();
+    }
+
+    namespace
+    {
+        /// prunes nodes whose children are all INSIDE or all OUTSIDE leaves
+        struct PruneVisitor
+        {
+            GLData *g;
+            bool force;
+            OpStats &stats;
+            Journal *journal; // the prunes are undone with the most recent operation
+            unsigned int epoch;
+            std::size_t pruned;
+            /// per level of the nodes descended into, true if a node below was pruned
+            bool below[32];
+            unsigned int levels;
+            // the nodes of a shared block are not written, they were pruned before they were shared
+            bool pre(Octnode *current)
+            {
+                if (current->isLeaf() || current->children_shared())
+                    return false;
+                below[levels++] = false;
+                return true;
+            }
+            void post(Octnode *current)
+            {
+                // stamp the ancestors of a pruned node, and journal them so that undo() stamps them
+                bool stamped = below[--levels];
+                if (stamped)
+                    changed(current);
+                // children are visited first, so a whole subtree can collapse in one pass
+                for (int n = 0; n < 8; ++n)
+                    if (!current->child(n)->isLeaf() || current->child(n)->is_paged())
+                        return;
+                if (!current->all_child_state(Octnode::INSIDE) && !current->all_child_state(Octnode::OUTSIDE))
+                    return;
+                if (current->was_touched() && !force)
+                { // cut since the last pass, keep it for one more round
+                    current->clear_touched();
+                    return;
+                }
+                current->clear_touched();
+                if (!stamped)
+                    changed(current);
+                if (journal)
+                    journal->keep(current);
+                current->delete_children(g);
+                ++pruned;
+                CUTSIM_STAT(++stats.prunes);
+            }
+            /// stamp and record current, before it or a node below it is pruned
+            void changed(Octnode *current)
+            {
+                current->set_epoch(epoch);
+                if (journal)
+                    journal->record(current);
+                if (levels)
+                    below[levels - 1] = true;
+            }
+        };
+    } // end anonymous namespace
+
+    void Octree::set_bricks(bool on)
+    {
+        if (on && max_depth < 5)
+        {
+            std::cout << " Octree::set_bricks() error: max_depth=" << max_depth << " is too small for bricks\n";
+            return;
         }
+        // the cells of a brick at brick_depth are the leaves at max_depth-1
+        brick_depth = on ? max_depth - 4 : 0;
     }
 
-    void Octree::diff(Octnode *current, const Volume *vol)
+    Octree *Octree::fork(GLData *gl)
     {
-        if (!vol->bb.overlaps(current->bb) || current->is_outside())
+        GLVertex center = root->center();
+        Octree *tree = new Octree(root_scale, max_depth, center, gl);
+        tree->root->share(*root);
+        tree->lazy_prune = lazy_prune;
+        tree->max_pending = max_pending;
+        tree->brick_depth = brick_depth;
+        tree->depth_limit = depth_limit;
+        tree->memory_limit = memory_limit;
+        tree->refine_tolerance = refine_tolerance;
+        tree->set_dist_cache(dist_cache != NULL);
+        tree->set_undo(undo_depth);
+        tree->epoch = epoch;
+        if (journal) // undo() would write to the nodes shared with the fork
+            journal->clear();
+        return tree;
+    }
+
+    bool Octree::restore(const Octree &snapshot)
+    {
+        if (!same_lattice(snapshot))
         {
-            //std::cout << vol->center.x << "," << vol->center.y << "," << vol->center.z << " overlaps? " << vol->bb.overlaps( current->bb ) << "\n";
-            return; // if no overlap, or already OUTSIDE, then quit.
+            std::cout << " Octree::restore() error: the snapshot is of a different tree\n";
+            return false;
         }
+        if (journal)
+            journal->clear();
+        root->collapse(g);
+        root->clearVertexSet(g);
+        root->share(*snapshot.root);
+        epoch = snapshot.epoch;
+        pending = 0;
+        return true;
+    }
 
-        current->diff(vol);
-        if (vol->bb.overlaps(current->bb) || current->bb.overlaps(vol->bb))
-            current->setUndecided();
+    bool Octree::same_lattice(const Octree &other) const
+    {
+        GLVertex c = root->center(), oc = other.root->center();
+        return other.root_scale == root_scale && other.max_depth == max_depth &&
+               oc.x == c.x && oc.y == c.y && oc.z == c.z;
+    }
 
-        if (((current->childcount) == 8) && (current->is_undecided()))
-        { // recurse into existing tree
-            for (int m = 0; m < 8; ++m)
+    namespace
+    {
+        /// writes the nodes of a tree to a checkpoint
+        struct SaveVisitor
+        {
+            CheckpointWriter &out;
+            bool ok;
+            bool pre(Octnode *current)
             {
-                //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-                diff(current->child[m], vol); // call diff on children
+                current->save(out);
+                ok = ok && current->save_page(out, false); // a paged sub-tree is copied from its page
+                return true;
             }
-        }
-        else if ((current->is_undecided()))
-        { // no children, subdivide if undecided
-            if ((current->depth < (this->max_depth - 1)))
+            void post(Octnode *) {}
+        };
+
+        /// reads the nodes of a tree from a checkpoint, in the order of SaveVisitor
+        struct LoadVisitor
+        {
+            CheckpointReader &in;
+            unsigned int max_depth;
+            unsigned int clean; ///< an epoch other than that of the tree
+            bool ok;
+            bool pre(Octnode *current)
             {
-                current->subdivide(); // smash into 8 sub-pieces
-                for (int m = 0; m < 8; ++m)
+                ok = ok && current->load(in) && (current->isLeaf() || current->depth() + 1 < max_depth);
+                current->set_epoch(clean);
+                return ok; // load() created the children that follow
+            }
+            void post(Octnode *) {}
+        };
+
+        /// writes the nodes changed in an epoch, and a mark for each unchanged sub-tree
+        struct DeltaSaveVisitor
+        {
+            CheckpointWriter &out;
+            unsigned int epoch;
+            bool ok;
+            bool pre(Octnode *current)
+            {
+                bool changed = current->epoch() == epoch;
+                out.put((uint8_t)(changed ? Checkpoint::changed : Checkpoint::unchanged));
+                if (changed)
                 {
-                    diff(current->child[m], vol); // call diff on children
+                    current->save(out);
+                    ok = ok && current->save_page(out, true);
                 }
+                return changed;
+            }
+            void post(Octnode *) {}
+        };
+
+        /// applies the changes written by DeltaSaveVisitor, in the same order
+        struct DeltaLoadVisitor
+        {
+            CheckpointReader &in;
+            unsigned int max_depth;
+            unsigned int clean; ///< an epoch other than that of the tree
+            bool ok;
+            bool pre(Octnode *current)
+            {
+                const char *mark = ok ? in.next(1) : NULL;
+                ok = mark && (*mark == Checkpoint::unchanged || *mark == Checkpoint::changed);
+                if (!ok || *mark == Checkpoint::unchanged)
+                    return false;
+                ok = current->load(in) && (current->isLeaf() || current->depth() + 1 < max_depth);
+                current->set_epoch(clean);
+                current->unshare_children(NULL); // the records of the children follow
+                return ok;
             }
+            void post(Octnode *) {}
+        };
+    } // end anonymous namespace
+
+    bool Octree::save(CheckpointWriter &out) const
+    {
+        SaveVisitor visitor = {out, true};
+        traverse(root, visitor);
+        return visitor.ok;
+    }
+
+    bool Octree::load(CheckpointReader &in)
+    {
+        clear();
+        LoadVisitor visitor = {in, max_depth, (stamp() + 255) & 255, true};
+        traverse(root, visitor);
+        pending = 0;
+        if (!visitor.ok)
+        {
+            std::cout << " Octree::load() error: the checkpoint data is damaged\n";
+            clear();
         }
+        return visitor.ok;
+    }
 
-        // now all children have their status set, prune.
-        if ((current->childcount == 8) && (current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE)))
+    bool Octree::save_delta(CheckpointWriter &out) const
+    {
+        DeltaSaveVisitor visitor = {out, stamp(), true};
+        traverse(root, visitor);
+        return visitor.ok;
+    }
+
+    bool Octree::load_delta(CheckpointReader &in)
+    {
+        DeltaLoadVisitor visitor = {in, max_depth, (stamp() + 255) & 255, true};
+        traverse(root, visitor);
+        pending = 0;
+        if (!visitor.ok)
+            std::cout << " Octree::load_delta() error: the checkpoint data is damaged\n";
+        return visitor.ok;
+    }
+
+    void Octree::next_epoch()
+    {
+        ++epoch;
+    }
+
+    void Octree::set_undo(std::size_t depth)
+    {
+        delete journal;
+        journal = NULL; // made by the first operation, so that snapshots have none
+        undo_depth = depth;
+    }
+
+    bool Octree::undo()
+    {
+        return journal && journal->undo(epoch);
+    }
+
+    std::size_t Octree::undo_steps() const
+    {
+        return journal ? journal->steps() : 0;
+    }
+
+    void Octree::set_dist_cache(bool on)
+    {
+        if (on && !dist_cache)
         {
-            current->delete_children();
+            dist_cache = new DistCache();
+            dist_cache->set_lattice(root->center(), root_scale, max_depth);
+        }
+        else if (!on)
+        {
+            delete dist_cache;
+            dist_cache = NULL;
         }
     }
 
-    void Octree::intersect(Octnode *current, const Volume *vol)
+    void Octree::set_lazy_prune(bool lazy, std::size_t max)
     {
-        if (current->is_outside()) // if already OUTSIDE, then quit.
-            return;
+        lazy_prune = lazy;
+        max_pending = max;
+        if (!lazy)
+            prune(true);
+    }
+
+    std::size_t Octree::prune(bool force)
+    {
+        TraceScope trace("prune");
+        PruneVisitor visitor = {g, force, stats, journal, stamp(), 0, {}, 0};
+        traverse(root, visitor);
+        pending = 0;
+        return visitor.pruned;
+    }
 
-        current->intersect(vol);
-        if (((current->childcount) == 8) && current->is_undecided())
-        { // recurse into existing tree
-            for (int m = 0; m < 8; ++m)
+    void Octree::check_pending()
+    {
+        if (lazy_prune && max_pending && pending > max_pending)
+            prune();
+    }
+
+    namespace
+    {
+        /// finds the nodes at page depth with a sub-tree in memory
+        struct PageCandidateVisitor
+        {
+            std::vector<Octnode *> &nodes;
+            unsigned int depth;
+            // the nodes below a shared block are shared with another tree, and not written
+            bool pre(Octnode *current)
             {
-                //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-                intersect(current->child[m], vol); // call diff on children
+                if (current->depth() == depth)
+                {
+                    if (!current->isLeaf() || current->is_packed())
+                        nodes.push_back(current);
+                    return false;
+                }
+                return !current->children_shared();
             }
+            void post(Octnode *) {}
+        };
+
+        /// reads the paged sub-trees that are not shared back, or only those in memory
+        struct PageInVisitor
+        {
+            GLData *g;
+            bool packed;
+            bool ok;
+            bool pre(Octnode *current)
+            {
+                if (!packed || current->is_packed())
+                    ok = current->page_in(g) && ok;
+                return !current->children_shared();
+            }
+            void post(Octnode *) {}
+        };
+    } // end anonymous namespace
+
+    bool Octree::set_paging(const std::string &path)
+    {
+        if (path.empty())
+        {
+            bool ok = page_in();
+            pager.reset(); // the pages still shared with other trees keep the file
+            return ok;
         }
-        else if (current->is_undecided())
-        { // no children, subdivide if undecided
-            if ((current->depth < (this->max_depth - 1)))
+        std::shared_ptr<Pager> file = std::make_shared<Pager>(path);
+        if (!file->good())
+            return false;
+        pager = file;
+        return true;
+    }
+
+    unsigned int Octree::page_depth() const
+    {
+        // sub-trees of up to seven levels, large enough to be worth a page, with the
+        // bricks below them
+        return max_depth > 8 ? max_depth - 7 : 1;
+    }
+
+    void Octree::page_candidates(std::vector<Octnode *> &nodes) const
+    {
+        if (max_depth < 2)
+            return;
+        PageCandidateVisitor visitor = {nodes, page_depth()};
+        traverse(root, visitor);
+    }
+
+    bool Octree::page_out(Octnode *node)
+    {
+        if (!pager)
+            return false;
+        if (journal) // the journal refers to the nodes of the sub-tree
+            journal->clear();
+        return node->page_out(pager, g);
+    }
+
+    bool Octree::pack(Octnode *node)
+    {
+        if (node->is_paged())
+            return false;
+        if (journal)
+            journal->clear();
+        return node->page_out(std::shared_ptr<Pager>(), g);
+    }
+
+    bool Octree::page_in()
+    {
+        TraceScope trace("page_in");
+        PageInVisitor visitor = {g, false, true};
+        traverse(root, visitor);
+        return visitor.ok;
+    }
+
+    bool Octree::unpack()
+    {
+        TraceScope trace("unpack");
+        PageInVisitor visitor = {g, true, true};
+        traverse(root, visitor);
+        return visitor.ok;
+    }
+
+    unsigned int Octree::cut_depth() const
+    {
+        return std::min(page_depth(), 5u); // at most 32768 cells
+    }
+
+    void Octree::mark_cut(const Bbox &bb, unsigned long op)
+    {
+        const int n = 1 << cut_depth();
+        if (cuts.empty())
+            cuts.assign(n * n * n, 0);
+        const GLVertex origin = root->center() - GLVertex(root_scale, root_scale, root_scale);
+        const double cell = 2 * root_scale / n;
+        int lo[3], hi[3];
+        const double min[3] = {bb.minpt.x - origin.x, bb.minpt.y - origin.y, bb.minpt.z - origin.z};
+        const double max[3] = {bb.maxpt.x - origin.x, bb.maxpt.y - origin.y, bb.maxpt.z - origin.z};
+        for (int a = 0; a < 3; ++a)
+        {
+            if (max[a] < 0 || min[a] > 2 * root_scale)
+                return; // outside the tree
+            lo[a] = std::max(0, std::min(n - 1, (int)std::floor(min[a] / cell)));
+            hi[a] = std::max(0, std::min(n - 1, (int)std::floor(max[a] / cell)));
+        }
+        for (int k = lo[2]; k <= hi[2]; ++k)
+            for (int j = lo[1]; j <= hi[1]; ++j)
+                for (int i = lo[0]; i <= hi[0]; ++i)
+                    cuts[(k * n + j) * n + i] = op;
+    }
+
+    unsigned long Octree::last_cut(const Octnode *node) const
+    {
+        if (cuts.empty())
+            return 0;
+        const int n = 1 << cut_depth();
+        const GLVertex origin = root->center() - GLVertex(root_scale, root_scale, root_scale);
+        const double cell = 2 * root_scale / n;
+        const GLVertex p = node->center() - origin;
+        const int i = std::max(0, std::min(n - 1, (int)std::floor(p.x / cell)));
+        const int j = std::max(0, std::min(n - 1, (int)std::floor(p.y / cell)));
+        const int k = std::max(0, std::min(n - 1, (int)std::floor(p.z / cell)));
+        return cuts[(k * n + j) * n + i];
+    }
+
+    void Octree::set_depth_limit(unsigned int limit)
+    {
+        depth_limit = (limit == 0 || limit > max_depth) ? max_depth : std::max(2u, limit);
+    }
+
+    namespace
+    {
+        /// deletes the nodes below a depth in the cells cut before an operation
+        struct CoarsenVisitor
+        {
+            const Octree &tree;
+            GLData *g;
+            Journal *journal;
+            unsigned int depth;
+            unsigned int cell_depth;
+            unsigned long cut_before;
+            unsigned int epoch;
+            std::size_t coarsened;
+            /// per level of the nodes descended into, true if a node below was coarsened
+            bool below[32];
+            unsigned int levels;
+            // the nodes of a shared block are not written, and deleting them frees no memory
+            bool pre(Octnode *current)
             {
-                current->subdivide(); // smash into 8 sub-pieces
-                for (int m = 0; m < 8; ++m)
+                if (current->depth() == cell_depth && tree.last_cut(current) >= cut_before)
+                    return false; // cut recently
+                if (current->depth() == depth)
                 {
-                    intersect(current->child[m], vol); // call diff on children
+                    if (current->hasBrick() || current->is_paged() || (!current->isLeaf() && !current->children_shared()))
+                    {
+                        if (journal && !coarsened) // the journal refers to the nodes deleted
+                            journal->clear();
+                        current->collapse(g);
+                        current->set_coarse();
+                        changed(current);
+                        ++coarsened;
+                    }
+                    return false;
                 }
+                if (current->isLeaf() || current->children_shared())
+                    return false;
+                current->unshare_children(g); // takes over a block that the other trees let go of
+                below[levels++] = false;
+                return true;
             }
-        }
-        // now all children have their status set, prune.
-        if ((current->childcount == 8) && (current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE)))
+            void post(Octnode *current)
+            {
+                if (below[--levels])
+                    changed(current);
+            }
+            /// stamp and invalidate current, and its parent once the traversal is back there.
+            /// setInvalid() stops at an invalid parent, which need not have invalid ancestors.
+            void changed(Octnode *current)
+            {
+                current->set_epoch(epoch);
+                current->setInvalid();
+                if (levels)
+                    below[levels - 1] = true;
+            }
+        };
+    } // end anonymous namespace
+
+    std::size_t Octree::coarsen(unsigned int depth, unsigned long cut_before)
+    {
+        if (depth < cut_depth() || depth >= max_depth)
+            return 0;
+        TraceScope trace("coarsen");
+        CoarsenVisitor visitor = {*this, g, journal, depth, cut_depth(), cut_before, stamp(), 0, {}, 0};
+        traverse(root, visitor);
+        if (Trace::enabled())
         {
-            current->delete_children();
+            std::ostringstream args;
+            args << "\"depth\": " << depth << ", \"coarsened\": " << visitor.coarsened;
+            trace.set_args(args.str());
         }
+        return visitor.coarsened;
+    }
+
+    namespace
+    {
+        /// counts nodes and memory
+        struct StatsVisitor
+        {
+            OctreeStats &s;
+            bool pre(Octnode *current)
+            {
+                unsigned int d = current->depth();
+                s.grow(d + 1); // Octree::init() may subdivide below max_depth
+                ++s.nodes[d];
+                ++s.node_count;
+                if (current->is_inside())
+                    ++s.inside[d];
+                else if (current->is_outside())
+                    ++s.outside[d];
+                else
+                    ++s.undecided[d];
+                if (!current->valid())
+                    ++s.invalid[d];
+                if (current->depth() == 0)
+                    s.node_bytes += sizeof(Octnode);
+                else if (current->idx() == 0)
+                { // children are allocated as blocks of eight
+                    s.node_bytes += Octnode::block_bytes();
+                    if (shared)
+                        s.shared_bytes += Octnode::block_bytes();
+                }
+                if (current->children_shared())
+                    ++shared; // the blocks below are shared through this one
+                if (g && !unowned) // the vertex sets in blocks that g does not own are stale
+                    s.vertexset_bytes += current->vertexSetBytes();
+                if (!current->children_owned(g))
+                    ++unowned;
+                if (current->isLeaf())
+                {
+                    ++s.leaves[d];
+                    ++s.leaf_count;
+                }
+                if (current->hasBrick())
+                {
+                    ++s.brick_count;
+                    s.brick_bytes += sizeof(Brick);
+                }
+                if (current->is_packed())
+                {
+                    ++s.packed_count;
+                    s.packed_bytes += current->page_bytes();
+                }
+                else if (current->is_paged())
+                {
+                    ++s.paged_count;
+                    s.page_bytes += current->page_bytes();
+                }
+                return true;
+            }
+            void post(Octnode *current)
+            {
+                if (current->children_shared())
+                    --shared;
+                if (!current->children_owned(g))
+                    --unowned;
+            }
+            /// the GLData of the tree
+            const GLData *g;
+            /// number of shared blocks above the current node
+            unsigned int shared;
+            /// number of blocks above the current node that g does not own
+            unsigned int unowned;
+        };
+    } // end anonymous namespace
+
+    void Octree::get_stats(OctreeStats &s) const
+    {
+        s.clear(max_depth);
+        StatsVisitor visitor = {s, g, 0, 0};
+        traverse(root, visitor);
+        if (dist_cache)
+            s.distcache_bytes = dist_cache->bytes();
+        if (journal)
+            s.journal_bytes = journal->bytes();
     }
 
     // string repr
     std::string Octree::str() const
     {
+        OctreeStats s;
+        get_stats(s);
         std::ostringstream o;
-        o << " Octree: ";
-        /*
-    std::vector<Octnode*> nodelist;
-    Octree::get_all_nodes(root, nodelist);
-    std::vector<int> nodelevel(this->max_depth);
-    std::vector<int> invalidsAtLevel(this->max_depth);
-    std::vector<int> surfaceAtLevel(this->max_depth);
-    BOOST_FOREACH( Octnode* n, nodelist) {
-        ++nodelevel[n->depth];
-        if ( !n->valid() ) 
-            ++invalidsAtLevel[n->depth];
-        if (n->is_undecided() ) 
-            ++surfaceAtLevel[n->depth];
-    }
-    o << "  " << nodelist.size() << " leaf-nodes:\n";
-    int m=0;
-    BOOST_FOREACH( int count, nodelevel) {
-        o << "depth="<<m <<"  " << count << " nodes, " << invalidsAtLevel[m] << " invalid, surface=" << surfaceAtLevel[m] << " \n";
-        ++m;
-    }*/
+        o << " Octree: " << s.str();
         return o.str();
     }
 
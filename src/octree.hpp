@@ -21,16 +21,25 @@
 
 #include <iostream>
 #include <list>
+#include <memory>
+#include <string>
+#include <vector>
 #include <cassert>
 
 #include "bbox.hpp"
 #include "gldata.hpp"
+#include "stats.hpp"
 
 namespace cutsim
 {
 
     class Octnode;
     class Volume;
+    class DistCache;
+    class Journal;
+    class CheckpointWriter;
+    class CheckpointReader;
+    class Pager;
 
     /// Octree class for cutting simulation
     /// see http://en.wikipedia.org/wiki/Octree
@@ -54,17 +63,21 @@ namespace cutsim
         virtual ~Octree();
 
         // bolean operations on tree
+        // the changed nodes get the given material index, see Palette
         /// diff given Volume from tree
-        void diff(const Volume *vol) { diff(this->root, vol); }
+        void diff(const Volume *vol, unsigned char material = 0) { diff(this->root, vol, material); }
         /// sum given Volume to tree
-        void sum(const Volume *vol) { sum(this->root, vol); }
+        void sum(const Volume *vol, unsigned char material = 0) { sum(this->root, vol, material); }
         /// intersect tree with given Volume
-        void intersect(const Volume *vol) { intersect(this->root, vol); }
+        void intersect(const Volume *vol, unsigned char material = 0) { intersect(this->root, vol, material); }
 
         // debug, can be removed?
         // put all leaf-nodes in a list
         //void get_leaf_nodes( std::vector<Octnode*>& nodelist) const { get_leaf_nodes( root,  nodelist); }
 
+        /// the leaf node that contains point p, or NULL if p is outside the root node
+        Octnode *find_leaf(const GLVertex &p) const;
+
         /// put all leaf-nodes in a list
         void get_leaf_nodes(Octnode *current, std::vector<Octnode *> &nodelist) const;
 
@@ -75,14 +88,164 @@ namespace cutsim
         // put all nodes in a list
         //void get_all_nodes(Octnode* current, std::vector<Octnode*>& nodelist) const;
 
+        /// defer pruning of nodes whose children all became INSIDE or all OUTSIDE.
+        /// Consecutive overlapping cuts then re-use the children instead of pruning and
+        /// subdividing the same node again. The deferred prunes are done by prune(),
+        /// or automatically by the next operation once more than max_pending are deferred.
+        void set_lazy_prune(bool lazy, std::size_t max_pending);
+        /// true if pruning is deferred
+        bool get_lazy_prune() const { return lazy_prune; }
+        /// prune the nodes whose children are all INSIDE or all OUTSIDE leaves, return the number pruned.
+        /// Nodes that were cut since the previous prune() are kept for one more round (hysteresis),
+        /// unless force is true.
+        std::size_t prune(bool force = false);
+
+        /// store the three levels above max_depth as a dense Brick in each undecided node at
+        /// depth max_depth-4, instead of as sparse nodes. Needs max_depth >= 5.
+        /// Existing Bricks are kept, and still updated, when bricks are switched off.
+        void set_bricks(bool on);
+        /// true if new Bricks are created
+        bool get_bricks() const { return brick_depth != 0; }
+
+        /// limit the depth that sum(), diff() and intersect() subdivide to, i.e. the leaves they create
+        /// are at depth limit-1 or above. No new Bricks are created below max_depth. The existing
+        /// deeper nodes are kept. A limit of 0, or above max_depth, is max_depth, the default.
+        void set_depth_limit(unsigned int limit);
+        /// the depth that the operations subdivide to
+        unsigned int get_depth_limit() const { return depth_limit; }
+        /// stop subdividing, and creating Bricks, in sum(), diff() and intersect() while the memory of
+        /// the nodes of all trees, see Octnode::resident_bytes(), is over limit bytes. The leaves stay
+        /// coarser than max_depth until an operation after the memory was freed cuts them again.
+        /// 0, the default, for no limit.
+        void set_memory_limit(std::size_t limit) { memory_limit = limit; }
+        /// the memory limit of the operations, 0 for none
+        std::size_t get_memory_limit() const { return memory_limit; }
+        /// leave an undecided leaf that an operation would subdivide, or give a Brick, as it is if the
+        /// distance field in it is linear within tolerance, see Octnode::check_linear(). The surface of
+        /// a planar or gently curved face is then as exact in a coarser leaf, which the next operation
+        /// that cuts it subdivides from its corners. 0, the default, subdivides all undecided leaves.
+        /// The mesh is not watertight then. The marching cubes mesh each leaf on its own, so where a
+        /// coarse leaf meets a finer one the finer one has vertices inside the edges of the coarse
+        /// one's triangles: T-junctions, exact in position on a planar face, and cracks up to about
+        /// tolerance wide on a curved one. A consumer that needs a closed mesh, e.g. for 3D printing,
+        /// must weld or repair the exported mesh, or leave this off.
+        void set_refine_tolerance(float tolerance) { refine_tolerance = std::max(0.0f, tolerance); }
+        /// the tolerance of the linear distance field in a leaf, 0 for none
+        float get_refine_tolerance() const { return refine_tolerance; }
+        /// delete the nodes below depth, and the Bricks at depth, in the cells that mark_cut() saw last
+        /// cut before operation cut_before, except where the nodes are shared with another tree.
+        /// The nodes at depth keep their distance field, need meshing, and are subdivided from it when
+        /// cut again, see Octnode::set_coarse(). Returns the number of nodes
+        /// that lost a sub-tree. depth is at least that of the cells, see last_cut().
+        /// The operations before can no longer be undone.
+        std::size_t coarsen(unsigned int depth, unsigned long cut_before);
+
+        /// evaluate Volume::dist() once per lattice point and operation, instead of once per node
+        /// corner, for the volumes with Volume::expensive_dist() only, see DistCache.
+        /// With cutsim-bench at depth 9 it makes the MeshVolume tool 3.2x faster, but the lookup
+        /// made the sphere, cylinder and cone cuts 1.3x to 2.4x slower, so they bypass the cache.
+        /// Only the evaluations are shared: each node still stores its own corner values, so the
+        /// memory of the tree is the same, and the cache adds its table on top of it.
+        void set_dist_cache(bool on);
+        /// the distance cache, NULL when off
+        const DistCache *get_dist_cache() const { return dist_cache; }
+
+        /// journal the changes of the last depth operations, so that undo() can revert them.
+        /// The journal costs memory in proportion to the nodes that the operations change,
+        /// see Journal. 0 turns it off, which is the default.
+        /// init(), clear(), fork() and restore() forget the journaled operations, fork() because
+        /// the snapshot shares the nodes that undo() would write.
+        void set_undo(std::size_t depth);
+        /// the number of operations journaled, 0 when off
+        std::size_t get_undo() const { return undo_depth; }
+        /// revert the most recent sum, diff or intersect, false if there is none to undo.
+        /// Takes time in proportion to the nodes the operation changed, and these need meshing.
+        bool undo();
+        /// number of operations that undo() can revert
+        std::size_t undo_steps() const;
+
+        /// a new tree drawing to gl, that shares all nodes with this one until either of them changes.
+        /// The trees copy a block of eight nodes before they change it (copy-on-write), so
+        /// the fork costs memory in proportion to the nodes changed since. Any number of forks
+        /// may be changed in parallel, each by one thread, while this tree is not changed.
+        /// A fork with gl NULL is a snapshot, which must not be changed.
+        /// Not const: this tree forgets its journaled operations, see set_undo().
+        Octree *fork(GLData *gl);
+        /// make this tree a fork of snapshot again, which must have the same root and depth.
+        /// All nodes need meshing afterwards.
+        bool restore(const Octree &snapshot);
+        /// true if other has the same root node and max_depth, i.e. the same nodes
+        bool same_lattice(const Octree &other) const;
+
+        /// write all nodes to a checkpoint, in depth-first order, see Checkpoint.
+        /// false if a paged sub-tree can not be read.
+        bool save(CheckpointWriter &out) const;
+        /// replace all nodes with those written by save() of a tree with the same lattice.
+        /// On bad data the tree is cleared and false is returned. All nodes need meshing afterwards.
+        bool load(CheckpointReader &in);
+
+        // DELTA CHECKPOINTS
+        // Operations, prunes and undo() stamp the nodes they change, and their ancestors, with
+        // the current epoch of the tree. A delta holds only the sub-trees with stamped roots, so
+        // it takes time and space in proportion to the change since the previous checkpoint.
+        // After 256 epochs an unchanged node may look changed again, and is written once more.
+        /// write the nodes changed in the current epoch, and a mark for each unchanged sub-tree.
+        /// false if a paged sub-tree can not be read.
+        bool save_delta(CheckpointWriter &out) const;
+        /// apply a delta written by save_delta() to a tree that is as it was at the start of
+        /// that epoch. Must not be called on a tree with GLData, but on a fork() of it with none.
+        /// false on bad data, which leaves the tree partly changed.
+        bool load_delta(CheckpointReader &in);
+        /// start a new epoch, after the tree was written to a checkpoint. fork() and restore()
+        /// take the epoch of their source.
+        void next_epoch();
+
+        // PAGING
+        // The sub-trees below the nodes at page_depth() can be written to a page file, or packed
+        // in memory, and freed, see Octnode::page_out(). The paged nodes keep their distance field
+        // and the vertices of the sub-tree, so the mesh stays drawn. An operation or meshing that
+        // reaches a paged node reads the sub-tree back first. Which sub-trees to page is up to
+        // the caller, see Cutsim::set_paging() and Cutsim::set_packing(). mark_cut() keeps the
+        // operations that last cut each part of the tree, to pick them by.
+        /// page to a new page file at path, or with an empty path read all pages back and stop
+        /// paging. false if the file can not be created.
+        bool set_paging(const std::string &path);
+        /// true if sub-trees can be paged out
+        bool get_paging() const { return pager != NULL; }
+        /// the depth of the nodes whose sub-trees are paged
+        unsigned int page_depth() const;
+        /// put the nodes at page_depth() whose sub-trees are in memory, or packed in memory,
+        /// and not shared with another tree, in nodes
+        void page_candidates(std::vector<Octnode *> &nodes) const;
+        /// page out the sub-tree of node, one of page_candidates(), false on error.
+        /// The operations before can no longer be undone.
+        bool page_out(Octnode *node);
+        /// pack the sub-tree of node, one of page_candidates() that is not paged, in memory.
+        /// false on error. The operations before can no longer be undone.
+        bool pack(Octnode *node);
+        /// read the paged sub-trees that are not shared with another tree back, false on error
+        bool page_in();
+        /// read the sub-trees packed in memory that are not shared with another tree back
+        bool unpack();
+        /// remember that operation op cut the box bb, see last_cut()
+        void mark_cut(const Bbox &bb, unsigned long op);
+        /// the latest operation given to mark_cut() with a box overlapping the cell of node,
+        /// 0 for none. The cells are the nodes at page_depth(), or at depth 5 if it is deeper.
+        unsigned long last_cut(const Octnode *node) const;
+
         /// initialize by recursively calling subdivide() on all nodes n times
         void init(const unsigned int n);
+        /// delete all nodes below the root and make the tree empty, i.e. all OUTSIDE
+        void clear();
         /// return max depth
         unsigned int get_max_depth() const;
         /// return the maximum cube side-length, (i.e. at depth=0)
         double get_root_scale() const;
         /// return the minimum cube side-length (i.e. at maximum depth)
         double leaf_scale() const;
+        /// count nodes per depth and state, and the memory used by the tree.
+        /// walks the whole tree without allocating, so it can be called after every operation.
+        void get_stats(OctreeStats &s) const;
         /// string output
         std::string str() const;
         /// flag for debug mode
@@ -95,18 +258,58 @@ namespace cutsim
         unsigned int max_depth;
         /// pointer to the root node
         Octnode *root;
+        /// running totals of the instrumentation counters for boolean operations
+        OpStats stats;
 
     protected:
-        /// recursively traverse the tree subtracting Volume
-        void diff(Octnode *current, const Volume *vol);
+        /// traverse the tree subtracting Volume
+        void diff(Octnode *current, const Volume *vol, unsigned char material);
         /// union Octnode with Volume
-        void sum(Octnode *current, const Volume *vol);
+        void sum(Octnode *current, const Volume *vol, unsigned char material);
         /// intersect Octnode with Volume
-        void intersect(Octnode *current, const Volume *vol);
+        void intersect(Octnode *current, const Volume *vol, unsigned char material);
+
+        /// called before each operation, starts the operation in the journal, and in the
+        /// dist cache if vol uses it. Returns the dist cache for vol, NULL if it does not use one.
+        DistCache *start_op(const Volume *vol);
+        /// called after each operation, runs prune() when too many prunes are deferred
+        void check_pending();
 
         // DATA
         /// the GLData used to draw this tree
         GLData *g;
+        /// defer pruning to prune()
+        bool lazy_prune;
+        /// number of prunes deferred since the last prune()
+        std::size_t pending;
+        /// prune() when more than this many prunes are deferred
+        std::size_t max_pending;
+        /// memo of Volume::dist() for the current operation, NULL when off
+        DistCache *dist_cache;
+        /// depth of the nodes that get a Brick, 0 when off
+        unsigned int brick_depth;
+        /// the depth the operations subdivide to, see set_depth_limit()
+        unsigned int depth_limit;
+        /// the memory over which the operations do not subdivide, see set_memory_limit()
+        std::size_t memory_limit;
+        /// the tolerance of a leaf that is not subdivided, see set_refine_tolerance()
+        float refine_tolerance;
+        /// the depth of the nodes that the operations give a new Brick, 0 for none
+        unsigned int new_brick_depth() const { return depth_limit < max_depth ? 0 : brick_depth; }
+        /// changes of the recent operations, NULL when off
+        Journal *journal;
+        /// number of operations in the journal
+        std::size_t undo_depth;
+        /// the number of checkpoints taken, see save_delta()
+        unsigned long epoch;
+        /// the stamp of the nodes changed in the current epoch
+        unsigned int stamp() const { return epoch & 255; }
+        /// the page file, NULL when paging is off
+        std::shared_ptr<Pager> pager;
+        /// depth of the cells of cuts
+        unsigned int cut_depth() const;
+        /// the last operation that cut each cell, x fastest, empty before mark_cut()
+        std::vector<unsigned long> cuts;
 
     private:
         Octree() {} // disable constructor
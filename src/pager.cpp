@@ -0,0 +1,210 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <iostream>
+
+#include "pager.hpp"
+
+namespace cutsim
+{
+
+    Pager::Pager(const std::string &p) : path(p), end(0), used(0)
+    {
+        file.open(path.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!file.is_open())
+            std::cout << "Pager: can not create page file " << path << "\n";
+    }
+
+    Pager::~Pager()
+    {
+        if (file.is_open())
+        {
+            file.close();
+            std::remove(path.c_str());
+        }
+    }
+
+    bool Pager::write(const std::vector<char> &data, uint64_t &offset)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file.is_open())
+            return false;
+        std::multimap<std::size_t, uint64_t>::iterator it = unused.lower_bound(data.size());
+        bool reuse = it != unused.end();
+        if (reuse)
+        { // the smallest released space that fits, the rest of it stays free
+            offset = it->second;
+            std::size_t left = it->first - data.size();
+            unused.erase(it);
+            if (left)
+                unused.insert(std::make_pair(left, offset + data.size()));
+        }
+        else
+            offset = end;
+        file.clear();
+        file.seekp(offset);
+        file.write(data.data(), data.size());
+        file.flush();
+        if (!file.good())
+        {
+            std::cout << "Pager: write error in " << path << "\n";
+            if (reuse)
+                unused.insert(std::make_pair(data.size(), offset));
+            return false;
+        }
+        if (!reuse)
+            end += data.size();
+        used += data.size();
+        return true;
+    }
+
+    bool Pager::read(uint64_t offset, std::size_t size, std::vector<char> &data)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        data.resize(size);
+        file.clear();
+        file.seekg(offset);
+        file.read(data.data(), size);
+        if (!file.good() || (std::size_t)file.gcount() != size)
+        {
+            std::cout << "Pager: read error in " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void Pager::release(uint64_t offset, std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size)
+            unused.insert(std::make_pair(size, offset));
+        used -= size;
+    }
+
+    std::size_t Pager::bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used;
+    }
+
+    namespace
+    {
+        // a control byte below 128 is followed by that many bytes plus one, copied as they are.
+        // A control byte c of 128 or more is followed by one byte, repeated c - 125 times.
+        const std::size_t max_literal = 128;
+        const std::size_t min_run = 3;
+        const std::size_t max_run = 255 - 125;
+
+        void pack_plane(const std::vector<char> &data, std::size_t first, std::vector<char> &packed)
+        {
+            std::size_t literal = packed.size(); // the control byte of the open literal
+            std::size_t literal_length = 0;
+            for (std::size_t i = first; i < data.size();)
+            {
+                std::size_t run = 1;
+                while (i + 2 * run < data.size() && run < max_run && data[i + 2 * run] == data[i])
+                    ++run;
+                if (run >= min_run)
+                {
+                    packed.push_back((char)(run + 125));
+                    packed.push_back(data[i]);
+                    literal_length = 0;
+                    i += 2 * run;
+                    continue;
+                }
+                if (literal_length == 0 || literal_length == max_literal)
+                {
+                    literal = packed.size();
+                    packed.push_back(0);
+                    literal_length = 0;
+                }
+                packed[literal] = (char)literal_length;
+                packed.push_back(data[i]);
+                ++literal_length;
+                i += 2;
+            }
+        }
+
+        bool unpack_plane(const unsigned char *&in, const unsigned char *end, std::size_t first, std::vector<char> &data)
+        {
+            for (std::size_t i = first; i < data.size();)
+            {
+                if (in + 2 > end)
+                    return false;
+                std::size_t control = *in++;
+                if (control < max_literal)
+                {
+                    std::size_t length = control + 1;
+                    if (in + length > end || i + 2 * (length - 1) >= data.size())
+                        return false;
+                    for (std::size_t n = 0; n < length; ++n, i += 2)
+                        data[i] = (char)*in++;
+                }
+                else
+                {
+                    std::size_t run = control - 125;
+                    if (i + 2 * (run - 1) >= data.size())
+                        return false;
+                    for (std::size_t n = 0; n < run; ++n, i += 2)
+                        data[i] = (char)*in;
+                    ++in;
+                }
+            }
+            return true;
+        }
+    } // end anonymous namespace
+
+    void PageCodec::pack(const std::vector<char> &data, std::vector<char> &packed)
+    {
+        packed.clear();
+        packed.reserve(data.size() / 4);
+        pack_plane(data, 0, packed);
+        pack_plane(data, 1, packed);
+    }
+
+    bool PageCodec::unpack(const char *packed, std::size_t packed_size, std::size_t size, std::vector<char> &data)
+    {
+        data.resize(size);
+        const unsigned char *in = reinterpret_cast<const unsigned char *>(packed);
+        const unsigned char *end = in + packed_size;
+        return unpack_plane(in, end, 0, data) && unpack_plane(in, end, 1, data) && in == end;
+    }
+
+    bool Page::read(std::vector<char> &data) const
+    {
+        std::vector<char> file_page;
+        const std::vector<char> *p = &packed;
+        if (pager)
+        {
+            if (!pager->read(offset, packed_bytes, file_page))
+                return false;
+            p = &file_page;
+        }
+        if (p->size() != packed_bytes || !PageCodec::unpack(p->data(), p->size(), bytes(), data))
+        {
+            std::cout << "Page::read(): bad page" << (pager ? " in " + pager->get_path() : std::string()) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+} // end namespace
+
+// end file pager.cpp
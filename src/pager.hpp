@@ -0,0 +1,113 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cutsim
+{
+
+    /// A page file that holds sub-trees paged out of an Octree, see Octree::page_out().
+    ///
+    /// Pages are written once and read any number of times, until they are released.
+    /// The space of released pages is reused for new pages of the same size or smaller,
+    /// best fit first, so the file does not grow while the paged-out part of the stock
+    /// stays the same size. The file is deleted with the Pager.
+    /// All calls are thread-safe, the tiles of a stock may be paged in parallel.
+    class Pager
+    {
+    public:
+        /// create, or truncate, the page file at path
+        explicit Pager(const std::string &path);
+        ~Pager();
+        /// true if the file could be created
+        bool good() const { return file.is_open(); }
+        /// write a page, false on error. offset is where the page starts in the file.
+        bool write(const std::vector<char> &data, uint64_t &offset);
+        /// read size bytes of a page at offset to data, false on error
+        bool read(uint64_t offset, std::size_t size, std::vector<char> &data);
+        /// free the space of a page that is no longer needed
+        void release(uint64_t offset, std::size_t size);
+        /// bytes in the pages that are not released
+        std::size_t bytes() const;
+        /// the path of the page file
+        const std::string &get_path() const { return path; }
+
+    private:
+        std::string path;
+        std::fstream file;
+        mutable std::mutex mutex;
+        uint64_t end;                                 ///< size of the file
+        std::size_t used;                             ///< bytes in pages that are not released
+        std::multimap<std::size_t, uint64_t> unused; ///< released space, size to offset
+        Pager(const Pager &);
+        Pager &operator=(const Pager &);
+    };
+
+    /// The coding of pages: the bytes are split into two planes, the even and the odd ones, which
+    /// gathers the high bytes of the int16 distances of a Checkpoint, and each plane is run-length
+    /// coded. The saturated distances of the nodes inside and outside the stock, the empty
+    /// material bytes and the zero vertex counts then pack into a few bytes per run.
+    class PageCodec
+    {
+    public:
+        /// pack data to packed
+        static void pack(const std::vector<char> &data, std::vector<char> &packed);
+        /// unpack size bytes from packed, false if packed is not a packing of size bytes
+        static bool unpack(const char *packed, std::size_t packed_size, std::size_t size, std::vector<char> &data);
+    };
+
+    /// A sub-tree paged out of an Octree, which replaces the children of an Octnode.
+    /// The page is either in a page file, or packed in memory, see Octnode::page_out().
+    /// A page is never changed, and is shared by the trees forked from one another
+    /// like a block of children, see Octnode::page_in().
+    ///
+    /// The page holds the nodes below the paged node in the order and format of a Checkpoint,
+    /// followed by a uint32 vertex count per node, in the same order, packed by PageCodec.
+    /// The vertices of the sub-tree move to the vertex set of the paged node, after its own
+    /// vertices, so the mesh stays drawn and page_in() can give each node its vertices back.
+    struct Page
+    {
+        std::shared_ptr<Pager> pager;   ///< the file, NULL for a page in memory
+        uint64_t offset;                ///< where the page starts in the file
+        std::vector<char> packed;       ///< the packed page, of a page in memory
+        uint32_t packed_bytes;          ///< bytes of the packed page
+        uint32_t node_bytes;            ///< bytes of the nodes
+        uint32_t nodes;                 ///< number of nodes, and vertex counts after them
+        uint32_t own_vertices;          ///< vertices of the paged node itself, before those of the sub-tree
+        std::atomic<unsigned int> refs; ///< nodes, of any tree, that have the page as children
+        /// bytes of the unpacked page
+        std::size_t bytes() const { return node_bytes + nodes * sizeof(uint32_t); }
+        /// read and unpack the page to data, false on error
+        bool read(std::vector<char> &data) const;
+        /// bytes of the pages in memory, of all trees
+        static inline std::atomic<std::size_t> memory{0};
+    };
+
+} // end namespace
+
+// end file pager.hpp
@@ -0,0 +1,76 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+
+#include "palette.hpp"
+
+namespace cutsim
+{
+
+    Palette::Palette()
+    {
+        clear();
+    }
+
+    void Palette::clear()
+    {
+        Color black;
+        black.set(0, 0, 0);
+        colors.assign(1, black);
+    }
+
+    unsigned char Palette::material(const Color &c)
+    {
+        unsigned int nearest = 0;
+        float nearest_d2 = -1;
+        for (unsigned int m = 0; m < colors.size(); ++m)
+        {
+            float dr = colors[m].r - c.r;
+            float dg = colors[m].g - c.g;
+            float db = colors[m].b - c.b;
+            float d2 = dr * dr + dg * dg + db * db;
+            if (d2 == 0)
+                return m;
+            if (nearest_d2 < 0 || d2 < nearest_d2)
+            {
+                nearest = m;
+                nearest_d2 = d2;
+            }
+        }
+        if (colors.size() < max_size)
+        {
+            colors.push_back(c);
+            return colors.size() - 1;
+        }
+        return nearest;
+    }
+
+    std::string Palette::str() const
+    {
+        std::ostringstream o;
+        o << "Palette " << colors.size() << " materials\n";
+        for (unsigned int m = 0; m < colors.size(); ++m)
+            o << " " << m << ": (" << colors[m].r << ", " << colors[m].g << ", " << colors[m].b << ")\n";
+        return o.str();
+    }
+
+} // end namespace
+
+// end file palette.cpp
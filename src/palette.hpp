@@ -0,0 +1,61 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glvertex.hpp"
+
+namespace cutsim
+{
+
+    /// a Palette maps the small material index stored in each Octnode to a Color.
+    ///
+    /// A job uses only a handful of tool colors (Volume::setColor), so instead of
+    /// a color per node the nodes store the index of the material, i.e. of the
+    /// Volume that last changed them, and the color is looked up at mesh generation.
+    /// Material 0 is the default (black) material of a fresh tree.
+    class Palette
+    {
+    public:
+        /// maximum number of materials, limited by the 8-bit index in Octnode
+        static const unsigned int max_size = 256;
+
+        Palette();
+        /// the material index of the given color, adding it to the palette if it is new.
+        /// When the palette is full the nearest existing color is used.
+        unsigned char material(const Color &c);
+        /// the color of material m
+        const Color &color(unsigned char m) const { return colors[m]; }
+        /// number of materials in the palette
+        unsigned int size() const { return colors.size(); }
+        /// remove all materials except the default
+        void clear();
+        /// string output
+        std::string str() const;
+
+    private:
+        std::vector<Color> colors; ///< the color of each material index
+    };
+
+} // end namespace
+
+// end file palette.hpp
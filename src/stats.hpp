@@ -0,0 +1,285 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Instrumentation counters are only updated when the library is built with
+// CUTSIM_STATS defined (the CMake option of the same name). Without it the
+// CUTSIM_STAT() statements compile to nothing and all counters stay zero.
+#ifdef CUTSIM_STATS
+#define CUTSIM_STAT(statement) statement
+#else
+#define CUTSIM_STAT(statement)
+#endif
+
+namespace cutsim
+{
+
+    /// counters for one operation, or accumulated over many operations
+    struct OpStats
+    {
+        OpStats() { clear(); }
+        /// reset all counters to zero
+        void clear()
+        {
+            calls = 0;
+            nodes_visited = 0;
+            dist_calls = 0;
+            subdivisions = 0;
+            prunes = 0;
+            classified = 0;
+            linear = 0;
+            vertices_added = 0;
+            vertices_removed = 0;
+            polygons_added = 0;
+            polygons_removed = 0;
+            seconds = 0;
+        }
+        /// add the counters of another OpStats
+        OpStats &operator+=(const OpStats &o)
+        {
+            calls += o.calls;
+            nodes_visited += o.nodes_visited;
+            dist_calls += o.dist_calls;
+            subdivisions += o.subdivisions;
+            prunes += o.prunes;
+            classified += o.classified;
+            linear += o.linear;
+            vertices_added += o.vertices_added;
+            vertices_removed += o.vertices_removed;
+            polygons_added += o.polygons_added;
+            polygons_removed += o.polygons_removed;
+            seconds += o.seconds;
+            return *this;
+        }
+        /// counter difference, used to extract one operation from running totals
+        OpStats operator-(const OpStats &o) const
+        {
+            OpStats d;
+            d.calls = calls - o.calls;
+            d.nodes_visited = nodes_visited - o.nodes_visited;
+            d.dist_calls = dist_calls - o.dist_calls;
+            d.subdivisions = subdivisions - o.subdivisions;
+            d.prunes = prunes - o.prunes;
+            d.classified = classified - o.classified;
+            d.linear = linear - o.linear;
+            d.vertices_added = vertices_added - o.vertices_added;
+            d.vertices_removed = vertices_removed - o.vertices_removed;
+            d.polygons_added = polygons_added - o.polygons_added;
+            d.polygons_removed = polygons_removed - o.polygons_removed;
+            d.seconds = seconds - o.seconds;
+            return d;
+        }
+        /// string output
+        std::string str() const
+        {
+            std::ostringstream o;
+            o << calls << " calls, " << seconds << " s, "
+              << nodes_visited << " nodes visited, " << dist_calls << " dist() calls, "
+              << subdivisions << " subdivisions, " << prunes << " prunes, "
+              << classified << " classified, " << linear << " linear, "
+              << "vertices +" << vertices_added << "/-" << vertices_removed << ", "
+              << "polygons +" << polygons_added << "/-" << polygons_removed;
+            return o.str();
+        }
+
+        unsigned long calls;            ///< number of operations
+        unsigned long nodes_visited;    ///< octree nodes visited
+        unsigned long dist_calls;       ///< Volume::dist() evaluations
+        unsigned long subdivisions;     ///< calls to Octnode::subdivide()
+        unsigned long prunes;           ///< calls to Octnode::delete_children()
+        unsigned long classified;       ///< nodes decided as a whole by Volume::classify()
+        unsigned long linear;           ///< undecided leaves not subdivided, see Octree::set_refine_tolerance()
+        unsigned long vertices_added;   ///< GLData vertices added
+        unsigned long vertices_removed; ///< GLData vertices removed
+        unsigned long polygons_added;   ///< GLData polygons added
+        unsigned long polygons_removed; ///< GLData polygons removed
+        double seconds;                 ///< elapsed wall-clock time
+    };
+
+    /// instrumentation of a Cutsim, per kind of operation
+    struct CutsimStats
+    {
+        OpStats diff;      ///< Cutsim::diff_volume()
+        OpStats sum;       ///< Cutsim::sum_volume()
+        OpStats intersect; ///< Cutsim::intersect_volume()
+        OpStats update;    ///< Cutsim::updateGL()
+        OpStats last;      ///< the most recent operation of any kind
+        /// reset all counters to zero
+        void clear()
+        {
+            diff.clear();
+            sum.clear();
+            intersect.clear();
+            update.clear();
+            last.clear();
+        }
+        /// string output
+        std::string str() const
+        {
+            std::ostringstream o;
+            o << "diff:      " << diff.str() << "\n";
+            o << "sum:       " << sum.str() << "\n";
+            o << "intersect: " << intersect.str() << "\n";
+            o << "updateGL:  " << update.str() << "\n";
+            return o.str();
+        }
+    };
+
+    /// size and shape of an Octree, and the memory used by it and its GLData.
+    /// the per-depth vectors are indexed by node depth, from 0 (root) to the deepest node,
+    /// which may be below max_depth-1 after Octree::init()
+    struct OctreeStats
+    {
+        OctreeStats() { clear(0); }
+        /// reset all counts to zero, for a tree of the given max_depth
+        void clear(unsigned int max_depth)
+        {
+            nodes.assign(max_depth, 0);
+            inside.assign(max_depth, 0);
+            outside.assign(max_depth, 0);
+            undecided.assign(max_depth, 0);
+            invalid.assign(max_depth, 0);
+            leaves.assign(max_depth, 0);
+            node_count = 0;
+            leaf_count = 0;
+            brick_count = 0;
+            paged_count = 0;
+            packed_count = 0;
+            node_bytes = 0;
+            brick_bytes = 0;
+            shared_bytes = 0;
+            vertexset_bytes = 0;
+            gldata_bytes = 0;
+            distcache_bytes = 0;
+            journal_bytes = 0;
+            page_bytes = 0;
+            packed_bytes = 0;
+        }
+        /// make room in the per-depth vectors for nodes down to depth n-1
+        void grow(std::size_t n)
+        {
+            if (nodes.size() >= n)
+                return;
+            nodes.resize(n, 0);
+            inside.resize(n, 0);
+            outside.resize(n, 0);
+            undecided.resize(n, 0);
+            invalid.resize(n, 0);
+            leaves.resize(n, 0);
+        }
+        /// add the counts of another tree, e.g. of another tile of the stock
+        OctreeStats &operator+=(const OctreeStats &o)
+        {
+            grow(o.nodes.size());
+            for (std::size_t d = 0; d < o.nodes.size(); ++d)
+            {
+                nodes[d] += o.nodes[d];
+                inside[d] += o.inside[d];
+                outside[d] += o.outside[d];
+                undecided[d] += o.undecided[d];
+                invalid[d] += o.invalid[d];
+                leaves[d] += o.leaves[d];
+            }
+            node_count += o.node_count;
+            leaf_count += o.leaf_count;
+            brick_count += o.brick_count;
+            paged_count += o.paged_count;
+            packed_count += o.packed_count;
+            node_bytes += o.node_bytes;
+            brick_bytes += o.brick_bytes;
+            shared_bytes += o.shared_bytes;
+            vertexset_bytes += o.vertexset_bytes;
+            gldata_bytes += o.gldata_bytes;
+            distcache_bytes += o.distcache_bytes;
+            journal_bytes += o.journal_bytes;
+            page_bytes += o.page_bytes;
+            packed_bytes += o.packed_bytes;
+            return *this;
+        }
+        /// all memory accounted for
+        std::size_t total_bytes() const { return node_bytes + brick_bytes + packed_bytes + vertexset_bytes + gldata_bytes + distcache_bytes + journal_bytes; }
+        /// string output, one line per depth followed by the memory use
+        std::string str() const
+        {
+            std::ostringstream o;
+            o << node_count << " nodes, " << leaf_count << " leaves";
+            if (brick_count)
+                o << ", " << brick_count << " bricks";
+            if (paged_count)
+                o << ", " << paged_count << " paged out";
+            if (packed_count)
+                o << ", " << packed_count << " packed";
+            o << "\n";
+            for (std::size_t d = 0; d < nodes.size(); ++d)
+            {
+                if (nodes[d] == 0)
+                    continue;
+                o << "  depth " << d << ": " << nodes[d] << " nodes, " << leaves[d] << " leaves, "
+                  << inside[d] << " inside, " << outside[d] << " outside, " << undecided[d] << " undecided, "
+                  << invalid[d] << " invalid\n";
+            }
+            o << "  bytes: " << node_bytes << " nodes, ";
+            if (brick_bytes)
+                o << brick_bytes << " bricks, ";
+            if (packed_bytes)
+                o << packed_bytes << " packed, ";
+            if (shared_bytes)
+                o << "(" << shared_bytes << " of the nodes shared), ";
+            o << vertexset_bytes << " vertex sets, " << gldata_bytes << " GLData, ";
+            if (distcache_bytes)
+                o << distcache_bytes << " dist cache, ";
+            if (journal_bytes)
+                o << journal_bytes << " undo journal, ";
+            o << total_bytes() << " total";
+            if (page_bytes)
+                o << ", " << page_bytes << " in page files";
+            o << "\n";
+            return o.str();
+        }
+
+        std::vector<unsigned long> nodes;     ///< nodes at each depth
+        std::vector<unsigned long> inside;    ///< INSIDE nodes at each depth
+        std::vector<unsigned long> outside;   ///< OUTSIDE nodes at each depth
+        std::vector<unsigned long> undecided; ///< UNDECIDED nodes at each depth
+        std::vector<unsigned long> invalid;   ///< nodes with an invalid isosurface at each depth
+        std::vector<unsigned long> leaves;    ///< leaf nodes at each depth
+        unsigned long node_count;             ///< total number of nodes
+        unsigned long leaf_count;             ///< total number of leaf nodes
+        unsigned long brick_count;            ///< leaf nodes that store a Brick
+        unsigned long paged_count;            ///< nodes whose sub-tree is paged out, see Octree::page_out()
+        unsigned long packed_count;           ///< nodes whose sub-tree is packed in memory, see Octree::pack()
+        std::size_t node_bytes;               ///< memory used by the Octnode objects
+        std::size_t brick_bytes;              ///< memory used by the Bricks
+        std::size_t shared_bytes;             ///< part of node_bytes in blocks shared with another tree, see Octree::fork()
+        std::size_t vertexset_bytes;          ///< memory used by the vertex sets of the nodes
+        std::size_t gldata_bytes;             ///< memory used by the GLData arrays, zero when only the tree is counted
+        std::size_t distcache_bytes;          ///< memory used by the DistCache, zero when it is off
+        std::size_t journal_bytes;            ///< memory used by the undo Journal, zero when it is off
+        std::size_t page_bytes;               ///< bytes of the paged sub-trees in page files, not in memory
+        std::size_t packed_bytes;             ///< memory used by the sub-trees packed in memory
+    };
+
+} // end namespace
+
+// end file stats.hpp
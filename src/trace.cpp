@@ -0,0 +1,148 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace cutsim
+{
+
+    namespace
+    {
+        /// one recorded event, times in microseconds since Trace::start()
+        struct TraceEvent
+        {
+            const char *name;
+            double ts;
+            double dur;
+            int tid;
+            std::string args;
+        };
+
+        std::atomic<bool> recording(false);
+        std::mutex trace_mutex; // guards everything below
+        std::string trace_path;
+        std::chrono::steady_clock::time_point trace_start;
+        std::vector<TraceEvent> events;
+        std::map<std::thread::id, int> thread_ids; // small, stable per-thread numbers
+
+        double microseconds(std::chrono::steady_clock::duration d)
+        {
+            return std::chrono::duration<double, std::micro>(d).count();
+        }
+    } // end anonymous namespace
+
+    bool Trace::start(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (recording)
+            return false;
+        trace_path = path;
+        trace_start = std::chrono::steady_clock::now();
+        events.clear();
+        thread_ids.clear();
+        recording = true;
+        return true;
+    }
+
+    bool Trace::stop()
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (!recording)
+            return false;
+        recording = false;
+
+        std::ofstream out(trace_path.c_str());
+        if (!out)
+            return false;
+        out << std::fixed;
+        out.precision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        for (std::size_t n = 0; n < events.size(); ++n)
+        {
+            const TraceEvent &e = events[n];
+            out << "{\"name\": \"" << e.name << "\", \"cat\": \"cutsim\", \"ph\": \"X\", \"pid\": 1"
+                << ", \"tid\": " << e.tid << ", \"ts\": " << e.ts << ", \"dur\": " << e.dur;
+            if (!e.args.empty())
+                out << ", \"args\": {" << e.args << "}";
+            out << "}" << (n + 1 < events.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        events.clear();
+        return out.good();
+    }
+
+    bool Trace::enabled()
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    void Trace::event(const char *name, std::chrono::steady_clock::time_point begin,
+                      std::chrono::steady_clock::time_point end, const std::string &args)
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (!recording)
+            return;
+        std::map<std::thread::id, int>::iterator found = thread_ids.find(std::this_thread::get_id());
+        int tid;
+        if (found == thread_ids.end())
+        {
+            tid = thread_ids.size();
+            thread_ids[std::this_thread::get_id()] = tid;
+        }
+        else
+            tid = found->second;
+        TraceEvent e = {name, microseconds(begin - trace_start), microseconds(end - begin), tid, args};
+        events.push_back(e);
+    }
+
+    TraceScope::TraceScope(const char *event_name) : name(event_name), active(Trace::enabled())
+    {
+        if (active)
+            begin = std::chrono::steady_clock::now();
+    }
+
+    TraceScope::~TraceScope()
+    {
+        if (active)
+            Trace::event(name, begin, std::chrono::steady_clock::now(), args);
+    }
+
+    void TraceScope::set_args(const OpStats &s)
+    {
+        if (!active)
+            return;
+        std::ostringstream o;
+        o << "\"nodes_visited\": " << s.nodes_visited << ", \"dist_calls\": " << s.dist_calls
+          << ", \"subdivisions\": " << s.subdivisions << ", \"prunes\": " << s.prunes
+          << ", \"classified\": " << s.classified << ", \"linear\": " << s.linear
+          << ", \"vertices_added\": " << s.vertices_added << ", \"vertices_removed\": " << s.vertices_removed;
+        args = o.str();
+    }
+
+} // end namespace
+
+// end file trace.cpp
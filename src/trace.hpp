@@ -0,0 +1,73 @@
+/*  
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *  
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "stats.hpp"
+
+namespace cutsim
+{
+
+    /// Timeline recording in the Chrome Trace Event format.
+    ///
+    /// Between start() and stop() every TraceScope records one complete ("X") event
+    /// with its thread, start time and duration. stop() writes all events as JSON that
+    /// chrome://tracing or https://ui.perfetto.dev can open.
+    /// When no trace is running a TraceScope costs one atomic load.
+    class Trace
+    {
+    public:
+        /// start recording, to be written to the given file by stop(). false if already recording.
+        static bool start(const std::string &path);
+        /// stop recording and write the trace file. false if not recording or the write failed.
+        static bool stop();
+        /// true while recording
+        static bool enabled();
+        /// record one complete event. args is a JSON object body, e.g. "\"n\": 3", or empty.
+        static void event(const char *name, std::chrono::steady_clock::time_point begin,
+                          std::chrono::steady_clock::time_point end, const std::string &args);
+    };
+
+    /// records the lifetime of this object as a trace event
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char *event_name);
+        ~TraceScope();
+        /// attach the counters of an operation to the event
+        void set_args(const OpStats &s);
+        /// attach a JSON object body to the event
+        void set_args(const std::string &a) { args = a; }
+
+    private:
+        TraceScope(const TraceScope &);
+        TraceScope &operator=(const TraceScope &);
+
+        const char *name;
+        bool active;
+        std::chrono::steady_clock::time_point begin;
+        std::string args;
+    };
+
+} // end namespace
+
+// end file trace.hpp
@@ -0,0 +1,90 @@
+/*
+ *  Copyright 2012 Anders Wallin (anders.e.e.wallin "at" gmail.com)
+ *
+ *  This file is part of libcutsim.
+ *
+ *  libcutsim is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libcutsim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "octnode.hpp"
+
+#if defined(__GNUC__)
+#define CUTSIM_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define CUTSIM_PREFETCH(address)
+#endif
+
+namespace cutsim
+{
+
+    /// depth-first traversal of the sub-tree at root, with an explicit stack.
+    ///
+    /// The Visitor provides
+    ///  - bool pre(Octnode*) called on each node before its children, returns true to descend into them.
+    ///    pre() may create the children of the node (subdivide) before returning true.
+    ///  - void post(Octnode*) called after all children of a node that was descended into,
+    ///    where the children may be deleted (pruned).
+    ///
+    /// Children are visited in the order 0..7, as in a recursive traversal.
+    /// The stack lives in a fixed-size array, so a traversal does not allocate. Below depth
+    /// max_stack_depth, which octrees of practical size never reach, the traversal recurses.
+    template <class Visitor>
+    void traverse(Octnode *root, Visitor &visitor)
+    {
+        static const unsigned int max_stack_depth = 32;
+        struct Entry
+        {
+            Octnode *node;
+            bool descended; // children pushed, post() due when popped again
+        };
+        Entry stack[8 * max_stack_depth + 1];
+        unsigned int top = 0;
+        stack[top++] = Entry{root, false};
+        while (top)
+        {
+            Entry &e = stack[top - 1];
+            Octnode *node = e.node;
+            if (e.descended)
+            {
+                --top;
+                visitor.post(node);
+                continue;
+            }
+            if (!visitor.pre(node) || node->isLeaf())
+            {
+                --top;
+                continue;
+            }
+            if (top + 8 > 8 * max_stack_depth + 1)
+            { // stack full, continue recursively
+                --top;
+                for (int m = 0; m < 8; ++m)
+                    traverse(node->child(m), visitor);
+                visitor.post(node);
+                continue;
+            }
+            e.descended = true;
+            for (int m = 7; m >= 0; --m)
+            {
+                CUTSIM_PREFETCH(node->child(m));
+                stack[top++] = Entry{node->child(m), false};
+            }
+        }
+    }
+
+} // end namespace
+
+// end file traversal.hpp
@@ -18,6 +18,7 @@
  *  along with libcutsim.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -28,6 +29,79 @@
 namespace cutsim
 {
 
+	namespace
+	{
+		/// squared distance from x to the nearest point of [lo, hi]
+		inline float near2(float x, float lo, float hi)
+		{
+			float d = (x < lo) ? lo - x : ((x > hi) ? x - hi : 0);
+			return d * d;
+		}
+		/// squared distance from x to the farthest point of [lo, hi]
+		inline float far2(float x, float lo, float hi)
+		{
+			float d = std::max(fabs(x - lo), fabs(x - hi));
+			return d * d;
+		}
+		/// true if the segment a-b touches the rectangle [x0, x1] x [y0, y1] (Liang-Barsky clipping)
+		bool segment_hits_rect(const GLVertex &a, const GLVertex &b, float x0, float y0, float x1, float y1)
+		{
+			float t0 = 0, t1 = 1;
+			const float p[4] = {a.x - b.x, b.x - a.x, a.y - b.y, b.y - a.y};
+			const float q[4] = {a.x - x0, x1 - a.x, a.y - y0, y1 - a.y};
+			for (int i = 0; i < 4; ++i)
+			{
+				if (p[i] == 0)
+				{ // parallel to the side, outside of it or not
+					if (q[i] < 0)
+						return false;
+					continue;
+				}
+				float t = q[i] / p[i];
+				if (p[i] < 0)
+					t0 = std::max(t0, t);
+				else
+					t1 = std::min(t1, t);
+				if (t0 > t1)
+					return false;
+			}
+			return true;
+		}
+		/// true if (x, y) is inside the closed polygon, by counting edge crossings
+		bool inside_polygon(const std::vector<GLVertex> &polygon, float x, float y)
+		{
+			bool inside = false;
+			for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+			{
+				const GLVertex &a = polygon[j];
+				const GLVertex &b = polygon[i];
+				if (((a.y > y) != (b.y > y)) && (x < a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y)))
+					inside = !inside;
+			}
+			return inside;
+		}
+	} // end anonymous namespace
+
+	//************* Volume **************/
+
+	Volume::Overlap Volume::classify(const Bbox &box) const
+	{
+		if (!bb.overlaps(box))
+			return OUTSIDE;
+		float lipschitz_bound = lipschitz();
+		if (lipschitz_bound > 0)
+		{ // dist() at the box center bounds dist() over the whole box
+			GLVertex c = (box.minpt + box.maxpt) * 0.5;
+			float r = lipschitz_bound * (box.maxpt - box.minpt).norm() * 0.5;
+			float d = dist(c);
+			if (d > r)
+				return INSIDE;
+			if (d < -r)
+				return OUTSIDE;
+		}
+		return STRADDLES;
+	}
+
 	//************* Sphere **************/
 
 	/// sphere at center
@@ -44,6 +118,16 @@ namespace cutsim
 		return radius - d; // positive inside. negative outside.
 	}
 
+	Volume::Overlap SphereVolume::classify(const Bbox &box) const
+	{
+		float r2 = radius * radius;
+		if (near2(center.x, box.minpt.x, box.maxpt.x) + near2(center.y, box.minpt.y, box.maxpt.y) + near2(center.z, box.minpt.z, box.maxpt.z) > r2)
+			return OUTSIDE;
+		if (far2(center.x, box.minpt.x, box.maxpt.x) + far2(center.y, box.minpt.y, box.maxpt.y) + far2(center.z, box.minpt.z, box.maxpt.z) < r2)
+			return INSIDE;
+		return STRADDLES;
+	}
+
 	/// set the bounding box values
 	void SphereVolume::calcBB()
 	{
@@ -88,6 +172,55 @@ namespace cutsim
 		// positive inside. negative outside.
 	}
 
+	Volume::Overlap CubeVolume::classify(const Bbox &box) const
+	{
+		float h = side / 2.0;
+		if (box.maxpt.x < center.x - h || box.minpt.x > center.x + h ||
+			box.maxpt.y < center.y - h || box.minpt.y > center.y + h ||
+			box.maxpt.z < center.z - h || box.minpt.z > center.z + h)
+			return OUTSIDE;
+		if (box.minpt.x > center.x - h && box.maxpt.x < center.x + h &&
+			box.minpt.y > center.y - h && box.maxpt.y < center.y + h &&
+			box.minpt.z > center.z - h && box.maxpt.z < center.z + h)
+			return INSIDE;
+		return STRADDLES;
+	}
+
+	//************* Box **************/
+
+	BoxVolume::BoxVolume()
+	{
+		center = GLVertex(0, 0, 0);
+		lx = ly = lz = 1.0;
+		calcBB();
+	}
+
+	void BoxVolume::calcBB()
+	{
+		bb.clear();
+		bb.addPoint(GLVertex(center.x + lx / 2, center.y + ly / 2, center.z + lz / 2));
+		bb.addPoint(GLVertex(center.x - lx / 2, center.y - ly / 2, center.z - lz / 2));
+	}
+
+	float BoxVolume::dist(const GLVertex &p) const
+	{
+		// distance to the nearest face plane, positive inside.
+		return std::min(lx / 2 - fabs(p.x - center.x), std::min(ly / 2 - fabs(p.y - center.y), lz / 2 - fabs(p.z - center.z)));
+	}
+
+	Volume::Overlap BoxVolume::classify(const Bbox &box) const
+	{
+		if (box.maxpt.x < bb.minpt.x || box.minpt.x > bb.maxpt.x ||
+			box.maxpt.y < bb.minpt.y || box.minpt.y > bb.maxpt.y ||
+			box.maxpt.z < bb.minpt.z || box.minpt.z > bb.maxpt.z)
+			return OUTSIDE;
+		if (box.minpt.x > bb.minpt.x && box.maxpt.x < bb.maxpt.x &&
+			box.minpt.y > bb.minpt.y && box.maxpt.y < bb.maxpt.y &&
+			box.minpt.z > bb.minpt.z && box.maxpt.z < bb.maxpt.z)
+			return INSIDE;
+		return STRADDLES;
+	}
+
 	//************* Cone **************/
 
 	float ConeVolume::dist(const GLVertex &p) const
@@ -105,6 +238,24 @@ namespace cutsim
 		//    return 0;
 	}
 
+	// the xy and z extents of the box are independent, so the tests below are exact
+	Volume::Overlap ConeVolume::classify(const Bbox &box) const
+	{
+		if (!bb.overlaps(box) || box.maxpt.z <= center.z)
+			return OUTSIDE;
+		float t = tan(alfa);
+		float rmax = (box.maxpt.z - center.z) * t; // widest cone section within the box
+		if (near2(center.x, box.minpt.x, box.maxpt.x) + near2(center.y, box.minpt.y, box.maxpt.y) >= rmax * rmax)
+			return OUTSIDE;
+		if (box.minpt.z > center.z)
+		{
+			float rmin = (box.minpt.z - center.z) * t; // narrowest cone section within the box
+			if (far2(center.x, box.minpt.x, box.maxpt.x) + far2(center.y, box.minpt.y, box.maxpt.y) < rmin * rmin)
+				return INSIDE;
+		}
+		return STRADDLES;
+	}
+
 	void ConeVolume::calcBB()
 	{
 		bb.clear();
@@ -114,6 +265,112 @@ namespace cutsim
 		bb.addPoint(minpt);
 	}
 
+	//************* Cylinder **************/
+
+	CylinderVolume::CylinderVolume()
+	{
+		center = GLVertex(0, 0, 0);
+		radius = 1.0;
+		length = 10.0;
+		calcBB();
+	}
+
+	float CylinderVolume::dist(const GLVertex &p) const
+	{
+		float h = p.z - center.z;
+		float dxy = sqrt((p.x - center.x) * (p.x - center.x) + (p.y - center.y) * (p.y - center.y));
+		// distance to the side, the bottom, and the top. positive inside.
+		return std::min(radius - dxy, std::min(h, length - h));
+	}
+
+	Volume::Overlap CylinderVolume::classify(const Bbox &box) const
+	{
+		float r2 = radius * radius;
+		if (box.maxpt.z < center.z || box.minpt.z > center.z + length ||
+			near2(center.x, box.minpt.x, box.maxpt.x) + near2(center.y, box.minpt.y, box.maxpt.y) > r2)
+			return OUTSIDE;
+		if (box.minpt.z > center.z && box.maxpt.z < center.z + length &&
+			far2(center.x, box.minpt.x, box.maxpt.x) + far2(center.y, box.minpt.y, box.maxpt.y) < r2)
+			return INSIDE;
+		return STRADDLES;
+	}
+
+	void CylinderVolume::calcBB()
+	{
+		bb.clear();
+		GLVertex maxpt = GLVertex(center.x + radius, center.y + radius, center.z + length);
+		GLVertex minpt = GLVertex(center.x - radius, center.y - radius, center.z);
+		bb.addPoint(maxpt);
+		bb.addPoint(minpt);
+	}
+
+	//************* Extrusion **************/
+
+	ExtrusionVolume::ExtrusionVolume()
+	{
+		center = GLVertex(0, 0, 0);
+		length = 1.0;
+		calcBB();
+	}
+
+	float ExtrusionVolume::dist(const GLVertex &p) const
+	{
+		if (profile.size() < 3)
+			return -1;
+		float x = p.x - center.x;
+		float y = p.y - center.y;
+		// distance to the nearest profile edge, and inside/outside by counting edge crossings
+		float d2 = -1;
+		bool inside = false;
+		for (std::size_t i = 0, j = profile.size() - 1; i < profile.size(); j = i++)
+		{
+			const GLVertex &a = profile[j];
+			const GLVertex &b = profile[i];
+			float ex = b.x - a.x, ey = b.y - a.y;
+			float wx = x - a.x, wy = y - a.y;
+			float len2 = ex * ex + ey * ey;
+			float t = (len2 > 0) ? std::max(0.0f, std::min(1.0f, (wx * ex + wy * ey) / len2)) : 0;
+			float dx = wx - t * ex, dy = wy - t * ey;
+			float e2 = dx * dx + dy * dy;
+			if (d2 < 0 || e2 < d2)
+				d2 = e2;
+			if (((a.y > y) != (b.y > y)) && (x < a.x + (y - a.y) * ex / ey))
+				inside = !inside;
+		}
+		float dxy = inside ? sqrt(d2) : -sqrt(d2);
+		float h = p.z - center.z;
+		// distance to the side, the bottom, and the top. positive inside.
+		return std::min(dxy, std::min(h, length - h));
+	}
+
+	Volume::Overlap ExtrusionVolume::classify(const Bbox &box) const
+	{
+		if (!valid() || !bb.overlaps(box))
+			return OUTSIDE;
+		// the rectangle of the box relative to the profile
+		float x0 = box.minpt.x - center.x, x1 = box.maxpt.x - center.x;
+		float y0 = box.minpt.y - center.y, y1 = box.maxpt.y - center.y;
+		for (std::size_t i = 0, j = profile.size() - 1; i < profile.size(); j = i++)
+			if (segment_hits_rect(profile[j], profile[i], x0, y0, x1, y1))
+				return STRADDLES;
+		// no profile edge in the rectangle, all of it is on the side of its center
+		if (!inside_polygon(profile, (x0 + x1) / 2, (y0 + y1) / 2))
+			return OUTSIDE;
+		if (box.minpt.z > center.z && box.maxpt.z < center.z + length)
+			return INSIDE;
+		return STRADDLES;
+	}
+
+	void ExtrusionVolume::calcBB()
+	{
+		bb.clear();
+		for (std::size_t n = 0; n < profile.size(); ++n)
+		{
+			bb.addPoint(GLVertex(center.x + profile[n].x, center.y + profile[n].y, center.z));
+			bb.addPoint(GLVertex(center.x + profile[n].x, center.y + profile[n].y, center.z + length));
+		}
+	}
+
 	//************* STL **************/
 
 	MeshVolume::MeshVolume()
@@ -284,13 +541,13 @@ namespace cutsim
 		return ret; // positive inside. negative outside.
 	}
 
-	bool MeshVolume::loadMesh(boost::python::list pyfacets)
+	bool MeshVolume::loadMesh(const std::vector<Facet> &meshFacets)
 	{
 
 		FileIO mesh;
 		facets.clear();
 		bool processed = false;
-		processed = mesh.loadMesh(pyfacets);
+		processed = mesh.loadMesh(meshFacets);
 
 		if (processed)
 		{
@@ -302,13 +559,13 @@ namespace cutsim
 		return processed;
 	}
 
-	bool MeshVolume::loadStl(boost::python::str fPath)
+	bool MeshVolume::loadStl(const std::string &filePath)
 	{
 
 		FileIO stl;
 		facets.clear();
 		bool processed = false;
-		processed = stl.loadStl(fPath);
+		processed = stl.loadStl(filePath);
 
 		if (processed)
 		{
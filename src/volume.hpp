@@ -22,6 +22,8 @@
 
 #include <iostream>
 #include <list>
+#include <string>
+#include <vector>
 #include <cassert>
 
 #include "bbox.hpp"
@@ -60,10 +62,39 @@ namespace cutsim
     {
     public:
         Volume() {}
+        virtual ~Volume() {}
         /// return signed distance from volume surface to Point p
         /// Points p inside the volume should return positive values.
         /// Points p outside the volume should return negative values.
         virtual float dist(const GLVertex &p) const { return 0; }
+        /// Lipschitz constant L of dist(), i.e. |dist(p) - dist(q)| <= L*|p - q| for all p, q.
+        /// With L > 0 one dist() evaluation at the center of an octree node bounds dist()
+        /// over the whole node, so the node can be classified without subdividing it.
+        /// 0 means no such bound is known, and nodes are classified from their corners only.
+        virtual float lipschitz() const { return 0; }
+
+        /// position of an axis-aligned box relative to the volume
+        enum Overlap
+        {
+            OUTSIDE,  ///< dist() < 0 everywhere in the box
+            INSIDE,   ///< dist() > 0 everywhere in the box
+            STRADDLES ///< the box may contain parts of the surface
+        };
+        /// classify the box as outside, inside, or straddling the surface of the volume.
+        /// OUTSIDE and INSIDE must be certain, STRADDLES is always a safe answer.
+        /// The default uses the bounding-box and, if known, the lipschitz() bound.
+        virtual Overlap classify(const Bbox &box) const;
+        /// true if classify() is exact, i.e. STRADDLES only for boxes that the surface crosses.
+        /// Sum then subdivides a straddling node even if none of its corners is inside, so that
+        /// a volume smaller than the node is not lost. With the loose default classify() that
+        /// would subdivide all of the bounding-box, so it is done for exact volumes only.
+        virtual bool exact_classify() const { return false; }
+        /// true if dist() costs much more than the lookup of Octree::set_dist_cache(), which
+        /// is used for such volumes only. The closed-form primitives are cheaper to re-evaluate.
+        virtual bool expensive_dist() const { return false; }
+        /// false for a volume that dist() can not be evaluated for, e.g. an extrusion of fewer
+        /// than 3 profile points. The operations of Cutsim refuse it with an error.
+        virtual bool valid() const { return true; }
         /// set the color
         void setColor(float r, float g, float b)
         {
@@ -105,6 +136,10 @@ namespace cutsim
         /// update the Bbox
         virtual void calcBB();
         virtual float dist(const GLVertex &p) const;
+        /// dist() is the exact Euclidean distance
+        virtual float lipschitz() const { return 1; }
+        virtual Overlap classify(const Bbox &box) const;
+        virtual bool exact_classify() const { return true; }
         float radius; ///< radius of sphere
     };
 
@@ -114,6 +149,10 @@ namespace cutsim
     public:
         CubeVolume();
         virtual float dist(const GLVertex &p) const;
+        /// the max-norm distance changes no faster than the Euclidean distance
+        virtual float lipschitz() const { return 1; }
+        virtual Overlap classify(const Bbox &box) const;
+        virtual bool exact_classify() const { return true; }
         void setSide(float s)
         {
             side = s;
@@ -124,6 +163,31 @@ namespace cutsim
         float side; ///< side length of cube
     };
 
+    /// axis-aligned box at center with side-lengths lx, ly, lz, e.g. for rectangular stock
+    class BoxVolume : public Volume
+    {
+    public:
+        BoxVolume();
+        virtual float dist(const GLVertex &p) const;
+        /// the max-norm distance changes no faster than the Euclidean distance
+        virtual float lipschitz() const { return 1; }
+        virtual Overlap classify(const Bbox &box) const;
+        virtual bool exact_classify() const { return true; }
+        /// set the side-lengths
+        void setSize(float x, float y, float z)
+        {
+            lx = x;
+            ly = y;
+            lz = z;
+            calcBB();
+        }
+        void calcBB();
+        // DATA
+        float lx; ///< side length along x
+        float ly; ///< side length along y
+        float lz; ///< side length along z
+    };
+
     /// cone, for v-carving sim
     class ConeVolume : public Volume
     {
@@ -134,6 +198,8 @@ namespace cutsim
             setHeight(10);
         }
         virtual float dist(const GLVertex &p) const;
+        virtual Overlap classify(const Bbox &box) const;
+        virtual bool exact_classify() const { return true; }
         void setHeight(float h)
         {
             height = h;
@@ -145,6 +211,73 @@ namespace cutsim
         float alfa;   ///< half-angle of cone
     };
 
+    /// cylinder along the z-axis, for flat end-mills and drills.
+    /// center is the center of the bottom face.
+    class CylinderVolume : public Volume
+    {
+    public:
+        CylinderVolume();
+        virtual float dist(const GLVertex &p) const;
+        /// dist() is a Euclidean distance, or a minimum of them
+        virtual float lipschitz() const { return 1; }
+        virtual Overlap classify(const Bbox &box) const;
+        virtual bool exact_classify() const { return true; }
+        /// set radius of cylinder
+        void setRadius(float r)
+        {
+            radius = r;
+            calcBB();
+        }
+        /// set length of cylinder
+        void setLength(float l)
+        {
+            length = l;
+            calcBB();
+        }
+        void calcBB();
+        // DATA
+        float radius; ///< radius of cylinder
+        float length; ///< length of cylinder
+    };
+
+    /// closed polygon profile in the xy-plane extruded along z, e.g. for stock cut from a plate.
+    /// profile points are relative to center, which is on the bottom face.
+    class ExtrusionVolume : public Volume
+    {
+    public:
+        ExtrusionVolume();
+        virtual float dist(const GLVertex &p) const;
+        /// dist() is a Euclidean distance, or a minimum of them
+        virtual float lipschitz() const { return 1; }
+        /// exact against the profile edges, so that only the boxes along the surface straddle it
+        virtual Overlap classify(const Bbox &box) const;
+        virtual bool exact_classify() const { return true; }
+        /// a profile needs at least 3 points
+        virtual bool valid() const { return profile.size() >= 3; }
+        /// add a point to the profile. the last point connects back to the first.
+        void addPoint(float x, float y)
+        {
+            profile.push_back(GLVertex(x, y, 0));
+            calcBB();
+        }
+        /// remove all points of the profile
+        void clearProfile()
+        {
+            profile.clear();
+            calcBB();
+        }
+        /// set length of extrusion
+        void setLength(float l)
+        {
+            length = l;
+            calcBB();
+        }
+        void calcBB();
+        // DATA
+        std::vector<GLVertex> profile; ///< the profile polygon, z is not used
+        float length;                  ///< length of extrusion
+    };
+
     /// STL volume
     class MeshVolume : public Volume
     {
@@ -193,12 +326,14 @@ namespace cutsim
         void calcBB();
 
         virtual float dist(const GLVertex &p) const;
+        /// dist() visits every facet
+        virtual bool expensive_dist() const { return true; }
 
-        // load mesh from facet data
-        bool loadMesh(boost::python::list);
+        /// load mesh from facet data
+        bool loadMesh(const std::vector<Facet> &meshFacets);
 
-        // load mesh from stl file
-        bool loadStl(boost::python::str);
+        /// load mesh from stl file
+        bool loadStl(const std::string &filePath);
 
     private:
         // V21[i] = facets[i]->v2 - facets[i]->v1